@@ -9,7 +9,7 @@
 #define DESCRIPTOR_SET_ID           (0)
 #define ATOMIC_COUNTER_SET_ID       (1)
 
-#define ILC_MAX_STRIDE_CONSTANTS    (8)
+#define ILC_MAX_STRIDE_CONSTANTS    (8) // Stride indexes double as specialization constant IDs
 
 typedef enum _IlcBindingType {
     ILC_BINDING_SAMPLER,
@@ -1520,6 +1520,21 @@ static void emitSrv(
                                               2, indexesId);
         strideId = ilcSpvPutLoad(compiler->module, compiler->intId, ptrId);
 
+        if (compiler->kernel->shaderType == IL_SHADER_VERTEX) {
+            // Prefer the specialized stride when the pipeline provides one (non-zero),
+            // only the vertex stage gets specialization info
+            IlcSpvWord specId = compiler->currentStrideIndex;
+            IlcSpvId specStrideId = ilcSpvPutSpecConstant(compiler->module, compiler->intId, 0);
+            ilcSpvPutDecoration(compiler->module, specStrideId, SpvDecorationSpecId, 1, &specId);
+            ilcSpvPutName(compiler->module, specStrideId, "specStride");
+
+            IlcSpvId zeroId = ilcSpvPutConstant(compiler->module, compiler->intId, 0);
+            IlcSpvId isSpecializedId = ilcSpvPutOp2(compiler->module, SpvOpINotEqual,
+                                                    compiler->boolId, specStrideId, zeroId);
+            strideId = ilcSpvPutSelect(compiler->module, compiler->intId, isSpecializedId,
+                                       specStrideId, strideId);
+        }
+
         compiler->currentStrideIndex++;
     }
 
@@ -1,7 +1,16 @@
 #include "mantle_internal.h"
 #include "amdilc.h"
 
-#define SETS_PER_POOL   (2048)
+#define SETS_PER_POOL               (2048)
+#define MIN_DESCRIPTORS_PER_TYPE    (64)
+#define USAGE_DECAY_THRESHOLD       (16 * SETS_PER_POOL)
+#define UPLOAD_BUFFER_SIZE          (1024 * 1024)
+#define INVALID_MEMORY_TYPE_INDEX   (~0u)
+#define MIN_UPLOAD_SIZE             (4 * 1024) // Smaller updates are inlined in the command buffer
+#define MAX_INLINE_UPDATE_SIZE      (65536) // vkCmdUpdateBuffer limit
+#define ATOMIC_COUNTER_STAGES       (VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT | \
+                                     VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | \
+                                     VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT)
 
 typedef enum _DirtyFlags {
     FLAG_DIRTY_DESCRIPTOR_SET       = 1u << 0,
@@ -10,21 +19,73 @@ typedef enum _DirtyFlags {
     FLAG_DIRTY_DYNAMIC_OFFSET       = 1u << 3,
 } DirtyFlags;
 
-static VkDescriptorPool getVkDescriptorPool(
-    const GrDevice* grDevice)
+typedef enum _DynamicStateFlags {
+    DYNAMIC_STATE_VIEWPORT                  = 1u << 0,
+    DYNAMIC_STATE_SCISSOR                   = 1u << 1,
+    DYNAMIC_STATE_POLYGON_MODE              = 1u << 2,
+    DYNAMIC_STATE_CULL_MODE                 = 1u << 3,
+    DYNAMIC_STATE_FRONT_FACE                = 1u << 4,
+    DYNAMIC_STATE_DEPTH_BIAS                = 1u << 5,
+    DYNAMIC_STATE_DEPTH_TEST_ENABLE         = 1u << 6,
+    DYNAMIC_STATE_DEPTH_WRITE_ENABLE        = 1u << 7,
+    DYNAMIC_STATE_DEPTH_COMPARE_OP          = 1u << 8,
+    DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE  = 1u << 9,
+    DYNAMIC_STATE_STENCIL_TEST_ENABLE       = 1u << 10,
+    DYNAMIC_STATE_STENCIL_OP                = 1u << 11, // Front, back is shifted by one
+    DYNAMIC_STATE_STENCIL_COMPARE_MASK      = 1u << 13, // Front, back is shifted by one
+    DYNAMIC_STATE_STENCIL_WRITE_MASK        = 1u << 15, // Front, back is shifted by one
+    DYNAMIC_STATE_STENCIL_REFERENCE         = 1u << 17, // Front, back is shifted by one
+    DYNAMIC_STATE_DEPTH_BOUNDS              = 1u << 19,
+    DYNAMIC_STATE_COLOR_BLEND_ENABLE        = 1u << 20,
+    DYNAMIC_STATE_COLOR_BLEND_EQUATION      = 1u << 21,
+    DYNAMIC_STATE_BLEND_CONSTANTS           = 1u << 22,
+    DYNAMIC_STATE_RASTERIZATION_SAMPLES     = 1u << 23,
+    DYNAMIC_STATE_SAMPLE_MASK               = 1u << 24,
+} DynamicStateFlags;
+
+// Descriptor types used by pipeline layouts
+static const VkDescriptorType mPoolDescriptorTypes[] = {
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+};
+
+static DescriptorPool createDescriptorPool(
+    GrDevice* grDevice,
+    const uint32_t* minDescriptorCounts)
 {
-    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
-
-    // TODO rebalance
-    const VkDescriptorPoolSize poolSizes[] = {
-        { VK_DESCRIPTOR_TYPE_SAMPLER,                   SETS_PER_POOL },
-        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,             SETS_PER_POOL },
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,             SETS_PER_POOL },
-        { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER,      SETS_PER_POOL },
-        { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER,      SETS_PER_POOL },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,            SETS_PER_POOL },
-        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,    SETS_PER_POOL },
+    DescriptorPool descriptorPool = {
+        .descriptorPool = VK_NULL_HANDLE, // Initialized below
+        .descriptorCounts = { 0 }, // Initialized below
     };
+    VkDescriptorPoolSize poolSizes[COUNT_OF(mPoolDescriptorTypes)];
+    uint64_t footprint = 0;
+
+    for (unsigned i = 0; i < COUNT_OF(mPoolDescriptorTypes); i++) {
+        VkDescriptorType descriptorType = mPoolDescriptorTypes[i];
+        uint32_t count = SETS_PER_POOL;
+
+        if (grDevice->descriptorSetUsage > 0) {
+            // Follow the observed per-set usage with some headroom
+            count = CEILDIV(5 * SETS_PER_POOL * grDevice->descriptorUsage[descriptorType],
+                            4 * grDevice->descriptorSetUsage);
+            count = MAX(count, MIN_DESCRIPTORS_PER_TYPE);
+        }
+
+        // Make sure the requesting layout fits
+        count = MAX(count, minDescriptorCounts[descriptorType]);
+
+        poolSizes[i] = (VkDescriptorPoolSize) {
+            .type = descriptorType,
+            .descriptorCount = count,
+        };
+        descriptorPool.descriptorCounts[descriptorType] = count;
+        footprint += count;
+    }
 
     const VkDescriptorPoolCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
@@ -35,51 +96,891 @@ static VkDescriptorPool getVkDescriptorPool(
         .pPoolSizes = poolSizes,
     };
 
-    VkResult res = VKD.vkCreateDescriptorPool(grDevice->device, &createInfo, NULL, &descriptorPool);
+    VkResult res = VKD.vkCreateDescriptorPool(grDevice->device, &createInfo, NULL,
+                                              &descriptorPool.descriptorPool);
     if (res != VK_SUCCESS) {
         LOGE("vkCreateDescriptorPool failed (%d)\n", res);
         assert(false);
     }
 
+    grDevice->descriptorPoolCount++;
+    grDevice->descriptorPoolFootprint += footprint;
+
+    LOGD("created descriptor pool of %llu descriptors (%u pools, %llu descriptors total, "
+         "%u exhausted pools)\n", footprint, grDevice->descriptorPoolCount,
+         grDevice->descriptorPoolFootprint, grDevice->descriptorPoolFailureCount);
+
     return descriptorPool;
 }
 
-static void updateVkDescriptorSet(
-    const GrDevice* grDevice,
+static void destroyDescriptorPool(
+    GrDevice* grDevice,
+    const DescriptorPool* descriptorPool)
+{
+    VKD.vkDestroyDescriptorPool(grDevice->device, descriptorPool->descriptorPool, NULL);
+
+    grDevice->descriptorPoolCount--;
+    for (unsigned i = 0; i < COUNT_OF(mPoolDescriptorTypes); i++) {
+        grDevice->descriptorPoolFootprint -=
+            descriptorPool->descriptorCounts[mPoolDescriptorTypes[i]];
+    }
+}
+
+static DescriptorPool acquireDescriptorPool(
+    GrDevice* grDevice,
+    const uint32_t* minDescriptorCounts)
+{
+    DescriptorPool descriptorPool;
+
+    AcquireSRWLockExclusive(&grDevice->descriptorPoolLock);
+
+    // Reuse the most recently released pool that fits
+    for (int i = grDevice->freeDescriptorPoolCount - 1; i >= 0; i--) {
+        const DescriptorPool* freePool = &grDevice->freeDescriptorPools[i];
+        bool fits = true;
+
+        for (unsigned j = 0; j < DESCRIPTOR_TYPE_COUNT; j++) {
+            fits &= freePool->descriptorCounts[j] >= minDescriptorCounts[j];
+        }
+
+        if (fits) {
+            descriptorPool = *freePool;
+            grDevice->freeDescriptorPoolCount--;
+            grDevice->freeDescriptorPools[i] =
+                grDevice->freeDescriptorPools[grDevice->freeDescriptorPoolCount];
+
+            ReleaseSRWLockExclusive(&grDevice->descriptorPoolLock);
+            return descriptorPool;
+        }
+    }
+
+    descriptorPool = createDescriptorPool(grDevice, minDescriptorCounts);
+
+    ReleaseSRWLockExclusive(&grDevice->descriptorPoolLock);
+    return descriptorPool;
+}
+
+void grCmdBufferReleaseDescriptorPools(
+    GrCmdBuffer* grCmdBuffer)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+
+    // Only the pools used since the last release need a reset
+    unsigned resetCount = MIN(grCmdBuffer->descriptorPoolIndex + 1,
+                              grCmdBuffer->descriptorPoolCount);
+    for (unsigned i = 0; i < resetCount; i++) {
+        VKD.vkResetDescriptorPool(grDevice->device,
+                                  grCmdBuffer->descriptorPools[i].descriptorPool, 0);
+    }
+
+    AcquireSRWLockExclusive(&grDevice->descriptorPoolLock);
+
+    grDevice->descriptorSetUsage += grCmdBuffer->descriptorSetUsage;
+    for (unsigned i = 0; i < DESCRIPTOR_TYPE_COUNT; i++) {
+        grDevice->descriptorUsage[i] += grCmdBuffer->descriptorUsage[i];
+    }
+    grDevice->descriptorPoolFailureCount += grCmdBuffer->descriptorPoolFailureCount;
+
+    if (grDevice->descriptorSetUsage > USAGE_DECAY_THRESHOLD) {
+        // Let older usage fade out
+        grDevice->descriptorSetUsage /= 2;
+        for (unsigned i = 0; i < DESCRIPTOR_TYPE_COUNT; i++) {
+            grDevice->descriptorUsage[i] /= 2;
+        }
+    }
+
+    // Keep a bounded number of pools around, the rest goes away
+    for (unsigned i = 0; i < grCmdBuffer->descriptorPoolCount; i++) {
+        const DescriptorPool* descriptorPool = &grCmdBuffer->descriptorPools[i];
+
+        if (grDevice->freeDescriptorPoolCount < MAX_FREE_DESCRIPTOR_POOLS) {
+            grDevice->freeDescriptorPools[grDevice->freeDescriptorPoolCount] = *descriptorPool;
+            grDevice->freeDescriptorPoolCount++;
+        } else {
+            destroyDescriptorPool(grDevice, descriptorPool);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->descriptorPoolLock);
+
+    grCmdBuffer->descriptorPoolCount = 0;
+    grCmdBuffer->descriptorPoolIndex = 0;
+    grCmdBuffer->descriptorSetUsage = 0;
+    memset(grCmdBuffer->descriptorUsage, 0, sizeof(grCmdBuffer->descriptorUsage));
+    grCmdBuffer->descriptorPoolFailureCount = 0;
+}
+
+void grDeviceDestroyDescriptorPools(
+    GrDevice* grDevice)
+{
+    LOGV("%u descriptor pools, %llu descriptors, %u exhausted pools\n",
+         grDevice->descriptorPoolCount, grDevice->descriptorPoolFootprint,
+         grDevice->descriptorPoolFailureCount);
+
+    for (unsigned i = 0; i < grDevice->freeDescriptorPoolCount; i++) {
+        destroyDescriptorPool(grDevice, &grDevice->freeDescriptorPools[i]);
+    }
+    grDevice->freeDescriptorPoolCount = 0;
+}
+
+// Returns true if the value differs from the last recorded one, in which case the shadow copy is
+// updated and the caller must record the matching vkCmdSet* call
+static bool updateDynamicState(
+    GrCmdBuffer* grCmdBuffer,
+    uint32_t flag,
+    void* shadowValue,
+    const void* value,
+    size_t size)
+{
+    if ((grCmdBuffer->dynamicStateMask & flag) && memcmp(shadowValue, value, size) == 0) {
+        grCmdBuffer->skippedDynamicStateCount++;
+        return false;
+    }
+
+    memcpy(shadowValue, value, size);
+    grCmdBuffer->dynamicStateMask |= flag;
+    grCmdBuffer->emittedDynamicStateCount++;
+    return true;
+}
+
+static bool isDescriptorRangeStale(
+    const DescriptorRange* range)
+{
+    for (unsigned i = 0; i < range->setCount; i++) {
+        const TrackedDescriptorSet* trackedSet = &range->sets[i];
+
+        if (trackedSet->grDescriptorSet->generation != trackedSet->generation) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool hasStaleDescriptorSets(
     const GrCmdBuffer* grCmdBuffer,
+    VkPipelineBindPoint vkBindPoint)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    const BindPoint* bindPoint = &grCmdBuffer->bindPoints[vkBindPoint];
+    const DescriptorRange* ranges = grCmdBuffer->descriptorRanges[vkBindPoint];
+
+    // A destroyed set may have been freed or had its memory reused, so don't dereference any
+    // range set once a descriptor set was destroyed since they were recorded
+    if (grDevice->descriptorSetDestroyCount != bindPoint->rangeSetDestroyCount) {
+        return true;
+    }
+
+    for (unsigned i = 0; i < bindPoint->rangeCount; i++) {
+        if (isDescriptorRangeStale(&ranges[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool isDescriptorRangeCurrent(
     const BindPoint* bindPoint,
-    const GrDescriptorSet* grDescriptorSet,
-    unsigned slotOffset,
-    unsigned updateTemplateSlotCount,
-    const UpdateTemplateSlot* updateTemplateSlots,
-    VkPipelineLayout pipelineLayout)
-{
-    for (unsigned i = 0; i < updateTemplateSlotCount; i++) {
-        const UpdateTemplateSlot* templateSlot = &updateTemplateSlots[i];
-        const DescriptorSetSlot* slot;
-
-        if (templateSlot->isDynamic) {
-            slot = &bindPoint->dynamicMemoryView;
-        } else {
-            slot = &grDescriptorSet->slots[slotOffset];
+    const DescriptorRange* range,
+    unsigned setIndex,
+    const UpdateTemplateSlot* templateSlot)
+{
+    if (templateSlot->isDynamic) {
+        return memcmp(&bindPoint->dynamicMemoryView, &bindPoint->rangeDynamicMemoryView,
+                      sizeof(DescriptorSetSlot)) == 0;
+    }
+
+    return range->sets[0].grDescriptorSet == bindPoint->grDescriptorSets[setIndex] &&
+           range->slotOffset == bindPoint->slotOffsets[setIndex] &&
+           !isDescriptorRangeStale(range);
+}
+
+static const DescriptorSetSlot* flattenDescriptorRange(
+    DescriptorRange* range,
+    const BindPoint* bindPoint,
+    unsigned setIndex,
+    const UpdateTemplateSlot* templateSlot)
+{
+    if (templateSlot->isDynamic) {
+        range->slot = &bindPoint->dynamicMemoryView;
+        range->slotOffset = 0;
+        range->setCount = 0;
+        return range->slot;
+    }
+
+    const GrDescriptorSet* grDescriptorSet = bindPoint->grDescriptorSets[setIndex];
+    const DescriptorSetSlot* slot = &grDescriptorSet->slots[bindPoint->slotOffsets[setIndex]];
+
+    range->slotOffset = bindPoint->slotOffsets[setIndex];
+    range->sets[0] = (TrackedDescriptorSet) {
+        .grDescriptorSet = grDescriptorSet,
+        .generation = grDescriptorSet->generation,
+    };
+    range->setCount = 1;
+
+    for (unsigned i = 0; i < templateSlot->pathDepth; i++) {
+        slot = &slot[templateSlot->path[i]];
+
+        const GrDescriptorSet* nextSet = slot->nested.nextSet;
+
+        range->sets[range->setCount] = (TrackedDescriptorSet) {
+            .grDescriptorSet = nextSet,
+            .generation = nextSet->generation,
+        };
+        range->setCount++;
+        slot = &nextSet->slots[slot->nested.slotOffset];
+    }
+
+    range->slot = slot;
+    return slot;
+}
+
+static DescriptorRange* getDescriptorRanges(
+    GrCmdBuffer* grCmdBuffer,
+    VkPipelineBindPoint vkBindPoint,
+    unsigned rangeCount)
+{
+    if (rangeCount > grCmdBuffer->descriptorRangeCapacities[vkBindPoint]) {
+        // Existing ranges are kept, they may still describe the bound descriptor set
+        grCmdBuffer->descriptorRangeCapacities[vkBindPoint] = MAX(2 * rangeCount, 16);
+        grCmdBuffer->descriptorRanges[vkBindPoint] =
+            realloc(grCmdBuffer->descriptorRanges[vkBindPoint],
+                    grCmdBuffer->descriptorRangeCapacities[vkBindPoint] *
+                    sizeof(DescriptorRange));
+    }
+
+    return grCmdBuffer->descriptorRanges[vkBindPoint];
+}
+
+static void setDescriptorRangesFlattened(
+    const GrDevice* grDevice,
+    BindPoint* bindPoint,
+    unsigned rangeCount)
+{
+    const GrPipeline* grPipeline = bindPoint->grPipeline;
+
+    bindPoint->rangeCount = rangeCount;
+    memcpy(bindPoint->rangeSlotLists, grPipeline->updateTemplateSlotLists,
+           sizeof(bindPoint->rangeSlotLists));
+    bindPoint->rangeSetDestroyCount = grDevice->descriptorSetDestroyCount;
+    bindPoint->rangeDynamicMemoryView = bindPoint->dynamicMemoryView;
+}
+
+static void collectStrides(
+    uint32_t* strides,
+    uint32_t* strideMask,
+    const DescriptorSetSlot* slot,
+    const UpdateTemplateSlot* templateSlot)
+{
+    for (unsigned i = 0; i < templateSlot->strideCount; i++) {
+        unsigned strideIndex = templateSlot->strideOffsets[i] / sizeof(uint32_t);
+
+        strides[strideIndex] = (uint32_t)slot[templateSlot->strideSlotIndexes[i]].buffer.stride;
+        *strideMask |= 1u << strideIndex;
+    }
+}
+
+static VkDescriptorSet findCachedDescriptorSet(
+    const GrCmdBuffer* grCmdBuffer,
+    uint64_t hash,
+    unsigned payloadSize,
+    const void* payload)
+{
+    if (grCmdBuffer->descriptorSetCacheCount == 0) {
+        return VK_NULL_HANDLE;
+    }
+
+    unsigned mask = grCmdBuffer->descriptorSetCacheSize - 1;
+
+    for (unsigned i = hash & mask; ; i = (i + 1) & mask) {
+        const DescriptorSetCacheEntry* entry = &grCmdBuffer->descriptorSetCache[i];
+
+        if (entry->payload == NULL) {
+            return VK_NULL_HANDLE;
+        } else if (entry->hash == hash && entry->payloadSize == payloadSize &&
+                   memcmp(entry->payload, payload, payloadSize) == 0) {
+            return entry->descriptorSet;
+        }
+    }
+}
 
-            for (unsigned j = 0; j < templateSlot->pathDepth; j++) {
-                slot = &slot[templateSlot->path[j]];
-                slot = &slot->nested.nextSet->slots[slot->nested.slotOffset];
+static void insertDescriptorSetCacheEntry(
+    DescriptorSetCacheEntry* cache,
+    unsigned cacheSize,
+    const DescriptorSetCacheEntry* newEntry)
+{
+    unsigned mask = cacheSize - 1;
+
+    for (unsigned i = newEntry->hash & mask; ; i = (i + 1) & mask) {
+        if (cache[i].payload == NULL) {
+            cache[i] = *newEntry;
+            return;
+        }
+    }
+}
+
+static void addCachedDescriptorSet(
+    GrCmdBuffer* grCmdBuffer,
+    uint64_t hash,
+    unsigned payloadSize,
+    const void* payload,
+    VkDescriptorSet descriptorSet)
+{
+    // Keep the load factor under 3/4
+    if (4 * (grCmdBuffer->descriptorSetCacheCount + 1) > 3 * grCmdBuffer->descriptorSetCacheSize) {
+        unsigned newSize = MAX(2 * grCmdBuffer->descriptorSetCacheSize, 64);
+        DescriptorSetCacheEntry* newCache = calloc(newSize, sizeof(DescriptorSetCacheEntry));
+
+        for (unsigned i = 0; i < grCmdBuffer->descriptorSetCacheSize; i++) {
+            const DescriptorSetCacheEntry* entry = &grCmdBuffer->descriptorSetCache[i];
+
+            if (entry->payload != NULL) {
+                insertDescriptorSetCacheEntry(newCache, newSize, entry);
             }
         }
 
-        VKD.vkUpdateDescriptorSetWithTemplate(grDevice->device, bindPoint->descriptorSet,
-                                              templateSlot->updateTemplate, (void*)slot);
+        free(grCmdBuffer->descriptorSetCache);
+        grCmdBuffer->descriptorSetCache = newCache;
+        grCmdBuffer->descriptorSetCacheSize = newSize;
+    }
+
+    const DescriptorSetCacheEntry entry = {
+        .hash = hash,
+        .payloadSize = payloadSize,
+        .payload = malloc(payloadSize),
+        .descriptorSet = descriptorSet,
+    };
+
+    memcpy(entry.payload, payload, payloadSize);
+
+    insertDescriptorSetCacheEntry(grCmdBuffer->descriptorSetCache,
+                                  grCmdBuffer->descriptorSetCacheSize, &entry);
+    grCmdBuffer->descriptorSetCacheCount++;
+}
+
+static void pushStrides(
+    const GrDevice* grDevice,
+    const GrCmdBuffer* grCmdBuffer,
+    VkPipelineLayout pipelineLayout,
+    const uint32_t* strides,
+    uint32_t strideMask)
+{
+    // Pass buffer strides down to the shader, one push per contiguous range
+    for (unsigned i = 0; i < ILC_MAX_STRIDE_CONSTANTS; i++) {
+        unsigned count = 0;
+
+        while (i + count < ILC_MAX_STRIDE_CONSTANTS && (strideMask & (1u << (i + count)))) {
+            count++;
+        }
 
-        // Pass buffer strides down to the shader
-        for (unsigned j = 0; j < templateSlot->strideCount; j++) {
+        if (count > 0) {
             VKD.vkCmdPushConstants(grCmdBuffer->commandBuffer, pipelineLayout,
                                    VK_SHADER_STAGE_VERTEX_BIT,
-                                   templateSlot->strideOffsets[j], sizeof(uint32_t),
-                                   &slot[templateSlot->strideSlotIndexes[j]].buffer.stride);
+                                   i * sizeof(uint32_t), count * sizeof(uint32_t), &strides[i]);
+            i += count;
+        }
+    }
+}
+
+static bool hasWriteAccess(
+    VkAccessFlags2 accessMask)
+{
+    return (accessMask & (VK_ACCESS_2_SHADER_WRITE_BIT |
+                          VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+                          VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                          VK_ACCESS_2_TRANSFER_WRITE_BIT |
+                          VK_ACCESS_2_HOST_WRITE_BIT |
+                          VK_ACCESS_2_MEMORY_WRITE_BIT)) != 0;
+}
+
+static bool isRedundantImageBarrier(
+    const VkImageMemoryBarrier2* barrier)
+{
+    // Read-only accesses on both sides don't need to be ordered
+    return barrier->oldLayout == barrier->newLayout &&
+           !hasWriteAccess(barrier->srcAccessMask) && !hasWriteAccess(barrier->dstAccessMask);
+}
+
+static bool isRedundantBufferBarrier(
+    const VkBufferMemoryBarrier2* barrier)
+{
+    return !hasWriteAccess(barrier->srcAccessMask) && !hasWriteAccess(barrier->dstAccessMask);
+}
+
+static bool rangesOverlap(
+    uint64_t baseA,
+    uint64_t countA,
+    uint64_t baseB,
+    uint64_t countB,
+    uint64_t remaining)
+{
+    return (countB == remaining || baseA < baseB + countB) &&
+           (countA == remaining || baseB < baseA + countA);
+}
+
+static bool subresourceRangesOverlap(
+    const VkImageSubresourceRange* a,
+    const VkImageSubresourceRange* b)
+{
+    return (a->aspectMask & b->aspectMask) != 0 &&
+           rangesOverlap(a->baseMipLevel, a->levelCount, b->baseMipLevel, b->levelCount,
+                         VK_REMAINING_MIP_LEVELS) &&
+           rangesOverlap(a->baseArrayLayer, a->layerCount, b->baseArrayLayer, b->layerCount,
+                         VK_REMAINING_ARRAY_LAYERS);
+}
+
+static void grCmdBufferFlushCopies(
+    GrCmdBuffer* grCmdBuffer)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    VkImageLayout transferLayout = getVkImageLayout(GR_IMAGE_STATE_DATA_TRANSFER);
+
+    switch (grCmdBuffer->copyType) {
+    case COPY_TYPE_NONE:
+        return;
+    case COPY_TYPE_BUFFER:
+        VKD.vkCmdCopyBuffer(grCmdBuffer->commandBuffer,
+                            grCmdBuffer->copySrcBuffer, grCmdBuffer->copyDstBuffer,
+                            grCmdBuffer->copyRegionCount,
+                            (const VkBufferCopy*)grCmdBuffer->copyRegions);
+        break;
+    case COPY_TYPE_IMAGE:
+        VKD.vkCmdCopyImage(grCmdBuffer->commandBuffer,
+                           grCmdBuffer->copySrcImage, transferLayout,
+                           grCmdBuffer->copyDstImage, transferLayout,
+                           grCmdBuffer->copyRegionCount,
+                           (const VkImageCopy*)grCmdBuffer->copyRegions);
+        break;
+    case COPY_TYPE_BUFFER_TO_IMAGE:
+        VKD.vkCmdCopyBufferToImage(grCmdBuffer->commandBuffer,
+                                   grCmdBuffer->copySrcBuffer,
+                                   grCmdBuffer->copyDstImage, transferLayout,
+                                   grCmdBuffer->copyRegionCount,
+                                   (const VkBufferImageCopy*)grCmdBuffer->copyRegions);
+        break;
+    case COPY_TYPE_IMAGE_TO_BUFFER:
+        VKD.vkCmdCopyImageToBuffer(grCmdBuffer->commandBuffer,
+                                   grCmdBuffer->copySrcImage, transferLayout,
+                                   grCmdBuffer->copyDstBuffer,
+                                   grCmdBuffer->copyRegionCount,
+                                   (const VkBufferImageCopy*)grCmdBuffer->copyRegions);
+        break;
+    }
+
+    grCmdBuffer->copyCommandCount++;
+    grCmdBuffer->copyType = COPY_TYPE_NONE;
+    grCmdBuffer->copyRegionCount = 0;
+}
+
+static void grCmdBufferFlushBarriers(
+    GrCmdBuffer* grCmdBuffer)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+
+    // Pending copies were recorded before the barriers
+    grCmdBufferFlushCopies(grCmdBuffer);
+
+    if (grCmdBuffer->imageBarrierCount == 0 && grCmdBuffer->bufferBarrierCount == 0) {
+        return;
+    }
+
+    const VkDependencyInfo dependencyInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .pNext = NULL,
+        .dependencyFlags = 0,
+        .memoryBarrierCount = 0,
+        .pMemoryBarriers = NULL,
+        .bufferMemoryBarrierCount = grCmdBuffer->bufferBarrierCount,
+        .pBufferMemoryBarriers = grCmdBuffer->bufferBarriers,
+        .imageMemoryBarrierCount = grCmdBuffer->imageBarrierCount,
+        .pImageMemoryBarriers = grCmdBuffer->imageBarriers,
+    };
+
+    VKD.vkCmdPipelineBarrier2(grCmdBuffer->commandBuffer, &dependencyInfo);
+
+    grCmdBuffer->emittedBarrierCount += grCmdBuffer->imageBarrierCount +
+                                        grCmdBuffer->bufferBarrierCount;
+    grCmdBuffer->barrierBatchCount++;
+    grCmdBuffer->imageBarrierCount = 0;
+    grCmdBuffer->bufferBarrierCount = 0;
+}
+
+static void grCmdBufferAddImageBarrier(
+    GrCmdBuffer* grCmdBuffer,
+    const VkImageMemoryBarrier2* barrier)
+{
+    for (unsigned i = 0; i < grCmdBuffer->imageBarrierCount; i++) {
+        VkImageMemoryBarrier2* pendingBarrier = &grCmdBuffer->imageBarriers[i];
+
+        if (pendingBarrier->image != barrier->image ||
+            !subresourceRangesOverlap(&pendingBarrier->subresourceRange,
+                                      &barrier->subresourceRange)) {
+            continue;
+        }
+
+        if (pendingBarrier->newLayout != barrier->oldLayout ||
+            memcmp(&pendingBarrier->subresourceRange, &barrier->subresourceRange,
+                   sizeof(barrier->subresourceRange)) != 0) {
+            // Overlapping transitions can't share a batch
+            grCmdBufferFlushBarriers(grCmdBuffer);
+            break;
+        }
+
+        // Nothing was recorded in-between, chain both transitions into one
+        pendingBarrier->dstStageMask = barrier->dstStageMask;
+        pendingBarrier->dstAccessMask = barrier->dstAccessMask;
+        pendingBarrier->newLayout = barrier->newLayout;
+        grCmdBuffer->droppedBarrierCount++;
+
+        if (isRedundantImageBarrier(pendingBarrier)) {
+            // The transitions cancelled each other out
+            grCmdBuffer->imageBarrierCount--;
+            grCmdBuffer->imageBarriers[i] =
+                grCmdBuffer->imageBarriers[grCmdBuffer->imageBarrierCount];
+            grCmdBuffer->droppedBarrierCount++;
+        }
+        return;
+    }
+
+    if (isRedundantImageBarrier(barrier)) {
+        grCmdBuffer->droppedBarrierCount++;
+        return;
+    }
+
+    if (grCmdBuffer->imageBarrierCount == grCmdBuffer->imageBarrierCapacity) {
+        grCmdBuffer->imageBarrierCapacity = MAX(2 * grCmdBuffer->imageBarrierCapacity, 32);
+        grCmdBuffer->imageBarriers = realloc(grCmdBuffer->imageBarriers,
+                                             grCmdBuffer->imageBarrierCapacity *
+                                             sizeof(VkImageMemoryBarrier2));
+    }
+
+    grCmdBuffer->imageBarriers[grCmdBuffer->imageBarrierCount] = *barrier;
+    grCmdBuffer->imageBarrierCount++;
+}
+
+static void grCmdBufferAddBufferBarrier(
+    GrCmdBuffer* grCmdBuffer,
+    const VkBufferMemoryBarrier2* barrier)
+{
+    for (unsigned i = 0; i < grCmdBuffer->bufferBarrierCount; i++) {
+        VkBufferMemoryBarrier2* pendingBarrier = &grCmdBuffer->bufferBarriers[i];
+
+        if (pendingBarrier->buffer != barrier->buffer ||
+            !rangesOverlap(pendingBarrier->offset, pendingBarrier->size,
+                           barrier->offset, barrier->size, VK_WHOLE_SIZE)) {
+            continue;
         }
+
+        if (pendingBarrier->offset != barrier->offset ||
+            pendingBarrier->size != barrier->size) {
+            grCmdBufferFlushBarriers(grCmdBuffer);
+            break;
+        }
+
+        pendingBarrier->dstStageMask = barrier->dstStageMask;
+        pendingBarrier->dstAccessMask = barrier->dstAccessMask;
+        grCmdBuffer->droppedBarrierCount++;
+
+        if (isRedundantBufferBarrier(pendingBarrier)) {
+            grCmdBuffer->bufferBarrierCount--;
+            grCmdBuffer->bufferBarriers[i] =
+                grCmdBuffer->bufferBarriers[grCmdBuffer->bufferBarrierCount];
+            grCmdBuffer->droppedBarrierCount++;
+        }
+        return;
     }
+
+    if (isRedundantBufferBarrier(barrier)) {
+        grCmdBuffer->droppedBarrierCount++;
+        return;
+    }
+
+    if (grCmdBuffer->bufferBarrierCount == grCmdBuffer->bufferBarrierCapacity) {
+        grCmdBuffer->bufferBarrierCapacity = MAX(2 * grCmdBuffer->bufferBarrierCapacity, 32);
+        grCmdBuffer->bufferBarriers = realloc(grCmdBuffer->bufferBarriers,
+                                              grCmdBuffer->bufferBarrierCapacity *
+                                              sizeof(VkBufferMemoryBarrier2));
+    }
+
+    grCmdBuffer->bufferBarriers[grCmdBuffer->bufferBarrierCount] = *barrier;
+    grCmdBuffer->bufferBarrierCount++;
+}
+
+static bool containsSubresourceRange(
+    const VkImageSubresourceRange* outer,
+    const VkImageSubresourceRange* inner)
+{
+    return (outer->aspectMask & inner->aspectMask) == inner->aspectMask &&
+           outer->baseMipLevel <= inner->baseMipLevel &&
+           (outer->levelCount == VK_REMAINING_MIP_LEVELS ||
+            outer->baseMipLevel + outer->levelCount >=
+            inner->baseMipLevel + inner->levelCount) &&
+           outer->baseArrayLayer <= inner->baseArrayLayer &&
+           (outer->layerCount == VK_REMAINING_ARRAY_LAYERS ||
+            outer->baseArrayLayer + outer->layerCount >=
+            inner->baseArrayLayer + inner->layerCount);
+}
+
+static void grCmdBufferEndRendering(
+    GrCmdBuffer* grCmdBuffer)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+
+    if (!grCmdBuffer->isRendering) {
+        return;
+    }
+
+    uint64_t startTicks = profilerGetCommandTicks();
+
+    VKD.vkCmdEndRendering(grCmdBuffer->commandBuffer);
+    grCmdBuffer->isRendering = false;
+
+    profilerAddCommandCounter(&grCmdBuffer->cmdStats, CMD_COUNTER_RENDERING_END, startTicks);
+}
+
+static void flushPendingClear(
+    GrCmdBuffer* grCmdBuffer,
+    const PendingClear* pendingClear)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    const VkImageSubresourceRange* range = &pendingClear->subresourceRange;
+    VkImageLayout imageLayout = pendingClear->imageLayout;
+    bool needsTransition = imageLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+    grCmdBufferEndRendering(grCmdBuffer);
+
+    if (needsTransition) {
+        // The image was already moved to its target state, synchronize with its next users
+        const VkImageMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .pNext = NULL,
+            .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .srcAccessMask = 0,
+            .dstStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED, // Contents get overwritten
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = pendingClear->grImage->image,
+            .subresourceRange = *range,
+        };
+
+        grCmdBufferAddImageBarrier(grCmdBuffer, &barrier);
+        imageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    }
+
+    grCmdBufferFlushBarriers(grCmdBuffer);
+
+    if (range->aspectMask & VK_IMAGE_ASPECT_COLOR_BIT) {
+        VKD.vkCmdClearColorImage(grCmdBuffer->commandBuffer, pendingClear->grImage->image,
+                                 imageLayout, &pendingClear->clearValue.color, 1, range);
+    } else {
+        VKD.vkCmdClearDepthStencilImage(grCmdBuffer->commandBuffer,
+                                        pendingClear->grImage->image, imageLayout,
+                                        &pendingClear->clearValue.depthStencil, 1, range);
+    }
+
+    if (needsTransition) {
+        // Deferred until the next command that needs it
+        const VkImageMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .pNext = NULL,
+            .srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .newLayout = pendingClear->imageLayout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = pendingClear->grImage->image,
+            .subresourceRange = *range,
+        };
+
+        grCmdBufferAddImageBarrier(grCmdBuffer, &barrier);
+    }
+}
+
+static void grCmdBufferFlushClears(
+    GrCmdBuffer* grCmdBuffer,
+    const GrImage* grImage)
+{
+    unsigned pendingClearCount = 0;
+
+    // Flush clears for the given image, or all of them
+    for (unsigned i = 0; i < grCmdBuffer->pendingClearCount; i++) {
+        const PendingClear* pendingClear = &grCmdBuffer->pendingClears[i];
+
+        if (grImage == NULL || pendingClear->grImage == grImage) {
+            flushPendingClear(grCmdBuffer, pendingClear);
+        } else {
+            grCmdBuffer->pendingClears[pendingClearCount] = *pendingClear;
+            pendingClearCount++;
+        }
+    }
+
+    grCmdBuffer->pendingClearCount = pendingClearCount;
+}
+
+static void grCmdBufferAddClear(
+    GrCmdBuffer* grCmdBuffer,
+    const GrImage* grImage,
+    unsigned rangeCount,
+    VkImageSubresourceRange* ranges,
+    VkImageLayout imageLayout,
+    const VkClearValue* clearValue)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    unsigned clearRangeCount = 0;
+
+    // Keep single-level clears around, they may be folded into the next render pass load op
+    for (unsigned i = 0; i < rangeCount; i++) {
+        VkImageSubresourceRange* range = &ranges[i];
+
+        if (grCmdBuffer->pendingClearCount < MAX_PENDING_CLEARS &&
+            grImage->imageType == VK_IMAGE_TYPE_2D && !grImage->multiplyCubeLayers &&
+            range->levelCount == 1) {
+            PendingClear* pendingClear =
+                &grCmdBuffer->pendingClears[grCmdBuffer->pendingClearCount];
+
+            *pendingClear = (PendingClear) {
+                .grImage = grImage,
+                .subresourceRange = *range,
+                .clearValue = *clearValue,
+                .imageLayout = imageLayout,
+            };
+            if (range->layerCount == VK_REMAINING_ARRAY_LAYERS) {
+                pendingClear->subresourceRange.layerCount =
+                    grImage->arrayLayers - range->baseArrayLayer;
+            }
+
+            grCmdBuffer->pendingClearCount++;
+        } else {
+            ranges[clearRangeCount] = *range;
+            clearRangeCount++;
+        }
+    }
+
+    if (clearRangeCount == 0) {
+        return;
+    }
+
+    grCmdBufferFlushBarriers(grCmdBuffer);
+
+    if (ranges[0].aspectMask & VK_IMAGE_ASPECT_COLOR_BIT) {
+        VKD.vkCmdClearColorImage(grCmdBuffer->commandBuffer, grImage->image, imageLayout,
+                                 &clearValue->color, clearRangeCount, ranges);
+    } else {
+        VKD.vkCmdClearDepthStencilImage(grCmdBuffer->commandBuffer, grImage->image, imageLayout,
+                                        &clearValue->depthStencil, clearRangeCount, ranges);
+    }
+}
+
+static void grCmdBufferTransitionClears(
+    GrCmdBuffer* grCmdBuffer,
+    unsigned barrierCount,
+    const VkImageMemoryBarrier2* barriers)
+{
+    unsigned pendingClearCount = 0;
+
+    for (unsigned i = 0; i < grCmdBuffer->pendingClearCount; i++) {
+        PendingClear* pendingClear = &grCmdBuffer->pendingClears[i];
+        VkImageLayout imageLayout = pendingClear->imageLayout;
+        bool isTransitioned = false;
+        bool canFold = true;
+
+        // Clears survive a single transition of the whole cleared range to a target state
+        for (unsigned j = 0; j < barrierCount; j++) {
+            const VkImageMemoryBarrier2* barrier = &barriers[j];
+
+            if (barrier->image != pendingClear->grImage->image) {
+                continue;
+            }
+
+            if (!isTransitioned && barrier->oldLayout == pendingClear->imageLayout &&
+                (barrier->newLayout == VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL ||
+                 barrier->newLayout == VK_IMAGE_LAYOUT_GENERAL) &&
+                containsSubresourceRange(&barrier->subresourceRange,
+                                         &pendingClear->subresourceRange)) {
+                isTransitioned = true;
+                imageLayout = barrier->newLayout;
+            } else {
+                canFold = false;
+            }
+        }
+
+        if (canFold) {
+            pendingClear->imageLayout = imageLayout;
+            grCmdBuffer->pendingClears[pendingClearCount] = *pendingClear;
+            pendingClearCount++;
+        } else {
+            // Must happen before the barriers
+            flushPendingClear(grCmdBuffer, pendingClear);
+        }
+    }
+
+    grCmdBuffer->pendingClearCount = pendingClearCount;
+}
+
+static bool isClearTarget(
+    const GrCmdBuffer* grCmdBuffer,
+    const PendingClear* pendingClear,
+    const GrImage* grImage,
+    unsigned mipLevel,
+    unsigned baseArrayLayer,
+    VkExtent3D extent,
+    const VkRenderingAttachmentInfo* attachment)
+{
+    const VkImageSubresourceRange* range = &pendingClear->subresourceRange;
+
+    // The render area must cover the whole cleared range
+    return pendingClear->grImage == grImage &&
+           range->baseMipLevel == mipLevel &&
+           range->baseArrayLayer == baseArrayLayer &&
+           range->layerCount == extent.depth &&
+           grCmdBuffer->minExtent.width == extent.width &&
+           grCmdBuffer->minExtent.height == extent.height &&
+           grCmdBuffer->minExtent.depth == extent.depth &&
+           attachment->imageLayout == pendingClear->imageLayout &&
+           attachment->storeOp == VK_ATTACHMENT_STORE_OP_STORE;
+}
+
+static VkRenderingAttachmentInfo* findClearAttachment(
+    const GrCmdBuffer* grCmdBuffer,
+    const PendingClear* pendingClear,
+    VkRenderingAttachmentInfo* colorAttachments,
+    VkRenderingAttachmentInfo* depthAttachment,
+    VkRenderingAttachmentInfo* stencilAttachment)
+{
+    VkImageAspectFlags aspectMask = pendingClear->subresourceRange.aspectMask;
+    const GrDepthStencilView* grDepthStencilView = grCmdBuffer->grDepthStencilView;
+
+    if (aspectMask == VK_IMAGE_ASPECT_COLOR_BIT) {
+        for (unsigned i = 0; i < GR_MAX_COLOR_TARGETS; i++) {
+            const GrColorTargetView* grColorTargetView = grCmdBuffer->grColorTargetViews[i];
+
+            if (grColorTargetView != NULL &&
+                isClearTarget(grCmdBuffer, pendingClear, grColorTargetView->grImage,
+                              grColorTargetView->mipLevel, grColorTargetView->baseArrayLayer,
+                              grColorTargetView->extent, &colorAttachments[i])) {
+                return &colorAttachments[i];
+            }
+        }
+    } else if (aspectMask == VK_IMAGE_ASPECT_DEPTH_BIT && grCmdBuffer->hasDepth &&
+               isClearTarget(grCmdBuffer, pendingClear, grDepthStencilView->grImage,
+                             grDepthStencilView->mipLevel, grDepthStencilView->baseArrayLayer,
+                             grDepthStencilView->extent, depthAttachment)) {
+        return depthAttachment;
+    } else if (aspectMask == VK_IMAGE_ASPECT_STENCIL_BIT && grCmdBuffer->hasStencil &&
+               isClearTarget(grCmdBuffer, pendingClear, grDepthStencilView->grImage,
+                             grDepthStencilView->mipLevel, grDepthStencilView->baseArrayLayer,
+                             grDepthStencilView->extent, stencilAttachment)) {
+        return stencilAttachment;
+    }
+
+    return NULL;
 }
 
 static void grCmdBufferBeginRenderPass(
@@ -87,10 +988,42 @@ static void grCmdBufferBeginRenderPass(
 {
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
+    if (grCmdBuffer->imageBarrierCount > 0 || grCmdBuffer->bufferBarrierCount > 0) {
+        // Barriers can't be recorded while rendering
+        grCmdBufferEndRendering(grCmdBuffer);
+    }
+
     if (grCmdBuffer->isRendering) {
         return;
     }
 
+    uint64_t startTicks = profilerGetCommandTicks();
+
+    // Load ops are patched on a copy, bound targets keep loading
+    VkRenderingAttachmentInfo colorAttachments[GR_MAX_COLOR_TARGETS];
+    VkRenderingAttachmentInfo depthAttachment = grCmdBuffer->depthAttachment;
+    VkRenderingAttachmentInfo stencilAttachment = grCmdBuffer->stencilAttachment;
+
+    memcpy(colorAttachments, grCmdBuffer->colorAttachments, sizeof(colorAttachments));
+
+    for (unsigned i = 0; i < grCmdBuffer->pendingClearCount; i++) {
+        const PendingClear* pendingClear = &grCmdBuffer->pendingClears[i];
+        VkRenderingAttachmentInfo* attachment =
+            findClearAttachment(grCmdBuffer, pendingClear, colorAttachments,
+                                &depthAttachment, &stencilAttachment);
+
+        if (attachment != NULL) {
+            attachment->loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            attachment->clearValue = pendingClear->clearValue;
+        } else {
+            flushPendingClear(grCmdBuffer, pendingClear);
+        }
+    }
+
+    grCmdBuffer->pendingClearCount = 0;
+
+    grCmdBufferFlushBarriers(grCmdBuffer);
+
     const VkRenderingInfo renderingInfo = {
         .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
         .pNext = NULL,
@@ -102,49 +1035,157 @@ static void grCmdBufferBeginRenderPass(
         .layerCount = grCmdBuffer->minExtent.depth,
         .viewMask = 0,
         .colorAttachmentCount = GR_MAX_COLOR_TARGETS,
-        .pColorAttachments = grCmdBuffer->colorAttachments,
-        .pDepthAttachment = grCmdBuffer->hasDepth ? &grCmdBuffer->depthAttachment : NULL,
-        .pStencilAttachment = grCmdBuffer->hasStencil ? &grCmdBuffer->stencilAttachment : NULL,
+        .pColorAttachments = colorAttachments,
+        .pDepthAttachment = grCmdBuffer->hasDepth ? &depthAttachment : NULL,
+        .pStencilAttachment = grCmdBuffer->hasStencil ? &stencilAttachment : NULL,
     };
 
     VKD.vkCmdBeginRendering(grCmdBuffer->commandBuffer, &renderingInfo);
     grCmdBuffer->isRendering = true;
+
+    profilerAddCommandCounter(&grCmdBuffer->cmdStats, CMD_COUNTER_RENDERING_BEGIN, startTicks);
 }
 
 void grCmdBufferEndRenderPass(
     GrCmdBuffer* grCmdBuffer)
+{
+    grCmdBufferEndRendering(grCmdBuffer);
+
+    // The following commands may access cleared images
+    grCmdBufferFlushClears(grCmdBuffer, NULL);
+    grCmdBufferFlushBarriers(grCmdBuffer);
+}
+
+static void* grCmdBufferBeginCopy(
+    GrCmdBuffer* grCmdBuffer,
+    CopyType copyType,
+    VkBuffer srcBuffer,
+    VkImage srcImage,
+    VkBuffer dstBuffer,
+    VkImage dstImage,
+    unsigned regionSize,
+    unsigned regionCount)
+{
+    grCmdBufferEndRendering(grCmdBuffer);
+    grCmdBufferFlushClears(grCmdBuffer, NULL);
+
+    if (grCmdBuffer->imageBarrierCount > 0 || grCmdBuffer->bufferBarrierCount > 0) {
+        grCmdBufferFlushBarriers(grCmdBuffer);
+    }
+
+    // Regions of a copy within the same resource must not overlap, keep those apart
+    if (grCmdBuffer->copyType != copyType ||
+        grCmdBuffer->copySrcBuffer != srcBuffer || grCmdBuffer->copySrcImage != srcImage ||
+        grCmdBuffer->copyDstBuffer != dstBuffer || grCmdBuffer->copyDstImage != dstImage ||
+        (srcBuffer != VK_NULL_HANDLE && srcBuffer == dstBuffer) ||
+        (srcImage != VK_NULL_HANDLE && srcImage == dstImage)) {
+        grCmdBufferFlushCopies(grCmdBuffer);
+
+        grCmdBuffer->copyType = copyType;
+        grCmdBuffer->copySrcBuffer = srcBuffer;
+        grCmdBuffer->copySrcImage = srcImage;
+        grCmdBuffer->copyDstBuffer = dstBuffer;
+        grCmdBuffer->copyDstImage = dstImage;
+    } else {
+        grCmdBuffer->batchedCopyCount++;
+    }
+
+    unsigned size = (grCmdBuffer->copyRegionCount + regionCount) * regionSize;
+    if (size > grCmdBuffer->copyRegionCapacity) {
+        grCmdBuffer->copyRegionCapacity = MAX(2 * grCmdBuffer->copyRegionCapacity,
+                                              MAX(size, 4096));
+        grCmdBuffer->copyRegions = realloc(grCmdBuffer->copyRegions,
+                                           grCmdBuffer->copyRegionCapacity);
+    }
+
+    return grCmdBuffer->copyRegions;
+}
+
+void grCmdBufferFlushTimestamps(
+    GrCmdBuffer* grCmdBuffer)
 {
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    const PendingTimestamp* pendingTimestamps = grCmdBuffer->pendingTimestamps;
+    unsigned first = 0;
 
-    if (!grCmdBuffer->isRendering) {
+    if (grCmdBuffer->timestampCount == 0) {
         return;
     }
 
-    VKD.vkCmdEndRendering(grCmdBuffer->commandBuffer);
-    grCmdBuffer->isRendering = false;
+    // Order the copies after the timestamp writes so results don't have to be waited on
+    const VkMemoryBarrier2 barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .pNext = NULL,
+        .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        .srcAccessMask = 0,
+        .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .dstAccessMask = 0,
+    };
+    const VkDependencyInfo dependencyInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .pNext = NULL,
+        .dependencyFlags = 0,
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &barrier,
+        .bufferMemoryBarrierCount = 0,
+        .pBufferMemoryBarriers = NULL,
+        .imageMemoryBarrierCount = 0,
+        .pImageMemoryBarriers = NULL,
+    };
+
+    VKD.vkCmdPipelineBarrier2(grCmdBuffer->commandBuffer, &dependencyInfo);
+
+    // Copy runs of timestamps landing next to each other in a single command
+    for (unsigned i = 1; i <= grCmdBuffer->timestampCount; i++) {
+        if (i < grCmdBuffer->timestampCount &&
+            pendingTimestamps[i].buffer == pendingTimestamps[first].buffer &&
+            pendingTimestamps[i].offset ==
+            pendingTimestamps[first].offset + (i - first) * sizeof(uint64_t)) {
+            continue;
+        }
+
+        VKD.vkCmdCopyQueryPoolResults(grCmdBuffer->commandBuffer,
+                                      grCmdBuffer->timestampQueryPool,
+                                      grCmdBuffer->timestampQueryIndex + first, i - first,
+                                      pendingTimestamps[first].buffer,
+                                      pendingTimestamps[first].offset, sizeof(uint64_t),
+                                      VK_QUERY_RESULT_64_BIT);
+        grCmdBuffer->timestampCopyCount++;
+        first = i;
+    }
+
+    grCmdBuffer->timestampCount = 0;
 }
 
-static void grCmdBufferUpdateDescriptorSet(
+static VkDescriptorSet allocateVkDescriptorSet(
     GrCmdBuffer* grCmdBuffer,
-    VkPipelineBindPoint vkBindPoint)
+    const GrPipeline* grPipeline)
 {
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
-    BindPoint* bindPoint = &grCmdBuffer->bindPoints[vkBindPoint];
-    GrPipeline* grPipeline = bindPoint->grPipeline;
+    GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
     VkResult vkRes;
 
+    // Feed the pool sizing heuristic
+    grCmdBuffer->descriptorSetUsage++;
+    for (unsigned i = 0; i < DESCRIPTOR_TYPE_COUNT; i++) {
+        grCmdBuffer->descriptorUsage[i] += grPipeline->descriptorCounts[i];
+    }
+
     for (unsigned i = 0; i < 2; i++) {
         if (grCmdBuffer->descriptorPoolIndex < grCmdBuffer->descriptorPoolCount) {
+            const DescriptorPool* descriptorPool =
+                &grCmdBuffer->descriptorPools[grCmdBuffer->descriptorPoolIndex];
+
             const VkDescriptorSetAllocateInfo descSetAllocateInfo = {
                 .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
                 .pNext = NULL,
-                .descriptorPool = grCmdBuffer->descriptorPools[grCmdBuffer->descriptorPoolIndex],
+                .descriptorPool = descriptorPool->descriptorPool,
                 .descriptorSetCount = 1,
                 .pSetLayouts = &grPipeline->descriptorSetLayout,
             };
 
             vkRes = VKD.vkAllocateDescriptorSets(grDevice->device, &descSetAllocateInfo,
-                                                 &bindPoint->descriptorSet);
+                                                 &descriptorSet);
             if (vkRes == VK_SUCCESS) {
                 break;
             } else if (vkRes != VK_ERROR_OUT_OF_POOL_MEMORY) {
@@ -155,30 +1196,250 @@ static void grCmdBufferUpdateDescriptorSet(
                 assert(false);
             } else {
                 // Use the next pool
+                grCmdBuffer->descriptorPoolFailureCount++;
                 grCmdBuffer->descriptorPoolIndex++;
             }
         }
 
         if (grCmdBuffer->descriptorPoolIndex == grCmdBuffer->descriptorPoolCount) {
-            // Need to allocate a new pool
-            VkDescriptorPool descriptorPool = getVkDescriptorPool(grDevice);
+            // Borrow a pool from the device, it's given back on reset
+            DescriptorPool descriptorPool =
+                acquireDescriptorPool(grDevice, grPipeline->descriptorCounts);
 
-            // Track descriptor pool
             grCmdBuffer->descriptorPoolCount++;
             grCmdBuffer->descriptorPools = realloc(grCmdBuffer->descriptorPools,
                                                    grCmdBuffer->descriptorPoolCount *
-                                                   sizeof(VkDescriptorPool));
+                                                   sizeof(DescriptorPool));
             grCmdBuffer->descriptorPools[grCmdBuffer->descriptorPoolCount - 1] = descriptorPool;
         }
-    }
+    }
+
+    return descriptorSet;
+}
+
+static unsigned getTemplateSlotCount(
+    const GrPipeline* grPipeline)
+{
+    unsigned templateSlotCount = 0;
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        templateSlotCount += grPipeline->updateTemplateSlotLists[i]->slotCount;
+    }
+
+    return templateSlotCount;
+}
+
+static void grCmdBufferPushDescriptorSet(
+    GrCmdBuffer* grCmdBuffer,
+    VkPipelineBindPoint vkBindPoint)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    BindPoint* bindPoint = &grCmdBuffer->bindPoints[vkBindPoint];
+    const GrPipeline* grPipeline = bindPoint->grPipeline;
+    unsigned rangeCount = getTemplateSlotCount(grPipeline);
+    DescriptorRange* ranges = getDescriptorRanges(grCmdBuffer, vkBindPoint, rangeCount);
+    unsigned rangeIndex = 0;
+
+    bindPoint->strideMask = 0;
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        const UpdateTemplateSlotList* list = grPipeline->updateTemplateSlotLists[i];
+
+        for (unsigned j = 0; j < list->slotCount; j++) {
+            const UpdateTemplateSlot* templateSlot = &list->slots[j];
+            const DescriptorSetSlot* slot =
+                flattenDescriptorRange(&ranges[rangeIndex], bindPoint, i, templateSlot);
+
+            VKD.vkCmdPushDescriptorSetWithTemplateKHR(grCmdBuffer->commandBuffer,
+                                                      templateSlot->updateTemplate,
+                                                      grPipeline->pipelineLayout, 0, slot);
+
+            collectStrides(bindPoint->strides, &bindPoint->strideMask, slot, templateSlot);
+            rangeIndex++;
+        }
+    }
+
+    setDescriptorRangesFlattened(grDevice, bindPoint, rangeCount);
+}
+
+static void copyDescriptorRanges(
+    const GrDevice* grDevice,
+    VkDescriptorSet dstSet,
+    VkDescriptorSet srcSet,
+    const GrPipeline* grPipeline,
+    const bool* isRangeDirty)
+{
+    unsigned copyCount = 0;
+    unsigned rangeIndex = 0;
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        const UpdateTemplateSlotList* list = grPipeline->updateTemplateSlotLists[i];
+
+        for (unsigned j = 0; j < list->slotCount; j++) {
+            if (!isRangeDirty[rangeIndex]) {
+                copyCount += list->slots[j].bindingCount;
+            }
+            rangeIndex++;
+        }
+    }
+
+    if (copyCount == 0) {
+        return;
+    }
+
+    STACK_ARRAY(VkCopyDescriptorSet, copies, 64, copyCount);
+    unsigned copyIndex = 0;
+
+    rangeIndex = 0;
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        const UpdateTemplateSlotList* list = grPipeline->updateTemplateSlotLists[i];
+
+        for (unsigned j = 0; j < list->slotCount; j++) {
+            const UpdateTemplateSlot* templateSlot = &list->slots[j];
+
+            for (unsigned k = 0; !isRangeDirty[rangeIndex] && k < templateSlot->bindingCount;
+                 k++) {
+                copies[copyIndex] = (VkCopyDescriptorSet) {
+                    .sType = VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET,
+                    .pNext = NULL,
+                    .srcSet = srcSet,
+                    .srcBinding = templateSlot->bindings[k],
+                    .srcArrayElement = 0,
+                    .dstSet = dstSet,
+                    .dstBinding = templateSlot->bindings[k],
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                };
+                copyIndex++;
+            }
+            rangeIndex++;
+        }
+    }
+
+    VKD.vkUpdateDescriptorSets(grDevice->device, 0, NULL, copyCount, copies);
+
+    STACK_ARRAY_FINISH(copies);
+}
+
+static void grCmdBufferUpdateDescriptorSet(
+    GrCmdBuffer* grCmdBuffer,
+    VkPipelineBindPoint vkBindPoint)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    BindPoint* bindPoint = &grCmdBuffer->bindPoints[vkBindPoint];
+    const GrPipeline* grPipeline = bindPoint->grPipeline;
+
+    if (grPipeline->usePushDescriptors) {
+        // Small layouts skip set allocation altogether
+        grCmdBufferPushDescriptorSet(grCmdBuffer, vkBindPoint);
+        return;
+    }
+
+    unsigned rangeCount = getTemplateSlotCount(grPipeline);
+    DescriptorRange* ranges = getDescriptorRanges(grCmdBuffer, vkBindPoint, rangeCount);
+    unsigned payloadSize = sizeof(VkDescriptorSetLayout);
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        const UpdateTemplateSlotList* list = grPipeline->updateTemplateSlotLists[i];
+
+        for (unsigned j = 0; j < list->slotCount; j++) {
+            payloadSize += list->slots[j].slotCount * sizeof(DescriptorSetSlot);
+        }
+    }
+
+    // The ranges flattened into the current descriptor set can be checked one by one if it was
+    // built from the same templates, and no set they walked through may have been freed since
+    bool canReuseRanges = bindPoint->descriptorSet != VK_NULL_HANDLE &&
+                          bindPoint->rangeCount == rangeCount &&
+                          memcmp(bindPoint->rangeSlotLists, grPipeline->updateTemplateSlotLists,
+                                 sizeof(bindPoint->rangeSlotLists)) == 0 &&
+                          bindPoint->rangeSetDestroyCount == grDevice->descriptorSetDestroyCount;
+
+    // The payload identifies the descriptor set contents: the layout followed by every slot
+    // read by the update templates
+    STACK_ARRAY(bool, isRangeDirty, 64, rangeCount);
+    STACK_ARRAY(uint8_t, payload, 4096, payloadSize);
+    unsigned rangeIndex = 0;
+    unsigned dirtyRangeCount = 0;
+    unsigned payloadOffset = 0;
+
+    memcpy(payload, &grPipeline->descriptorSetLayout, sizeof(VkDescriptorSetLayout));
+    payloadOffset += sizeof(VkDescriptorSetLayout);
+
+    bindPoint->strideMask = 0;
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        const UpdateTemplateSlotList* list = grPipeline->updateTemplateSlotLists[i];
+
+        for (unsigned j = 0; j < list->slotCount; j++) {
+            const UpdateTemplateSlot* templateSlot = &list->slots[j];
+            DescriptorRange* range = &ranges[rangeIndex];
+            const DescriptorSetSlot* slot = NULL;
+            unsigned size = templateSlot->slotCount * sizeof(DescriptorSetSlot);
+
+            if (canReuseRanges && isDescriptorRangeCurrent(bindPoint, range, i, templateSlot)) {
+                // Nothing changed along the path, no need to walk it again
+                slot = range->slot;
+                isRangeDirty[rangeIndex] = false;
+            } else {
+                slot = flattenDescriptorRange(range, bindPoint, i, templateSlot);
+                isRangeDirty[rangeIndex] = true;
+                dirtyRangeCount++;
+            }
+
+            memcpy(&payload[payloadOffset], &slot[templateSlot->slotIndex], size);
+            payloadOffset += size;
+
+            // Collect buffer strides, they're pushed all at once
+            collectStrides(bindPoint->strides, &bindPoint->strideMask, slot, templateSlot);
+            rangeIndex++;
+        }
+    }
+
+    VkDescriptorSet previousSet = bindPoint->descriptorSet;
+    setDescriptorRangesFlattened(grDevice, bindPoint, rangeCount);
+
+    if (canReuseRanges && dirtyRangeCount == 0) {
+        // The current descriptor set is still up to date
+        STACK_ARRAY_FINISH(payload);
+        STACK_ARRAY_FINISH(isRangeDirty);
+        return;
+    }
+
+    // Reuse a descriptor set with identical contents if there's one
+    uint64_t hash = getHash(payload, payloadSize);
+    VkDescriptorSet descriptorSet = findCachedDescriptorSet(grCmdBuffer, hash,
+                                                            payloadSize, payload);
+
+    if (descriptorSet == VK_NULL_HANDLE) {
+        descriptorSet = allocateVkDescriptorSet(grCmdBuffer, grPipeline);
+
+        if (canReuseRanges) {
+            // Only rewrite the ranges that changed, the rest comes from the previous set
+            copyDescriptorRanges(grDevice, descriptorSet, previousSet, grPipeline, isRangeDirty);
+        }
+
+        rangeIndex = 0;
+        for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+            const UpdateTemplateSlotList* list = grPipeline->updateTemplateSlotLists[i];
+
+            for (unsigned j = 0; j < list->slotCount; j++) {
+                if (isRangeDirty[rangeIndex]) {
+                    VKD.vkUpdateDescriptorSetWithTemplate(grDevice->device, descriptorSet,
+                                                          list->slots[j].updateTemplate,
+                                                          (void*)ranges[rangeIndex].slot);
+                }
+                rangeIndex++;
+            }
+        }
 
-    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        updateVkDescriptorSet(grDevice, grCmdBuffer, bindPoint,
-                              bindPoint->grDescriptorSets[i], bindPoint->slotOffsets[i],
-                              grPipeline->updateTemplateSlotCounts[i],
-                              grPipeline->updateTemplateSlots[i],
-                              grPipeline->pipelineLayout);
+        addCachedDescriptorSet(grCmdBuffer, hash, payloadSize, payload, descriptorSet);
     }
+
+    bindPoint->descriptorSet = descriptorSet;
+
+    STACK_ARRAY_FINISH(payload);
+    STACK_ARRAY_FINISH(isRangeDirty);
 }
 
 static void grCmdBufferBindDescriptorSet(
@@ -200,11 +1461,49 @@ static void grCmdBufferBindDescriptorSet(
         dynamicOffsets[i] = bindPoint->dynamicOffset;
     }
 
+    // The first set is pushed instead of bound with push descriptors
+    unsigned firstSet = grPipeline->usePushDescriptors ? 1 : 0;
+
     VKD.vkCmdBindDescriptorSets(grCmdBuffer->commandBuffer, vkBindPoint, grPipeline->pipelineLayout,
-                                0, COUNT_OF(descriptorSets), descriptorSets,
+                                firstSet, COUNT_OF(descriptorSets) - firstSet,
+                                &descriptorSets[firstSet],
                                 grPipeline->dynamicOffsetCount, dynamicOffsets);
 }
 
+static void grCmdBufferBindGraphicsPipeline(
+    GrCmdBuffer* grCmdBuffer)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    BindPoint* bindPoint = &grCmdBuffer->bindPoints[VK_PIPELINE_BIND_POINT_GRAPHICS];
+    GrPipeline* grPipeline = bindPoint->grPipeline;
+    VkPipeline vkPipeline = VK_NULL_HANDLE;
+
+    if (grPipeline->strideMask != 0 &&
+        (bindPoint->strideMask & grPipeline->strideMask) == grPipeline->strideMask) {
+        // Try to get a variant with the strides baked in
+        vkPipeline = grPipelineGetSpecializedVkPipeline(grPipeline,
+                                                        grCmdBuffer->depthFormat,
+                                                        grCmdBuffer->stencilFormat,
+                                                        bindPoint->strides);
+    }
+
+    if (vkPipeline == VK_NULL_HANDLE) {
+        // Assume that the depth-stencil attachment formats never change per pipeline
+        vkPipeline = grPipelineGetVkPipeline(grPipeline, grCmdBuffer->depthFormat,
+                                             grCmdBuffer->stencilFormat);
+
+        // Fall back to push constants
+        pushStrides(grDevice, grCmdBuffer, grPipeline->pipelineLayout,
+                    bindPoint->strides, bindPoint->strideMask);
+    }
+
+    if (vkPipeline != bindPoint->pipeline) {
+        VKD.vkCmdBindPipeline(grCmdBuffer->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              vkPipeline);
+        bindPoint->pipeline = vkPipeline;
+    }
+}
+
 static void grCmdBufferUpdateResources(
     GrCmdBuffer* grCmdBuffer,
     VkPipelineBindPoint vkBindPoint)
@@ -214,27 +1513,38 @@ static void grCmdBufferUpdateResources(
     GrPipeline* grPipeline = bindPoint->grPipeline;
     uint32_t dirtyFlags = bindPoint->dirtyFlags;
 
-    if (dirtyFlags & FLAG_DIRTY_DESCRIPTOR_SET) {
-        grCmdBufferUpdateDescriptorSet(grCmdBuffer, vkBindPoint);
-    }
+    // Shaders may access the counters
+    grCmdBufferSyncAtomicCounters(grCmdBuffer);
 
     if (dirtyFlags & (FLAG_DIRTY_DESCRIPTOR_SET | FLAG_DIRTY_DYNAMIC_OFFSET)) {
+        uint64_t startTicks = profilerGetCommandTicks();
+
+        if (dirtyFlags & FLAG_DIRTY_DESCRIPTOR_SET) {
+            grCmdBufferUpdateDescriptorSet(grCmdBuffer, vkBindPoint);
+        }
         grCmdBufferBindDescriptorSet(grCmdBuffer, vkBindPoint);
+
+        profilerAddCommandCounter(&grCmdBuffer->cmdStats, CMD_COUNTER_DESCRIPTOR_UPDATE,
+                                  startTicks);
     }
 
     if (dirtyFlags & FLAG_DIRTY_RENDER_PASS) {
-        grCmdBufferEndRenderPass(grCmdBuffer);
+        // Pending clears are folded when the next render pass begins
+        grCmdBufferEndRendering(grCmdBuffer);
     }
 
-    if (dirtyFlags & FLAG_DIRTY_PIPELINE) {
-        if (grPipeline->pipeline == VK_NULL_HANDLE) {
-            // Assume that the depth-stencil attachment formats never change per pipeline
-            grPipeline->pipeline = grPipelineGetVkPipeline(grPipeline,
-                                                           grCmdBuffer->depthFormat,
-                                                           grCmdBuffer->stencilFormat);
-        }
+    if (vkBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS) {
+        // Strides may select a different pipeline variant
+        if (dirtyFlags & (FLAG_DIRTY_PIPELINE | FLAG_DIRTY_DESCRIPTOR_SET)) {
+            uint64_t startTicks = profilerGetCommandTicks();
 
-        VKD.vkCmdBindPipeline(grCmdBuffer->commandBuffer, vkBindPoint, grPipeline->pipeline);
+            grCmdBufferBindGraphicsPipeline(grCmdBuffer);
+            profilerAddCommandCounter(&grCmdBuffer->cmdStats, CMD_COUNTER_PIPELINE_BIND,
+                                      startTicks);
+        }
+    } else if (dirtyFlags & FLAG_DIRTY_DESCRIPTOR_SET) {
+        pushStrides(grDevice, grCmdBuffer, grPipeline->pipelineLayout,
+                    bindPoint->strides, bindPoint->strideMask);
     }
 
     bindPoint->dirtyFlags = 0;
@@ -254,6 +1564,13 @@ GR_VOID GR_STDCALL grCmdBindPipeline(
     VkPipelineBindPoint vkBindPoint = getVkPipelineBindPoint(pipelineBindPoint);
     BindPoint* bindPoint = &grCmdBuffer->bindPoints[vkBindPoint];
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_BIND_PIPELINE, 0);
+        packet->args[0].u = pipelineBindPoint;
+        packet->args[1].p = pipeline;
+        return;
+    }
+
     if (grPipeline == bindPoint->grPipeline) {
         return;
     }
@@ -279,7 +1596,17 @@ GR_VOID GR_STDCALL grCmdBindStateObject(
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
-    // TODO compare objects instead of just pointers
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_BIND_STATE_OBJECT, 0);
+        packet->args[0].u = stateBindPoint;
+        packet->args[1].p = state;
+        return;
+    }
+
+    DynamicState* dynamicState = &grCmdBuffer->dynamicState;
+
+    // State objects are interned, comparing pointers is enough to skip rebinds. Objects that
+    // differ still share most values, only record what actually changed.
 
     switch ((GR_STATE_BIND_POINT)stateBindPoint) {
     case GR_STATE_BIND_VIEWPORT: {
@@ -288,10 +1615,29 @@ GR_VOID GR_STDCALL grCmdBindStateObject(
             break;
         }
 
-        VKD.vkCmdSetViewportWithCountEXT(grCmdBuffer->commandBuffer,
-                                         viewportState->viewportCount, viewportState->viewports);
-        VKD.vkCmdSetScissorWithCountEXT(grCmdBuffer->commandBuffer, viewportState->scissorCount,
-                                        viewportState->scissors);
+        // A count change invalidates the whole array
+        if (viewportState->viewportCount != dynamicState->viewportCount) {
+            grCmdBuffer->dynamicStateMask &= ~DYNAMIC_STATE_VIEWPORT;
+            dynamicState->viewportCount = viewportState->viewportCount;
+        }
+        if (viewportState->scissorCount != dynamicState->scissorCount) {
+            grCmdBuffer->dynamicStateMask &= ~DYNAMIC_STATE_SCISSOR;
+            dynamicState->scissorCount = viewportState->scissorCount;
+        }
+
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_VIEWPORT, dynamicState->viewports,
+                               viewportState->viewports,
+                               viewportState->viewportCount * sizeof(VkViewport))) {
+            VKD.vkCmdSetViewportWithCountEXT(grCmdBuffer->commandBuffer,
+                                             viewportState->viewportCount,
+                                             viewportState->viewports);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_SCISSOR, dynamicState->scissors,
+                               viewportState->scissors,
+                               viewportState->scissorCount * sizeof(VkRect2D))) {
+            VKD.vkCmdSetScissorWithCountEXT(grCmdBuffer->commandBuffer,
+                                            viewportState->scissorCount, viewportState->scissors);
+        }
 
         grCmdBuffer->grViewportState = viewportState;
     }   break;
@@ -301,11 +1647,32 @@ GR_VOID GR_STDCALL grCmdBindStateObject(
             break;
         }
 
-        VKD.vkCmdSetPolygonModeEXT(grCmdBuffer->commandBuffer, rasterState->polygonMode);
-        VKD.vkCmdSetCullModeEXT(grCmdBuffer->commandBuffer, rasterState->cullMode);
-        VKD.vkCmdSetFrontFaceEXT(grCmdBuffer->commandBuffer, rasterState->frontFace);
-        VKD.vkCmdSetDepthBias(grCmdBuffer->commandBuffer, rasterState->depthBiasConstantFactor,
-                              rasterState->depthBiasClamp, rasterState->depthBiasSlopeFactor);
+        const float depthBias[] = {
+            rasterState->depthBiasConstantFactor,
+            rasterState->depthBiasClamp,
+            rasterState->depthBiasSlopeFactor,
+        };
+
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_POLYGON_MODE,
+                               &dynamicState->polygonMode, &rasterState->polygonMode,
+                               sizeof(VkPolygonMode))) {
+            VKD.vkCmdSetPolygonModeEXT(grCmdBuffer->commandBuffer, rasterState->polygonMode);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_CULL_MODE,
+                               &dynamicState->cullMode, &rasterState->cullMode,
+                               sizeof(VkCullModeFlags))) {
+            VKD.vkCmdSetCullModeEXT(grCmdBuffer->commandBuffer, rasterState->cullMode);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_FRONT_FACE,
+                               &dynamicState->frontFace, &rasterState->frontFace,
+                               sizeof(VkFrontFace))) {
+            VKD.vkCmdSetFrontFaceEXT(grCmdBuffer->commandBuffer, rasterState->frontFace);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_DEPTH_BIAS,
+                               dynamicState->depthBias, depthBias, sizeof(depthBias))) {
+            VKD.vkCmdSetDepthBias(grCmdBuffer->commandBuffer, depthBias[0], depthBias[1],
+                                  depthBias[2]);
+        }
 
         grCmdBuffer->grRasterState = rasterState;
     }   break;
@@ -315,40 +1682,81 @@ GR_VOID GR_STDCALL grCmdBindStateObject(
             break;
         }
 
-        VKD.vkCmdSetDepthTestEnableEXT(grCmdBuffer->commandBuffer,
-                                       depthStencilState->depthTestEnable);
-        VKD.vkCmdSetDepthWriteEnableEXT(grCmdBuffer->commandBuffer,
-                                        depthStencilState->depthWriteEnable);
-        VKD.vkCmdSetDepthCompareOpEXT(grCmdBuffer->commandBuffer,
-                                      depthStencilState->depthCompareOp);
-        VKD.vkCmdSetDepthBoundsTestEnableEXT(grCmdBuffer->commandBuffer,
-                                             depthStencilState->depthBoundsTestEnable);
-        VKD.vkCmdSetStencilTestEnableEXT(grCmdBuffer->commandBuffer,
-                                         depthStencilState->stencilTestEnable);
-        VKD.vkCmdSetStencilOpEXT(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
-                                 depthStencilState->front.failOp,
-                                 depthStencilState->front.passOp,
-                                 depthStencilState->front.depthFailOp,
-                                 depthStencilState->front.compareOp);
-        VKD.vkCmdSetStencilCompareMask(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
-                                       depthStencilState->front.compareMask);
-        VKD.vkCmdSetStencilWriteMask(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
-                                     depthStencilState->front.writeMask);
-        VKD.vkCmdSetStencilReference(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
-                                     depthStencilState->front.reference);
-        VKD.vkCmdSetStencilOpEXT(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_BACK_BIT,
-                                 depthStencilState->back.failOp,
-                                 depthStencilState->back.passOp,
-                                 depthStencilState->back.depthFailOp,
-                                 depthStencilState->back.compareOp);
-        VKD.vkCmdSetStencilCompareMask(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_BACK_BIT,
-                                       depthStencilState->back.compareMask);
-        VKD.vkCmdSetStencilWriteMask(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_BACK_BIT,
-                                     depthStencilState->back.writeMask);
-        VKD.vkCmdSetStencilReference(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_BACK_BIT,
-                                     depthStencilState->back.reference);
-        VKD.vkCmdSetDepthBounds(grCmdBuffer->commandBuffer, depthStencilState->minDepthBounds,
-                                                            depthStencilState->maxDepthBounds);
+        const float depthBounds[] = {
+            depthStencilState->minDepthBounds,
+            depthStencilState->maxDepthBounds,
+        };
+
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+                               &dynamicState->depthTestEnable,
+                               &depthStencilState->depthTestEnable, sizeof(VkBool32))) {
+            VKD.vkCmdSetDepthTestEnableEXT(grCmdBuffer->commandBuffer,
+                                           depthStencilState->depthTestEnable);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+                               &dynamicState->depthWriteEnable,
+                               &depthStencilState->depthWriteEnable, sizeof(VkBool32))) {
+            VKD.vkCmdSetDepthWriteEnableEXT(grCmdBuffer->commandBuffer,
+                                            depthStencilState->depthWriteEnable);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_DEPTH_COMPARE_OP,
+                               &dynamicState->depthCompareOp,
+                               &depthStencilState->depthCompareOp, sizeof(VkCompareOp))) {
+            VKD.vkCmdSetDepthCompareOpEXT(grCmdBuffer->commandBuffer,
+                                          depthStencilState->depthCompareOp);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE,
+                               &dynamicState->depthBoundsTestEnable,
+                               &depthStencilState->depthBoundsTestEnable, sizeof(VkBool32))) {
+            VKD.vkCmdSetDepthBoundsTestEnableEXT(grCmdBuffer->commandBuffer,
+                                                 depthStencilState->depthBoundsTestEnable);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_STENCIL_TEST_ENABLE,
+                               &dynamicState->stencilTestEnable,
+                               &depthStencilState->stencilTestEnable, sizeof(VkBool32))) {
+            VKD.vkCmdSetStencilTestEnableEXT(grCmdBuffer->commandBuffer,
+                                             depthStencilState->stencilTestEnable);
+        }
+
+        for (unsigned i = 0; i < 2; i++) {
+            const VkStencilOpState* stencilState = i == 0 ? &depthStencilState->front
+                                                          : &depthStencilState->back;
+            VkStencilOpState* shadowState = &dynamicState->stencilStates[i];
+            VkStencilFaceFlags faceMask = i == 0 ? VK_STENCIL_FACE_FRONT_BIT
+                                                 : VK_STENCIL_FACE_BACK_BIT;
+
+            // failOp, passOp, depthFailOp and compareOp are laid out contiguously
+            if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_STENCIL_OP << i,
+                                   &shadowState->failOp, &stencilState->failOp,
+                                   OFFSET_OF(VkStencilOpState, compareMask))) {
+                VKD.vkCmdSetStencilOpEXT(grCmdBuffer->commandBuffer, faceMask,
+                                         stencilState->failOp, stencilState->passOp,
+                                         stencilState->depthFailOp, stencilState->compareOp);
+            }
+            if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_STENCIL_COMPARE_MASK << i,
+                                   &shadowState->compareMask, &stencilState->compareMask,
+                                   sizeof(uint32_t))) {
+                VKD.vkCmdSetStencilCompareMask(grCmdBuffer->commandBuffer, faceMask,
+                                               stencilState->compareMask);
+            }
+            if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_STENCIL_WRITE_MASK << i,
+                                   &shadowState->writeMask, &stencilState->writeMask,
+                                   sizeof(uint32_t))) {
+                VKD.vkCmdSetStencilWriteMask(grCmdBuffer->commandBuffer, faceMask,
+                                             stencilState->writeMask);
+            }
+            if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_STENCIL_REFERENCE << i,
+                                   &shadowState->reference, &stencilState->reference,
+                                   sizeof(uint32_t))) {
+                VKD.vkCmdSetStencilReference(grCmdBuffer->commandBuffer, faceMask,
+                                             stencilState->reference);
+            }
+        }
+
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_DEPTH_BOUNDS,
+                               dynamicState->depthBounds, depthBounds, sizeof(depthBounds))) {
+            VKD.vkCmdSetDepthBounds(grCmdBuffer->commandBuffer, depthBounds[0], depthBounds[1]);
+        }
 
         grCmdBuffer->grDepthStencilState = depthStencilState;
     }   break;
@@ -358,11 +1766,26 @@ GR_VOID GR_STDCALL grCmdBindStateObject(
             break;
         }
 
-        VKD.vkCmdSetColorBlendEnableEXT(grCmdBuffer->commandBuffer, 0, GR_MAX_COLOR_TARGETS,
-                                        colorBlendState->colorBlendEnables);
-        VKD.vkCmdSetColorBlendEquationEXT(grCmdBuffer->commandBuffer, 0, GR_MAX_COLOR_TARGETS,
-                                          colorBlendState->colorBlendEquations);
-        VKD.vkCmdSetBlendConstants(grCmdBuffer->commandBuffer, colorBlendState->blendConstants);
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_COLOR_BLEND_ENABLE,
+                               dynamicState->colorBlendEnables,
+                               colorBlendState->colorBlendEnables,
+                               sizeof(colorBlendState->colorBlendEnables))) {
+            VKD.vkCmdSetColorBlendEnableEXT(grCmdBuffer->commandBuffer, 0, GR_MAX_COLOR_TARGETS,
+                                            colorBlendState->colorBlendEnables);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_COLOR_BLEND_EQUATION,
+                               dynamicState->colorBlendEquations,
+                               colorBlendState->colorBlendEquations,
+                               sizeof(colorBlendState->colorBlendEquations))) {
+            VKD.vkCmdSetColorBlendEquationEXT(grCmdBuffer->commandBuffer, 0, GR_MAX_COLOR_TARGETS,
+                                              colorBlendState->colorBlendEquations);
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_BLEND_CONSTANTS,
+                               dynamicState->blendConstants, colorBlendState->blendConstants,
+                               sizeof(colorBlendState->blendConstants))) {
+            VKD.vkCmdSetBlendConstants(grCmdBuffer->commandBuffer,
+                                       colorBlendState->blendConstants);
+        }
 
         grCmdBuffer->grColorBlendState = colorBlendState;
     }   break;
@@ -372,10 +1795,21 @@ GR_VOID GR_STDCALL grCmdBindStateObject(
             break;
         }
 
-        VKD.vkCmdSetRasterizationSamplesEXT(grCmdBuffer->commandBuffer,
-                                            msaaState->sampleCountFlags);
-        VKD.vkCmdSetSampleMaskEXT(grCmdBuffer->commandBuffer,
-                                  msaaState->sampleCountFlags, &msaaState->sampleMask);
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_RASTERIZATION_SAMPLES,
+                               &dynamicState->rasterizationSamples,
+                               &msaaState->sampleCountFlags, sizeof(VkSampleCountFlags))) {
+            VKD.vkCmdSetRasterizationSamplesEXT(grCmdBuffer->commandBuffer,
+                                                msaaState->sampleCountFlags);
+
+            // The sample mask size depends on the sample count
+            grCmdBuffer->dynamicStateMask &= ~DYNAMIC_STATE_SAMPLE_MASK;
+        }
+        if (updateDynamicState(grCmdBuffer, DYNAMIC_STATE_SAMPLE_MASK,
+                               &dynamicState->sampleMask, &msaaState->sampleMask,
+                               sizeof(VkSampleMask))) {
+            VKD.vkCmdSetSampleMaskEXT(grCmdBuffer->commandBuffer,
+                                      msaaState->sampleCountFlags, &msaaState->sampleMask);
+        }
 
         grCmdBuffer->grMsaaState = msaaState;
     }   break;
@@ -395,11 +1829,24 @@ GR_VOID GR_STDCALL grCmdBindDescriptorSet(
     VkPipelineBindPoint vkBindPoint = getVkPipelineBindPoint(pipelineBindPoint);
     BindPoint* bindPoint = &grCmdBuffer->bindPoints[vkBindPoint];
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_BIND_DESCRIPTOR_SET, 0);
+        packet->args[0].u = pipelineBindPoint;
+        packet->args[1].u = index;
+        packet->args[2].p = descriptorSet;
+        packet->args[3].u = slotOffset;
+        return;
+    }
+
     if (grDescriptorSet != bindPoint->grDescriptorSets[index] ||
         slotOffset != bindPoint->slotOffsets[index]) {
         bindPoint->grDescriptorSets[index] = grDescriptorSet;
         bindPoint->slotOffsets[index] = slotOffset;
         bindPoint->dirtyFlags |= FLAG_DIRTY_DESCRIPTOR_SET;
+    } else if (!(bindPoint->dirtyFlags & FLAG_DIRTY_DESCRIPTOR_SET) &&
+               hasStaleDescriptorSets(grCmdBuffer, vkBindPoint)) {
+        // Same set rebound after being modified since it was last flattened
+        bindPoint->dirtyFlags |= FLAG_DIRTY_DESCRIPTOR_SET;
     }
 }
 
@@ -414,6 +1861,14 @@ GR_VOID GR_STDCALL grCmdBindDynamicMemoryView(
     VkPipelineBindPoint vkBindPoint = getVkPipelineBindPoint(pipelineBindPoint);
     BindPoint* bindPoint = &grCmdBuffer->bindPoints[vkBindPoint];
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_BIND_DYNAMIC_MEMORY_VIEW,
+                                                    sizeof(GR_MEMORY_VIEW_ATTACH_INFO));
+        packet->args[0].u = pipelineBindPoint;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pMemView, sizeof(GR_MEMORY_VIEW_ATTACH_INFO));
+        return;
+    }
+
     // FIXME what is pMemView->state for?
 
     if (pMemView->offset != bindPoint->dynamicOffset) {
@@ -449,10 +1904,18 @@ GR_VOID GR_STDCALL grCmdBindIndexData(
     GR_ENUM indexType)
 {
     LOGT("%p %p %u 0x%X\n", cmdBuffer, mem, offset, indexType);
-    const GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
+    GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrGpuMemory* grGpuMemory = (GrGpuMemory*)mem;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_BIND_INDEX_DATA, 0);
+        packet->args[0].p = mem;
+        packet->args[1].u = offset;
+        packet->args[2].u = indexType;
+        return;
+    }
+
     VKD.vkCmdBindIndexBuffer(grCmdBuffer->commandBuffer, grGpuMemory->buffer, offset,
                              getVkIndexType(indexType));
 }
@@ -464,22 +1927,34 @@ GR_VOID GR_STDCALL grCmdPrepareMemoryRegions(
 {
     LOGT("%p %u %p\n", cmdBuffer, transitionCount, pStateTransitions);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
-
-    grCmdBufferEndRenderPass(grCmdBuffer);
 
-    STACK_ARRAY(VkBufferMemoryBarrier, barriers, 128, transitionCount);
-    VkPipelineStageFlags srcStageMask = 0;
-    VkPipelineStageFlags dstStageMask = 0;
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet =
+            grCmdBufferRecordPacket(grCmdBuffer, CMD_PREPARE_MEMORY_REGIONS,
+                                    transitionCount * sizeof(GR_MEMORY_STATE_TRANSITION));
+        packet->args[0].u = transitionCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pStateTransitions, packet->payloadSize);
+        return;
+    }
 
+    // Recorded lazily, the next command that may depend on them flushes the batch
     for (unsigned i = 0; i < transitionCount; i++) {
         const GR_MEMORY_STATE_TRANSITION* stateTransition = &pStateTransitions[i];
         GrGpuMemory* grGpuMemory = (GrGpuMemory*)stateTransition->mem;
 
-        barriers[i] = (VkBufferMemoryBarrier) {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        if (stateTransition->oldState == GR_MEMORY_STATE_WRITE_TIMESTAMP &&
+            grCmdBuffer->timestampCount > 0) {
+            // Queued timestamp copies must land before the memory gets read
+            grCmdBufferEndRenderPass(grCmdBuffer);
+            grCmdBufferFlushTimestamps(grCmdBuffer);
+        }
+
+        const VkBufferMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
             .pNext = NULL,
+            .srcStageMask = getVkPipelineStageFlagsMemory(stateTransition->oldState),
             .srcAccessMask = getVkAccessFlagsMemory(stateTransition->oldState),
+            .dstStageMask = getVkPipelineStageFlagsMemory(stateTransition->newState),
             .dstAccessMask = getVkAccessFlagsMemory(stateTransition->newState),
             .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
@@ -488,14 +1963,8 @@ GR_VOID GR_STDCALL grCmdPrepareMemoryRegions(
             .size = stateTransition->regionSize > 0 ? stateTransition->regionSize : VK_WHOLE_SIZE,
         };
 
-        srcStageMask |= getVkPipelineStageFlagsMemory(stateTransition->oldState);
-        dstStageMask |= getVkPipelineStageFlagsMemory(stateTransition->newState);
+        grCmdBufferAddBufferBarrier(grCmdBuffer, &barrier);
     }
-
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer, srcStageMask, dstStageMask,
-                             0, 0, NULL, transitionCount, barriers, 0, NULL);
-
-    STACK_ARRAY_FINISH(barriers);
 }
 
 GR_VOID GR_STDCALL grCmdBindTargets(
@@ -508,7 +1977,22 @@ GR_VOID GR_STDCALL grCmdBindTargets(
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     BindPoint* bindPoint = &grCmdBuffer->bindPoints[VK_PIPELINE_BIND_POINT_GRAPHICS];
 
+    if (grCmdBuffer->isDeferred) {
+        unsigned colorTargetsSize = colorTargetCount * sizeof(GR_COLOR_TARGET_BIND_INFO);
+        unsigned depthTargetSize = pDepthTarget != NULL ? sizeof(GR_DEPTH_STENCIL_BIND_INFO) : 0;
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_BIND_TARGETS,
+                                                    colorTargetsSize + depthTargetSize);
+        packet->args[0].u = colorTargetCount;
+        packet->args[1].u = pDepthTarget != NULL;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pColorTargets, colorTargetsSize);
+        memcpy((uint8_t*)CMD_PACKET_PAYLOAD(packet) + colorTargetsSize, pDepthTarget,
+               depthTargetSize);
+        return;
+    }
+
     VkRenderingAttachmentInfo colorAttachments[GR_MAX_COLOR_TARGETS];
+    const GrColorTargetView* grColorTargetViews[GR_MAX_COLOR_TARGETS] = { NULL };
+    const GrDepthStencilView* grDepthStencilView = NULL;
     bool hasDepth = false;
     bool hasStencil = false;
     VkRenderingAttachmentInfo depthAttachment;
@@ -538,6 +2022,7 @@ GR_VOID GR_STDCALL grCmdBindTargets(
             pColorTargets[i].colorTargetState != GR_IMAGE_STATE_UNINITIALIZED) {
             colorAttachments[i].imageView = grColorTargetView->imageView;
             colorAttachments[i].imageLayout = getVkImageLayout(pColorTargets[i].colorTargetState);
+            grColorTargetViews[i] = grColorTargetView;
 
             minExtent.width = MIN(minExtent.width, grColorTargetView->extent.width);
             minExtent.height = MIN(minExtent.height, grColorTargetView->extent.height);
@@ -546,7 +2031,7 @@ GR_VOID GR_STDCALL grCmdBindTargets(
     }
 
     if (pDepthTarget != NULL && pDepthTarget->view != NULL) {
-        const GrDepthStencilView* grDepthStencilView = (GrDepthStencilView*)pDepthTarget->view;
+        grDepthStencilView = (GrDepthStencilView*)pDepthTarget->view;
 
         if (pDepthTarget->depthState != GR_IMAGE_STATE_UNINITIALIZED &&
             (grDepthStencilView->aspectMask & VK_IMAGE_ASPECT_DEPTH_BIT) != 0) {
@@ -604,6 +2089,8 @@ GR_VOID GR_STDCALL grCmdBindTargets(
         grCmdBuffer->depthAttachment = depthAttachment;
         grCmdBuffer->stencilAttachment = stencilAttachment;
         grCmdBuffer->minExtent = minExtent;
+        memcpy(grCmdBuffer->grColorTargetViews, grColorTargetViews, sizeof(grColorTargetViews));
+        grCmdBuffer->grDepthStencilView = grDepthStencilView;
 
         bindPoint->dirtyFlags |= FLAG_DIRTY_RENDER_PASS;
     }
@@ -622,22 +2109,28 @@ GR_VOID GR_STDCALL grCmdPrepareImages(
 {
     LOGT("%p %u %p\n", cmdBuffer, transitionCount, pStateTransitions);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
-    grCmdBufferEndRenderPass(grCmdBuffer);
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet =
+            grCmdBufferRecordPacket(grCmdBuffer, CMD_PREPARE_IMAGES,
+                                    transitionCount * sizeof(GR_IMAGE_STATE_TRANSITION));
+        packet->args[0].u = transitionCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pStateTransitions, packet->payloadSize);
+        return;
+    }
 
-    STACK_ARRAY(VkImageMemoryBarrier, barriers, 128, transitionCount);
-    VkPipelineStageFlags srcStageMask = 0;
-    VkPipelineStageFlags dstStageMask = 0;
+    STACK_ARRAY(VkImageMemoryBarrier2, barriers, 128, transitionCount);
 
     for (unsigned i = 0; i < transitionCount; i++) {
         const GR_IMAGE_STATE_TRANSITION* stateTransition = &pStateTransitions[i];
         GrImage* grImage = (GrImage*)stateTransition->image;
 
-        barriers[i] = (VkImageMemoryBarrier) {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        barriers[i] = (VkImageMemoryBarrier2) {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
             .pNext = NULL,
+            .srcStageMask = getVkPipelineStageFlagsImage(stateTransition->oldState),
             .srcAccessMask = getVkAccessFlagsImage(stateTransition->oldState),
+            .dstStageMask = getVkPipelineStageFlagsImage(stateTransition->newState),
             .dstAccessMask = getVkAccessFlagsImage(stateTransition->newState),
             .oldLayout = getVkImageLayout(stateTransition->oldState),
             .newLayout = getVkImageLayout(stateTransition->newState),
@@ -647,13 +2140,14 @@ GR_VOID GR_STDCALL grCmdPrepareImages(
             .subresourceRange = getVkImageSubresourceRange(stateTransition->subresourceRange,
                                                            grImage->multiplyCubeLayers),
         };
-
-        srcStageMask |= getVkPipelineStageFlagsImage(stateTransition->oldState);
-        dstStageMask |= getVkPipelineStageFlagsImage(stateTransition->newState);
     }
 
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer, srcStageMask, dstStageMask,
-                             0, 0, NULL, 0, NULL, transitionCount, barriers);
+    grCmdBufferTransitionClears(grCmdBuffer, transitionCount, barriers);
+
+    // Recorded lazily, the next command that may depend on them flushes the batch
+    for (unsigned i = 0; i < transitionCount; i++) {
+        grCmdBufferAddImageBarrier(grCmdBuffer, &barriers[i]);
+    }
 
     STACK_ARRAY_FINISH(barriers);
 }
@@ -669,6 +2163,15 @@ GR_VOID GR_STDCALL grCmdDraw(
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_DRAW, 0);
+        packet->args[0].u = firstVertex;
+        packet->args[1].u = vertexCount;
+        packet->args[2].u = firstInstance;
+        packet->args[3].u = instanceCount;
+        return;
+    }
+
 #ifndef TESS
     if (grCmdBuffer->bindPoints[0].grPipeline->hasTessellation) {
         // Skip draw
@@ -696,6 +2199,16 @@ GR_VOID GR_STDCALL grCmdDrawIndexed(
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_DRAW_INDEXED, 0);
+        packet->args[0].u = firstIndex;
+        packet->args[1].u = indexCount;
+        packet->args[2].i = vertexOffset;
+        packet->args[3].u = firstInstance;
+        packet->args[4].u = instanceCount;
+        return;
+    }
+
 #ifndef TESS
     if (grCmdBuffer->bindPoints[0].grPipeline->hasTessellation) {
         // Skip draw
@@ -720,6 +2233,13 @@ GR_VOID GR_STDCALL grCmdDrawIndirect(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrGpuMemory* grGpuMemory = (GrGpuMemory*)mem;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_DRAW_INDIRECT, 0);
+        packet->args[0].p = mem;
+        packet->args[1].u = offset;
+        return;
+    }
+
 #ifndef TESS
     if (grCmdBuffer->bindPoints[0].grPipeline->hasTessellation) {
         // Skip draw
@@ -743,6 +2263,13 @@ GR_VOID GR_STDCALL grCmdDrawIndexedIndirect(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrGpuMemory* grGpuMemory = (GrGpuMemory*)mem;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_DRAW_INDEXED_INDIRECT, 0);
+        packet->args[0].p = mem;
+        packet->args[1].u = offset;
+        return;
+    }
+
 #ifndef TESS
     if (grCmdBuffer->bindPoints[0].grPipeline->hasTessellation) {
         // Skip draw
@@ -766,6 +2293,14 @@ GR_VOID GR_STDCALL grCmdDispatch(
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_DISPATCH, 0);
+        packet->args[0].u = x;
+        packet->args[1].u = y;
+        packet->args[2].u = z;
+        return;
+    }
+
     grCmdBufferUpdateResources(grCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
     grCmdBufferEndRenderPass(grCmdBuffer);
 
@@ -782,6 +2317,13 @@ GR_VOID GR_STDCALL grCmdDispatchIndirect(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrGpuMemory* grGpuMemory = (GrGpuMemory*)mem;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_DISPATCH_INDIRECT, 0);
+        packet->args[0].p = mem;
+        packet->args[1].u = offset;
+        return;
+    }
+
     grCmdBufferUpdateResources(grCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
     grCmdBufferEndRenderPass(grCmdBuffer);
 
@@ -797,28 +2339,48 @@ GR_VOID GR_STDCALL grCmdCopyMemory(
 {
     LOGT("%p %p %p %u %p\n", cmdBuffer, srcMem, destMem, regionCount, pRegions);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrGpuMemory* grSrcGpuMemory = (GrGpuMemory*)srcMem;
     GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
 
-    grCmdBufferEndRenderPass(grCmdBuffer);
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_COPY_MEMORY,
+                                                    regionCount * sizeof(GR_MEMORY_COPY));
+        packet->args[0].p = srcMem;
+        packet->args[1].p = destMem;
+        packet->args[2].u = regionCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pRegions, packet->payloadSize);
+        return;
+    }
 
-    STACK_ARRAY(VkBufferCopy, vkRegions, 128, regionCount);
+    VkBufferCopy* vkRegions =
+        grCmdBufferBeginCopy(grCmdBuffer, COPY_TYPE_BUFFER,
+                             grSrcGpuMemory->buffer, VK_NULL_HANDLE,
+                             grDstGpuMemory->buffer, VK_NULL_HANDLE,
+                             sizeof(VkBufferCopy), regionCount);
+    unsigned vkRegionCount = grCmdBuffer->copyRegionCount;
 
     for (unsigned i = 0; i < regionCount; i++) {
         const GR_MEMORY_COPY* region = &pRegions[i];
+        VkBufferCopy* lastRegion = vkRegionCount > 0 ? &vkRegions[vkRegionCount - 1] : NULL;
+
+        if (lastRegion != NULL &&
+            lastRegion->srcOffset + lastRegion->size == region->srcOffset &&
+            lastRegion->dstOffset + lastRegion->size == region->destOffset) {
+            // Contiguous on both sides
+            lastRegion->size += region->copySize;
+            grCmdBuffer->mergedCopyRegionCount++;
+            continue;
+        }
 
-        vkRegions[i] = (VkBufferCopy) {
+        vkRegions[vkRegionCount] = (VkBufferCopy) {
             .srcOffset = region->srcOffset,
             .dstOffset = region->destOffset,
             .size = region->copySize,
         };
+        vkRegionCount++;
     }
 
-    VKD.vkCmdCopyBuffer(grCmdBuffer->commandBuffer, grSrcGpuMemory->buffer, grDstGpuMemory->buffer,
-                        regionCount, vkRegions);
-
-    STACK_ARRAY_FINISH(vkRegions);
+    grCmdBuffer->copyRegionCount = vkRegionCount;
 }
 
 GR_VOID GR_STDCALL grCmdCopyImage(
@@ -830,22 +2392,34 @@ GR_VOID GR_STDCALL grCmdCopyImage(
 {
     LOGT("%p %p %p %u %p\n", cmdBuffer, srcImage, destImage, regionCount, pRegions);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrImage* grSrcImage = (GrImage*)srcImage;
     GrImage* grDstImage = (GrImage*)destImage;
     unsigned srcTileSize = getVkFormatTileSize(grSrcImage->format);
     unsigned dstTileSize = getVkFormatTileSize(grDstImage->format);
     unsigned extentTileSize = srcTileSize > dstTileSize ? dstTileSize : srcTileSize;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_COPY_IMAGE,
+                                                    regionCount * sizeof(GR_IMAGE_COPY));
+        packet->args[0].p = srcImage;
+        packet->args[1].p = destImage;
+        packet->args[2].u = regionCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pRegions, packet->payloadSize);
+        return;
+    }
+
     if (quirkHas(QUIRK_COMPRESSED_IMAGE_COPY_IN_TEXELS)) {
         srcTileSize = 1;
         dstTileSize = 1;
         extentTileSize = 1;
     }
 
-    grCmdBufferEndRenderPass(grCmdBuffer);
-
-    STACK_ARRAY(VkImageCopy, vkRegions, 128, regionCount);
+    VkImageCopy* vkRegions =
+        grCmdBufferBeginCopy(grCmdBuffer, COPY_TYPE_IMAGE,
+                             VK_NULL_HANDLE, grSrcImage->image,
+                             VK_NULL_HANDLE, grDstImage->image,
+                             sizeof(VkImageCopy), regionCount);
+    vkRegions += grCmdBuffer->copyRegionCount;
 
     for (unsigned i = 0; i < regionCount; i++) {
         const GR_IMAGE_COPY* region = &pRegions[i];
@@ -871,117 +2445,451 @@ GR_VOID GR_STDCALL grCmdCopyImage(
         };
     }
 
-    VKD.vkCmdCopyImage(grCmdBuffer->commandBuffer,
-                       grSrcImage->image, getVkImageLayout(GR_IMAGE_STATE_DATA_TRANSFER),
-                       grDstImage->image, getVkImageLayout(GR_IMAGE_STATE_DATA_TRANSFER),
-                       regionCount, vkRegions);
+    grCmdBuffer->copyRegionCount += regionCount;
+}
+
+GR_VOID GR_STDCALL grCmdCopyMemoryToImage(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_GPU_MEMORY srcMem,
+    GR_IMAGE destImage,
+    GR_UINT regionCount,
+    const GR_MEMORY_IMAGE_COPY* pRegions)
+{
+    LOGT("%p %p %p %u %p\n", cmdBuffer, srcMem, destImage, regionCount, pRegions);
+    GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
+    GrGpuMemory* grSrcGpuMemory = (GrGpuMemory*)srcMem;
+    GrImage* grDstImage = (GrImage*)destImage;
+    unsigned dstTileSize = getVkFormatTileSize(grDstImage->format);
+
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_COPY_MEMORY_TO_IMAGE,
+                                                    regionCount * sizeof(GR_MEMORY_IMAGE_COPY));
+        packet->args[0].p = srcMem;
+        packet->args[1].p = destImage;
+        packet->args[2].u = regionCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pRegions, packet->payloadSize);
+        return;
+    }
+
+    if (quirkHas(QUIRK_COMPRESSED_IMAGE_COPY_IN_TEXELS)) {
+        dstTileSize = 1;
+    }
+
+    VkBufferImageCopy* vkRegions =
+        grCmdBufferBeginCopy(grCmdBuffer, COPY_TYPE_BUFFER_TO_IMAGE,
+                             grSrcGpuMemory->buffer, VK_NULL_HANDLE,
+                             VK_NULL_HANDLE, grDstImage->image,
+                             sizeof(VkBufferImageCopy), regionCount);
+    vkRegions += grCmdBuffer->copyRegionCount;
+
+    for (unsigned i = 0; i < regionCount; i++) {
+        const GR_MEMORY_IMAGE_COPY* region = &pRegions[i];
+
+        vkRegions[i] = (VkBufferImageCopy) {
+            .bufferOffset = region->memOffset,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = getVkImageSubresourceLayers(region->imageSubresource),
+            .imageOffset = {
+                region->imageOffset.x * dstTileSize,
+                region->imageOffset.y * dstTileSize,
+                region->imageOffset.z
+            },
+            .imageExtent = {
+                MIN(region->imageExtent.width * dstTileSize,
+                    MIP(grDstImage->extent.width, region->imageSubresource.mipLevel)),
+                MIN(region->imageExtent.height * dstTileSize,
+                    MIP(grDstImage->extent.height, region->imageSubresource.mipLevel)),
+                region->imageExtent.depth,
+            },
+        };
+    }
+
+    grCmdBuffer->copyRegionCount += regionCount;
+}
+
+GR_VOID GR_STDCALL grCmdCopyImageToMemory(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE srcImage,
+    GR_GPU_MEMORY destMem,
+    GR_UINT regionCount,
+    const GR_MEMORY_IMAGE_COPY* pRegions)
+{
+    LOGT("%p %p %p %u %p\n", cmdBuffer, srcImage, destMem, regionCount, pRegions);
+    GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
+    GrImage* grSrcImage = (GrImage*)srcImage;
+    GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
+    unsigned srcTileSize = getVkFormatTileSize(grSrcImage->format);
+
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_COPY_IMAGE_TO_MEMORY,
+                                                    regionCount * sizeof(GR_MEMORY_IMAGE_COPY));
+        packet->args[0].p = srcImage;
+        packet->args[1].p = destMem;
+        packet->args[2].u = regionCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pRegions, packet->payloadSize);
+        return;
+    }
+
+    if (quirkHas(QUIRK_COMPRESSED_IMAGE_COPY_IN_TEXELS)) {
+        srcTileSize = 1;
+    }
+
+    VkBufferImageCopy* vkRegions =
+        grCmdBufferBeginCopy(grCmdBuffer, COPY_TYPE_IMAGE_TO_BUFFER,
+                             VK_NULL_HANDLE, grSrcImage->image,
+                             grDstGpuMemory->buffer, VK_NULL_HANDLE,
+                             sizeof(VkBufferImageCopy), regionCount);
+    vkRegions += grCmdBuffer->copyRegionCount;
+
+    for (unsigned i = 0; i < regionCount; i++) {
+        const GR_MEMORY_IMAGE_COPY* region = &pRegions[i];
+
+        vkRegions[i] = (VkBufferImageCopy) {
+            .bufferOffset = region->memOffset,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = getVkImageSubresourceLayers(region->imageSubresource),
+            .imageOffset = {
+                region->imageOffset.x * srcTileSize,
+                region->imageOffset.y * srcTileSize,
+                region->imageOffset.z
+            },
+            .imageExtent = {
+                MIN(region->imageExtent.width * srcTileSize,
+                    MIP(grSrcImage->extent.width, region->imageSubresource.mipLevel)),
+                MIN(region->imageExtent.height * srcTileSize,
+                    MIP(grSrcImage->extent.height, region->imageSubresource.mipLevel)),
+                region->imageExtent.depth,
+            },
+        };
+    }
+
+    grCmdBuffer->copyRegionCount += regionCount;
+}
+
+GR_VOID GR_STDCALL grCmdResolveImage(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE srcImage,
+    GR_IMAGE destImage,
+    GR_UINT regionCount,
+    const GR_IMAGE_RESOLVE* pRegions)
+{
+    LOGT("%p %p %p %u %p\n", cmdBuffer, srcImage, destImage, regionCount, pRegions);
+    GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    GrImage* grSrcImage = (GrImage*)srcImage;
+    GrImage* grDstImage = (GrImage*)destImage;
+    unsigned vkRegionCount = 0;
+
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_RESOLVE_IMAGE,
+                                                    regionCount * sizeof(GR_IMAGE_RESOLVE));
+        packet->args[0].p = srcImage;
+        packet->args[1].p = destImage;
+        packet->args[2].u = regionCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pRegions, packet->payloadSize);
+        return;
+    }
+
+    grCmdBufferEndRenderPass(grCmdBuffer);
+
+    STACK_ARRAY(VkImageResolve, vkRegions, 16, regionCount);
+
+    for (unsigned i = 0; i < regionCount; i++) {
+        const GR_IMAGE_RESOLVE* region = &pRegions[i];
+
+        if (region->srcSubresource.aspect != GR_IMAGE_ASPECT_COLOR) {
+            LOGW("unhandled depth-stencil resolve\n");
+            continue;
+        }
+
+        vkRegions[vkRegionCount] = (VkImageResolve) {
+            .srcSubresource = getVkImageSubresourceLayers(region->srcSubresource),
+            .srcOffset = { region->srcOffset.x, region->srcOffset.y, 0 },
+            .dstSubresource = getVkImageSubresourceLayers(region->destSubresource),
+            .dstOffset = { region->destOffset.x, region->destOffset.y, 0 },
+            .extent = { region->extent.width, region->extent.height, 1 },
+        };
+        vkRegionCount++;
+    }
+
+    if (vkRegionCount > 0) {
+        VKD.vkCmdResolveImage(grCmdBuffer->commandBuffer,
+                              grSrcImage->image, getVkImageLayout(GR_IMAGE_STATE_RESOLVE_SOURCE),
+                              grDstImage->image,
+                              getVkImageLayout(GR_IMAGE_STATE_RESOLVE_DESTINATION),
+                              vkRegionCount, vkRegions);
+    }
+
+    STACK_ARRAY_FINISH(vkRegions);
+}
+
+static VkImageAspectFlags getImageAspectFlags(
+    const GrImage* grImage)
+{
+    VkImageAspectFlags aspectFlags = 0;
+
+    if (grImage->depthFormat != VK_FORMAT_UNDEFINED) {
+        aspectFlags |= VK_IMAGE_ASPECT_DEPTH_BIT;
+    }
+    if (grImage->stencilFormat != VK_FORMAT_UNDEFINED) {
+        aspectFlags |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
 
-    STACK_ARRAY_FINISH(vkRegions);
+    return aspectFlags != 0 ? aspectFlags : VK_IMAGE_ASPECT_COLOR_BIT;
 }
 
-GR_VOID GR_STDCALL grCmdCopyMemoryToImage(
+GR_VOID GR_STDCALL grCmdCloneImageData(
     GR_CMD_BUFFER cmdBuffer,
-    GR_GPU_MEMORY srcMem,
+    GR_IMAGE srcImage,
+    GR_ENUM srcImageState,
     GR_IMAGE destImage,
-    GR_UINT regionCount,
-    const GR_MEMORY_IMAGE_COPY* pRegions)
+    GR_ENUM destImageState)
 {
-    LOGT("%p %p %p %u %p\n", cmdBuffer, srcMem, destImage, regionCount, pRegions);
+    LOGT("%p %p 0x%X %p 0x%X\n", cmdBuffer, srcImage, srcImageState, destImage, destImageState);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
-    GrGpuMemory* grSrcGpuMemory = (GrGpuMemory*)srcMem;
+    GrImage* grSrcImage = (GrImage*)srcImage;
     GrImage* grDstImage = (GrImage*)destImage;
-    unsigned dstTileSize = getVkFormatTileSize(grDstImage->format);
 
-    if (quirkHas(QUIRK_COMPRESSED_IMAGE_COPY_IN_TEXELS)) {
-        dstTileSize = 1;
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_CLONE_IMAGE_DATA, 0);
+        packet->args[0].p = srcImage;
+        packet->args[1].u = srcImageState;
+        packet->args[2].p = destImage;
+        packet->args[3].u = destImageState;
+        return;
     }
 
+    VkImageLayout srcLayout = getVkImageLayout(srcImageState);
+    VkImageLayout dstLayout = getVkImageLayout(destImageState);
+    VkImageLayout srcCopyLayout = srcLayout == VK_IMAGE_LAYOUT_GENERAL ?
+                                  VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    VkImageLayout dstCopyLayout = dstLayout == VK_IMAGE_LAYOUT_GENERAL ?
+                                  VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    VkImageAspectFlags aspectFlags = getImageAspectFlags(grSrcImage);
+
+    const VkImageSubresourceRange subresourceRange = {
+        .aspectMask = aspectFlags,
+        .baseMipLevel = 0,
+        .levelCount = VK_REMAINING_MIP_LEVELS,
+        .baseArrayLayer = 0,
+        .layerCount = VK_REMAINING_ARRAY_LAYERS,
+    };
+
     grCmdBufferEndRenderPass(grCmdBuffer);
 
-    STACK_ARRAY(VkBufferImageCopy, vkRegions, 128, regionCount);
+    // Move both images to copy layouts, the destination contents are entirely replaced
+    VkImageMemoryBarrier2 srcBarrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .pNext = NULL,
+        .srcStageMask = getVkPipelineStageFlagsImage(srcImageState),
+        .srcAccessMask = getVkAccessFlagsImage(srcImageState),
+        .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+        .oldLayout = srcLayout,
+        .newLayout = srcCopyLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = grSrcImage->image,
+        .subresourceRange = subresourceRange,
+    };
+    VkImageMemoryBarrier2 dstBarrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .pNext = NULL,
+        .srcStageMask = getVkPipelineStageFlagsImage(destImageState),
+        .srcAccessMask = getVkAccessFlagsImage(destImageState),
+        .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+        .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = dstCopyLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = grDstImage->image,
+        .subresourceRange = subresourceRange,
+    };
 
-    for (unsigned i = 0; i < regionCount; i++) {
-        const GR_MEMORY_IMAGE_COPY* region = &pRegions[i];
+    grCmdBufferAddImageBarrier(grCmdBuffer, &srcBarrier);
+    grCmdBufferAddImageBarrier(grCmdBuffer, &dstBarrier);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
-        vkRegions[i] = (VkBufferImageCopy) {
-            .bufferOffset = region->memOffset,
-            .bufferRowLength = 0,
-            .bufferImageHeight = 0,
-            .imageSubresource = getVkImageSubresourceLayers(region->imageSubresource),
-            .imageOffset = {
-                region->imageOffset.x * dstTileSize,
-                region->imageOffset.y * dstTileSize,
-                region->imageOffset.z
-            },
-            .imageExtent = {
-                MIN(region->imageExtent.width * dstTileSize,
-                    MIP(grDstImage->extent.width, region->imageSubresource.mipLevel)),
-                MIN(region->imageExtent.height * dstTileSize,
-                    MIP(grDstImage->extent.height, region->imageSubresource.mipLevel)),
-                region->imageExtent.depth,
+    STACK_ARRAY(VkImageCopy, vkRegions, 16, grSrcImage->mipLevels);
+
+    for (unsigned i = 0; i < grSrcImage->mipLevels; i++) {
+        const VkImageSubresourceLayers subresourceLayers = {
+            .aspectMask = aspectFlags,
+            .mipLevel = i,
+            .baseArrayLayer = 0,
+            .layerCount = grSrcImage->arrayLayers,
+        };
+
+        vkRegions[i] = (VkImageCopy) {
+            .srcSubresource = subresourceLayers,
+            .srcOffset = { 0, 0, 0 },
+            .dstSubresource = subresourceLayers,
+            .dstOffset = { 0, 0, 0 },
+            .extent = {
+                MIP(grSrcImage->extent.width, i),
+                MIP(grSrcImage->extent.height, i),
+                MIP(grSrcImage->extent.depth, i),
             },
         };
     }
 
-    VKD.vkCmdCopyBufferToImage(grCmdBuffer->commandBuffer,
-                               grSrcGpuMemory->buffer, grDstImage->image,
-                               getVkImageLayout(GR_IMAGE_STATE_DATA_TRANSFER),
-                               regionCount, vkRegions);
+    VKD.vkCmdCopyImage(grCmdBuffer->commandBuffer,
+                       grSrcImage->image, srcCopyLayout, grDstImage->image, dstCopyLayout,
+                       grSrcImage->mipLevels, vkRegions);
 
     STACK_ARRAY_FINISH(vkRegions);
+
+    // Return to the states the images were cloned in, recorded with the next barrier batch
+    srcBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    srcBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+    srcBarrier.dstStageMask = getVkPipelineStageFlagsImage(srcImageState);
+    srcBarrier.dstAccessMask = getVkAccessFlagsImage(srcImageState);
+    srcBarrier.oldLayout = srcCopyLayout;
+    srcBarrier.newLayout = srcLayout;
+
+    dstBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    dstBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    dstBarrier.dstStageMask = getVkPipelineStageFlagsImage(destImageState);
+    dstBarrier.dstAccessMask = getVkAccessFlagsImage(destImageState);
+    dstBarrier.oldLayout = dstCopyLayout;
+    dstBarrier.newLayout = dstLayout;
+
+    // Images can't be transitioned to the undefined layout, leave them in their copy layouts
+    if (srcLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        grCmdBufferAddImageBarrier(grCmdBuffer, &srcBarrier);
+    }
+    if (dstLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        grCmdBufferAddImageBarrier(grCmdBuffer, &dstBarrier);
+    }
 }
 
-GR_VOID GR_STDCALL grCmdCopyImageToMemory(
-    GR_CMD_BUFFER cmdBuffer,
-    GR_IMAGE srcImage,
-    GR_GPU_MEMORY destMem,
-    GR_UINT regionCount,
-    const GR_MEMORY_IMAGE_COPY* pRegions)
+static bool getUploadBuffer(
+    const GrCmdBuffer* grCmdBuffer,
+    UploadBuffer* uploadBuffer,
+    VkDeviceSize size)
 {
-    LOGT("%p %p %p %u %p\n", cmdBuffer, srcImage, destMem, regionCount, pRegions);
-    GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
-    GrImage* grSrcImage = (GrImage*)srcImage;
-    GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
-    unsigned srcTileSize = getVkFormatTileSize(grSrcImage->format);
+    VkMemoryRequirements memoryRequirements;
+    VkResult vkRes;
 
-    if (quirkHas(QUIRK_COMPRESSED_IMAGE_COPY_IN_TEXELS)) {
-        srcTileSize = 1;
+    *uploadBuffer = (UploadBuffer) {
+        .buffer = VK_NULL_HANDLE,
+        .memory = VK_NULL_HANDLE,
+        .size = size,
+        .data = NULL,
+    };
+
+    const VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .pQueueFamilyIndices = NULL,
+    };
+
+    vkRes = VKD.vkCreateBuffer(grDevice->device, &bufferCreateInfo, NULL, &uploadBuffer->buffer);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkCreateBuffer failed (%d)\n", vkRes);
+        return false;
     }
 
-    grCmdBufferEndRenderPass(grCmdBuffer);
+    VKD.vkGetBufferMemoryRequirements(grDevice->device, uploadBuffer->buffer,
+                                      &memoryRequirements);
 
-    STACK_ARRAY(VkBufferImageCopy, vkRegions, 128, regionCount);
+    unsigned memoryTypeIndex = INVALID_MEMORY_TYPE_INDEX;
+    for (unsigned i = 0; i < grDevice->memoryProperties.memoryTypeCount; i++) {
+        VkMemoryPropertyFlags flags = grDevice->memoryProperties.memoryTypes[i].propertyFlags;
 
-    for (unsigned i = 0; i < regionCount; i++) {
-        const GR_MEMORY_IMAGE_COPY* region = &pRegions[i];
+        if ((memoryRequirements.memoryTypeBits & (1 << i)) &&
+            (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+            (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+            memoryTypeIndex = i;
+            break;
+        }
+    }
 
-        vkRegions[i] = (VkBufferImageCopy) {
-            .bufferOffset = region->memOffset,
-            .bufferRowLength = 0,
-            .bufferImageHeight = 0,
-            .imageSubresource = getVkImageSubresourceLayers(region->imageSubresource),
-            .imageOffset = {
-                region->imageOffset.x * srcTileSize,
-                region->imageOffset.y * srcTileSize,
-                region->imageOffset.z
-            },
-            .imageExtent = {
-                MIN(region->imageExtent.width * srcTileSize,
-                    MIP(grSrcImage->extent.width, region->imageSubresource.mipLevel)),
-                MIN(region->imageExtent.height * srcTileSize,
-                    MIP(grSrcImage->extent.height, region->imageSubresource.mipLevel)),
-                region->imageExtent.depth,
-            },
-        };
+    if (memoryTypeIndex == INVALID_MEMORY_TYPE_INDEX) {
+        LOGW("no host-visible coherent memory type for upload buffers\n");
+        VKD.vkDestroyBuffer(grDevice->device, uploadBuffer->buffer, NULL);
+        return false;
     }
 
-    VKD.vkCmdCopyImageToBuffer(grCmdBuffer->commandBuffer, grSrcImage->image,
-                               getVkImageLayout(GR_IMAGE_STATE_DATA_TRANSFER),
-                               grDstGpuMemory->buffer, regionCount, vkRegions);
+    const VkMemoryAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = NULL,
+        .allocationSize = memoryRequirements.size,
+        .memoryTypeIndex = memoryTypeIndex,
+    };
 
-    STACK_ARRAY_FINISH(vkRegions);
+    vkRes = VKD.vkAllocateMemory(grDevice->device, &allocateInfo, NULL, &uploadBuffer->memory);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkAllocateMemory failed (%d)\n", vkRes);
+        VKD.vkDestroyBuffer(grDevice->device, uploadBuffer->buffer, NULL);
+        return false;
+    }
+
+    vkRes = VKD.vkBindBufferMemory(grDevice->device, uploadBuffer->buffer, uploadBuffer->memory,
+                                   0);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkBindBufferMemory failed (%d)\n", vkRes);
+        VKD.vkDestroyBuffer(grDevice->device, uploadBuffer->buffer, NULL);
+        VKD.vkFreeMemory(grDevice->device, uploadBuffer->memory, NULL);
+        return false;
+    }
+
+    vkRes = VKD.vkMapMemory(grDevice->device, uploadBuffer->memory, 0, VK_WHOLE_SIZE, 0,
+                            (void**)&uploadBuffer->data);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkMapMemory failed (%d)\n", vkRes);
+        VKD.vkDestroyBuffer(grDevice->device, uploadBuffer->buffer, NULL);
+        VKD.vkFreeMemory(grDevice->device, uploadBuffer->memory, NULL);
+        return false;
+    }
+
+    return true;
+}
+
+static const UploadBuffer* grCmdBufferAllocateUpload(
+    GrCmdBuffer* grCmdBuffer,
+    VkDeviceSize* offset,
+    VkDeviceSize size)
+{
+    while (grCmdBuffer->uploadBufferIndex < grCmdBuffer->uploadBufferCount) {
+        const UploadBuffer* uploadBuffer =
+            &grCmdBuffer->uploadBuffers[grCmdBuffer->uploadBufferIndex];
+        VkDeviceSize uploadOffset = ALIGN(grCmdBuffer->uploadBufferOffset, 16);
+
+        if (uploadOffset + size <= uploadBuffer->size) {
+            grCmdBuffer->uploadBufferOffset = uploadOffset + size;
+            *offset = uploadOffset;
+            return uploadBuffer;
+        }
+
+        // Use the next buffer
+        grCmdBuffer->uploadBufferIndex++;
+        grCmdBuffer->uploadBufferOffset = 0;
+    }
+
+    UploadBuffer uploadBuffer;
+    if (!getUploadBuffer(grCmdBuffer, &uploadBuffer, MAX(size, UPLOAD_BUFFER_SIZE))) {
+        return NULL;
+    }
+
+    grCmdBuffer->uploadBufferCount++;
+    grCmdBuffer->uploadBuffers = realloc(grCmdBuffer->uploadBuffers,
+                                         grCmdBuffer->uploadBufferCount * sizeof(UploadBuffer));
+    grCmdBuffer->uploadBuffers[grCmdBuffer->uploadBufferIndex] = uploadBuffer;
+    grCmdBuffer->uploadBufferOffset = size;
+
+    *offset = 0;
+    return &grCmdBuffer->uploadBuffers[grCmdBuffer->uploadBufferIndex];
 }
 
 GR_VOID GR_STDCALL grCmdUpdateMemory(
@@ -996,10 +2904,44 @@ GR_VOID GR_STDCALL grCmdUpdateMemory(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_UPDATE_MEMORY, dataSize);
+        packet->args[0].p = destMem;
+        packet->args[1].u = destOffset;
+        packet->args[2].u = dataSize;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pData, dataSize);
+        return;
+    }
+
     grCmdBufferEndRenderPass(grCmdBuffer);
 
-    VKD.vkCmdUpdateBuffer(grCmdBuffer->commandBuffer, grDstGpuMemory->buffer, destOffset,
-                          dataSize, pData);
+    if (dataSize >= MIN_UPLOAD_SIZE) {
+        VkDeviceSize uploadOffset = 0;
+        const UploadBuffer* uploadBuffer =
+            grCmdBufferAllocateUpload(grCmdBuffer, &uploadOffset, dataSize);
+
+        if (uploadBuffer != NULL) {
+            const VkBufferCopy bufferCopy = {
+                .srcOffset = uploadOffset,
+                .dstOffset = destOffset,
+                .size = dataSize,
+            };
+
+            memcpy(&uploadBuffer->data[uploadOffset], pData, dataSize);
+            VKD.vkCmdCopyBuffer(grCmdBuffer->commandBuffer, uploadBuffer->buffer,
+                                grDstGpuMemory->buffer, 1, &bufferCopy);
+            grCmdBuffer->uploadedSize += dataSize;
+            return;
+        }
+    }
+
+    // Split updates past the inline limit, in case the upload buffer couldn't be allocated
+    for (GR_GPU_SIZE offset = 0; offset < dataSize; offset += MAX_INLINE_UPDATE_SIZE) {
+        VKD.vkCmdUpdateBuffer(grCmdBuffer->commandBuffer, grDstGpuMemory->buffer,
+                              destOffset + offset, MIN(dataSize - offset, MAX_INLINE_UPDATE_SIZE),
+                              (const uint8_t*)pData + offset);
+    }
+    grCmdBuffer->inlineUpdateSize += dataSize;
 }
 
 GR_VOID GR_STDCALL grCmdFillMemory(
@@ -1014,6 +2956,15 @@ GR_VOID GR_STDCALL grCmdFillMemory(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_FILL_MEMORY, 0);
+        packet->args[0].p = destMem;
+        packet->args[1].u = destOffset;
+        packet->args[2].u = fillSize;
+        packet->args[3].u = data;
+        return;
+    }
+
     grCmdBufferEndRenderPass(grCmdBuffer);
 
     VKD.vkCmdFillBuffer(grCmdBuffer->commandBuffer, grDstGpuMemory->buffer, destOffset,
@@ -1030,13 +2981,29 @@ GR_VOID GR_STDCALL grCmdClearColorImage(
     LOGT("%p %p %g %g %g %g %u %p\n",
          cmdBuffer, image, color[0], color[1], color[2], color[3], rangeCount, pRanges);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrImage* grImage = (GrImage*)image;
 
-    grCmdBufferEndRenderPass(grCmdBuffer);
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet =
+            grCmdBufferRecordPacket(grCmdBuffer, CMD_CLEAR_COLOR_IMAGE,
+                                    rangeCount * sizeof(GR_IMAGE_SUBRESOURCE_RANGE));
+        packet->args[0].p = image;
+        packet->args[1].f = color[0];
+        packet->args[2].f = color[1];
+        packet->args[3].f = color[2];
+        packet->args[4].f = color[3];
+        packet->args[5].u = rangeCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pRanges, packet->payloadSize);
+        return;
+    }
+
+    grCmdBufferEndRendering(grCmdBuffer);
+    grCmdBufferFlushClears(grCmdBuffer, grImage);
 
-    const VkClearColorValue vkColor = {
-        .float32 = { color[0], color[1], color[2], color[3] },
+    const VkClearValue clearValue = {
+        .color = {
+            .float32 = { color[0], color[1], color[2], color[3] },
+        },
     };
 
     STACK_ARRAY(VkImageSubresourceRange, vkRanges, 128, rangeCount);
@@ -1045,9 +3012,8 @@ GR_VOID GR_STDCALL grCmdClearColorImage(
         vkRanges[i] = getVkImageSubresourceRange(pRanges[i], grImage->multiplyCubeLayers);
     }
 
-    VKD.vkCmdClearColorImage(grCmdBuffer->commandBuffer, grImage->image,
-                             getVkImageLayout(GR_IMAGE_STATE_CLEAR),
-                             &vkColor, rangeCount, vkRanges);
+    grCmdBufferAddClear(grCmdBuffer, grImage, rangeCount, vkRanges,
+                        getVkImageLayout(GR_IMAGE_STATE_CLEAR), &clearValue);
 
     STACK_ARRAY_FINISH(vkRanges);
 }
@@ -1062,15 +3028,31 @@ GR_VOID GR_STDCALL grCmdClearColorImageRaw(
     LOGT("%p %p %u %u %u %u %u %p\n",
          cmdBuffer, image, color[0], color[1], color[2], color[3], rangeCount, pRanges);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrImage* grImage = (GrImage*)image;
 
-    grCmdBufferEndRenderPass(grCmdBuffer);
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet =
+            grCmdBufferRecordPacket(grCmdBuffer, CMD_CLEAR_COLOR_IMAGE_RAW,
+                                    rangeCount * sizeof(GR_IMAGE_SUBRESOURCE_RANGE));
+        packet->args[0].p = image;
+        packet->args[1].u = color[0];
+        packet->args[2].u = color[1];
+        packet->args[3].u = color[2];
+        packet->args[4].u = color[3];
+        packet->args[5].u = rangeCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pRanges, packet->payloadSize);
+        return;
+    }
+
+    grCmdBufferEndRendering(grCmdBuffer);
+    grCmdBufferFlushClears(grCmdBuffer, grImage);
 
     GR_IMAGE_STATE imageState = quirkHas(QUIRK_IMAGE_DATA_TRANSFER_STATE_FOR_RAW_CLEAR) ?
                                 GR_IMAGE_STATE_DATA_TRANSFER : GR_IMAGE_STATE_CLEAR;
-    const VkClearColorValue vkColor = {
-        .uint32 = { color[0], color[1], color[2], color[3] },
+    const VkClearValue clearValue = {
+        .color = {
+            .uint32 = { color[0], color[1], color[2], color[3] },
+        },
     };
 
     STACK_ARRAY(VkImageSubresourceRange, vkRanges, 128, rangeCount);
@@ -1079,8 +3061,8 @@ GR_VOID GR_STDCALL grCmdClearColorImageRaw(
         vkRanges[i] = getVkImageSubresourceRange(pRanges[i], grImage->multiplyCubeLayers);
     }
 
-    VKD.vkCmdClearColorImage(grCmdBuffer->commandBuffer, grImage->image,
-                             getVkImageLayout(imageState), &vkColor, rangeCount, vkRanges);
+    grCmdBufferAddClear(grCmdBuffer, grImage, rangeCount, vkRanges,
+                        getVkImageLayout(imageState), &clearValue);
 
     STACK_ARRAY_FINISH(vkRanges);
 }
@@ -1095,14 +3077,28 @@ GR_VOID GR_STDCALL grCmdClearDepthStencil(
 {
     LOGT("%p %p %g %u %u %p\n", cmdBuffer, image, depth, stencil, rangeCount, pRanges);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrImage* grImage = (GrImage*)image;
 
-    grCmdBufferEndRenderPass(grCmdBuffer);
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet =
+            grCmdBufferRecordPacket(grCmdBuffer, CMD_CLEAR_DEPTH_STENCIL,
+                                    rangeCount * sizeof(GR_IMAGE_SUBRESOURCE_RANGE));
+        packet->args[0].p = image;
+        packet->args[1].f = depth;
+        packet->args[2].u = stencil;
+        packet->args[3].u = rangeCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pRanges, packet->payloadSize);
+        return;
+    }
+
+    grCmdBufferEndRendering(grCmdBuffer);
+    grCmdBufferFlushClears(grCmdBuffer, grImage);
 
-    const VkClearDepthStencilValue depthStencilValue = {
-        .depth = depth,
-        .stencil = stencil,
+    const VkClearValue clearValue = {
+        .depthStencil = {
+            .depth = depth,
+            .stencil = stencil,
+        },
     };
 
     STACK_ARRAY(VkImageSubresourceRange, vkRanges, 128, rangeCount);
@@ -1111,9 +3107,8 @@ GR_VOID GR_STDCALL grCmdClearDepthStencil(
         vkRanges[i] = getVkImageSubresourceRange(pRanges[i], grImage->multiplyCubeLayers);
     }
 
-    VKD.vkCmdClearDepthStencilImage(grCmdBuffer->commandBuffer, grImage->image,
-                                    getVkImageLayout(GR_IMAGE_STATE_CLEAR),
-                                    &depthStencilValue, rangeCount, vkRanges);
+    grCmdBufferAddClear(grCmdBuffer, grImage, rangeCount, vkRanges,
+                        getVkImageLayout(GR_IMAGE_STATE_CLEAR), &clearValue);
 
     STACK_ARRAY_FINISH(vkRanges);
 }
@@ -1127,6 +3122,12 @@ GR_VOID GR_STDCALL grCmdSetEvent(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrEvent* grEvent = (GrEvent*)event;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_SET_EVENT, 0);
+        packet->args[0].p = event;
+        return;
+    }
+
     grCmdBufferEndRenderPass(grCmdBuffer);
 
     VKD.vkCmdSetEvent(grCmdBuffer->commandBuffer, grEvent->event,
@@ -1142,6 +3143,12 @@ GR_VOID GR_STDCALL grCmdResetEvent(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrEvent* grEvent = (GrEvent*)event;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_RESET_EVENT, 0);
+        packet->args[0].p = event;
+        return;
+    }
+
     grCmdBufferEndRenderPass(grCmdBuffer);
 
     VKD.vkCmdResetEvent(grCmdBuffer->commandBuffer, grEvent->event,
@@ -1155,10 +3162,18 @@ GR_VOID GR_STDCALL grCmdBeginQuery(
     GR_FLAGS flags)
 {
     LOGT("%p %p %u 0x%X\n", cmdBuffer, queryPool, slot, flags);
-    const GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
+    GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     const GrQueryPool* grQueryPool = (GrQueryPool*)queryPool;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_BEGIN_QUERY, 0);
+        packet->args[0].p = queryPool;
+        packet->args[1].u = slot;
+        packet->args[2].u = flags;
+        return;
+    }
+
     VKD.vkCmdBeginQuery(grCmdBuffer->commandBuffer, grQueryPool->queryPool, slot,
                         flags & GR_QUERY_IMPRECISE_DATA ? 0 : VK_QUERY_CONTROL_PRECISE_BIT);
 }
@@ -1169,10 +3184,17 @@ GR_VOID GR_STDCALL grCmdEndQuery(
     GR_UINT slot)
 {
     LOGT("%p %p %u\n", cmdBuffer, queryPool, slot);
-    const GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
+    GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     const GrQueryPool* grQueryPool = (GrQueryPool*)queryPool;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_END_QUERY, 0);
+        packet->args[0].p = queryPool;
+        packet->args[1].u = slot;
+        return;
+    }
+
     VKD.vkCmdEndQuery(grCmdBuffer->commandBuffer, grQueryPool->queryPool, slot);
 }
 
@@ -1187,6 +3209,14 @@ GR_VOID GR_STDCALL grCmdResetQueryPool(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     const GrQueryPool* grQueryPool = (GrQueryPool*)queryPool;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_RESET_QUERY_POOL, 0);
+        packet->args[0].p = queryPool;
+        packet->args[1].u = startQuery;
+        packet->args[2].u = queryCount;
+        return;
+    }
+
     grCmdBufferEndRenderPass(grCmdBuffer);
 
     VKD.vkCmdResetQueryPool(grCmdBuffer->commandBuffer, grQueryPool->queryPool,
@@ -1204,6 +3234,14 @@ GR_VOID GR_STDCALL grCmdWriteTimestamp(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrGpuMemory* grGpuMemory = (GrGpuMemory*)destMem;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_WRITE_TIMESTAMP, 0);
+        packet->args[0].u = timestampType;
+        packet->args[1].p = destMem;
+        packet->args[2].u = destOffset;
+        return;
+    }
+
     VkPipelineStageFlags stageFlags = 0;
     if (timestampType == GR_TIMESTAMP_TOP) {
         stageFlags = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
@@ -1216,76 +3254,181 @@ GR_VOID GR_STDCALL grCmdWriteTimestamp(
 
     grCmdBufferEndRenderPass(grCmdBuffer);
 
-    VKD.vkCmdResetQueryPool(grCmdBuffer->commandBuffer, grCmdBuffer->timestampQueryPool, 0, 1);
+    if (grCmdBuffer->timestampCount == TIMESTAMP_QUERIES_PER_RANGE) {
+        // Ring is full, copy results out before the queries get reused
+        grCmdBufferFlushTimestamps(grCmdBuffer);
+    }
+
+    if (grCmdBuffer->timestampCount == 0) {
+        VKD.vkCmdResetQueryPool(grCmdBuffer->commandBuffer, grCmdBuffer->timestampQueryPool,
+                                grCmdBuffer->timestampQueryIndex, TIMESTAMP_QUERIES_PER_RANGE);
+    }
 
     VKD.vkCmdWriteTimestamp(grCmdBuffer->commandBuffer, stageFlags,
-                            grCmdBuffer->timestampQueryPool, 0);
+                            grCmdBuffer->timestampQueryPool,
+                            grCmdBuffer->timestampQueryIndex + grCmdBuffer->timestampCount);
 
-    VKD.vkCmdCopyQueryPoolResults(grCmdBuffer->commandBuffer, grCmdBuffer->timestampQueryPool,
-                                  0, 1, grGpuMemory->buffer, destOffset, sizeof(uint64_t),
-                                  VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    grCmdBuffer->pendingTimestamps[grCmdBuffer->timestampCount] = (PendingTimestamp) {
+        .buffer = grGpuMemory->buffer,
+        .offset = destOffset,
+    };
+    grCmdBuffer->timestampCount++;
 }
 
-GR_VOID GR_STDCALL grCmdInitAtomicCounters(
-    GR_CMD_BUFFER cmdBuffer,
-    GR_ENUM pipelineBindPoint,
-    GR_UINT startCounter,
-    GR_UINT counterCount,
-    const GR_UINT32* pData)
+static bool counterRangesOverlap(
+    unsigned startA,
+    unsigned endA,
+    unsigned startB,
+    unsigned endB)
 {
-    LOGT("%p 0x%X %u %u %p\n", cmdBuffer, pipelineBindPoint, startCounter, counterCount, pData);
-    GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    return startA < endB && startB < endA;
+}
 
-    grCmdBufferEndRenderPass(grCmdBuffer);
+static void addCounterRange(
+    unsigned* start,
+    unsigned* end,
+    unsigned rangeStart,
+    unsigned rangeEnd)
+{
+    if (*start == *end) {
+        *start = rangeStart;
+        *end = rangeEnd;
+    } else {
+        *start = MIN(*start, rangeStart);
+        *end = MAX(*end, rangeEnd);
+    }
+}
 
+static void grCmdBufferBeginAtomicCounterTransfer(
+    GrCmdBuffer* grCmdBuffer,
+    unsigned startCounter,
+    unsigned counterCount,
+    bool isWrite)
+{
+    unsigned endCounter = startCounter + counterCount;
+    VkPipelineStageFlags2 srcStageMask;
+    VkAccessFlags2 srcAccessMask;
+    VkAccessFlags2 dstAccessMask = isWrite ? VK_ACCESS_2_TRANSFER_WRITE_BIT
+                                           : VK_ACCESS_2_TRANSFER_READ_BIT;
     VkDeviceSize offset = startCounter * sizeof(uint32_t);
     VkDeviceSize size = counterCount * sizeof(uint32_t);
 
-    const VkBufferMemoryBarrier preUpdateBarrier = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .pNext = NULL,
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer = grCmdBuffer->atomicCounterBuffer,
-        .offset = offset,
-        .size = size,
-    };
+    if (!grCmdBuffer->hasAtomicCounterTransfers) {
+        // Shaders may have accessed the counters since the last batch. Cover the whole buffer
+        // so that later transfers to disjoint ranges in the same batch are ordered as well.
+        srcStageMask = ATOMIC_COUNTER_STAGES | VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        offset = 0;
+        size = VK_WHOLE_SIZE;
+    } else if (counterRangesOverlap(startCounter, endCounter,
+                                    grCmdBuffer->atomicCounterWriteStart,
+                                    grCmdBuffer->atomicCounterWriteEnd) ||
+               (isWrite && counterRangesOverlap(startCounter, endCounter,
+                                                grCmdBuffer->atomicCounterReadStart,
+                                                grCmdBuffer->atomicCounterReadEnd))) {
+        // Order against the overlapping transfer from the same batch
+        srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    } else {
+        srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        srcAccessMask = VK_ACCESS_2_NONE;
+    }
+
+    if (srcStageMask != VK_PIPELINE_STAGE_2_NONE) {
+        const VkBufferMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+            .pNext = NULL,
+            .srcStageMask = srcStageMask,
+            .srcAccessMask = srcAccessMask,
+            .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .dstAccessMask = dstAccessMask,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = grCmdBuffer->atomicCounterBuffer,
+            .offset = offset,
+            .size = size,
+        };
 
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer,
-                             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             0, 0, NULL, 1, &preUpdateBarrier, 0, NULL);
+        grCmdBufferAddBufferBarrier(grCmdBuffer, &barrier);
+        grCmdBufferFlushBarriers(grCmdBuffer);
+    }
 
-    VKD.vkCmdUpdateBuffer(grCmdBuffer->commandBuffer, grCmdBuffer->atomicCounterBuffer,
-                          offset, size, pData);
+    if (isWrite) {
+        addCounterRange(&grCmdBuffer->atomicCounterWriteStart,
+                        &grCmdBuffer->atomicCounterWriteEnd, startCounter, endCounter);
+    } else {
+        addCounterRange(&grCmdBuffer->atomicCounterReadStart,
+                        &grCmdBuffer->atomicCounterReadEnd, startCounter, endCounter);
+    }
+    grCmdBuffer->hasAtomicCounterTransfers = true;
+}
+
+void grCmdBufferSyncAtomicCounters(
+    GrCmdBuffer* grCmdBuffer)
+{
+    if (!grCmdBuffer->hasAtomicCounterTransfers) {
+        return;
+    }
 
-    const VkBufferMemoryBarrier postUpdateBarrier = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    bool hasWrites = grCmdBuffer->atomicCounterWriteStart != grCmdBuffer->atomicCounterWriteEnd;
+    unsigned start = grCmdBuffer->atomicCounterReadStart;
+    unsigned end = grCmdBuffer->atomicCounterReadEnd;
+
+    addCounterRange(&start, &end, grCmdBuffer->atomicCounterWriteStart,
+                    grCmdBuffer->atomicCounterWriteEnd);
+
+    // Queued with the other barriers, only emitted once shaders may access the counters
+    const VkBufferMemoryBarrier2 barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
         .pNext = NULL,
-        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
-                         VK_ACCESS_SHADER_WRITE_BIT |
-                         VK_ACCESS_TRANSFER_READ_BIT |
-                         VK_ACCESS_TRANSFER_WRITE_BIT,
+        .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        .srcAccessMask = hasWrites ? VK_ACCESS_2_TRANSFER_WRITE_BIT : VK_ACCESS_2_NONE,
+        .dstStageMask = ATOMIC_COUNTER_STAGES,
+        .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT,
         .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
         .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
         .buffer = grCmdBuffer->atomicCounterBuffer,
-        .offset = offset,
-        .size = size,
+        .offset = start * sizeof(uint32_t),
+        .size = (end - start) * sizeof(uint32_t),
     };
 
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-                             VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             0, 0, NULL, 1, &postUpdateBarrier, 0, NULL);
+    grCmdBufferAddBufferBarrier(grCmdBuffer, &barrier);
+
+    grCmdBuffer->hasAtomicCounterTransfers = false;
+    grCmdBuffer->atomicCounterReadStart = 0;
+    grCmdBuffer->atomicCounterReadEnd = 0;
+    grCmdBuffer->atomicCounterWriteStart = 0;
+    grCmdBuffer->atomicCounterWriteEnd = 0;
+}
+
+GR_VOID GR_STDCALL grCmdInitAtomicCounters(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_ENUM pipelineBindPoint,
+    GR_UINT startCounter,
+    GR_UINT counterCount,
+    const GR_UINT32* pData)
+{
+    LOGT("%p 0x%X %u %u %p\n", cmdBuffer, pipelineBindPoint, startCounter, counterCount, pData);
+    GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_INIT_ATOMIC_COUNTERS,
+                                                    counterCount * sizeof(GR_UINT32));
+        packet->args[0].u = pipelineBindPoint;
+        packet->args[1].u = startCounter;
+        packet->args[2].u = counterCount;
+        memcpy(CMD_PACKET_PAYLOAD(packet), pData, packet->payloadSize);
+        return;
+    }
+
+    grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferBeginAtomicCounterTransfer(grCmdBuffer, startCounter, counterCount, true);
+
+    VKD.vkCmdUpdateBuffer(grCmdBuffer->commandBuffer, grCmdBuffer->atomicCounterBuffer,
+                          startCounter * sizeof(uint32_t), counterCount * sizeof(uint32_t),
+                          pData);
 }
 
 GR_VOID GR_STDCALL grCmdSaveAtomicCounters(
@@ -1302,7 +3445,18 @@ GR_VOID GR_STDCALL grCmdSaveAtomicCounters(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
 
+    if (grCmdBuffer->isDeferred) {
+        CmdPacket* packet = grCmdBufferRecordPacket(grCmdBuffer, CMD_SAVE_ATOMIC_COUNTERS, 0);
+        packet->args[0].u = pipelineBindPoint;
+        packet->args[1].u = startCounter;
+        packet->args[2].u = counterCount;
+        packet->args[3].p = destMem;
+        packet->args[4].u = destOffset;
+        return;
+    }
+
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferBeginAtomicCounterTransfer(grCmdBuffer, startCounter, counterCount, false);
 
     const VkBufferCopy bufferCopy = {
         .srcOffset = startCounter * sizeof(uint32_t),
@@ -1310,56 +3464,6 @@ GR_VOID GR_STDCALL grCmdSaveAtomicCounters(
         .size = counterCount * sizeof(uint32_t),
     };
 
-    const VkBufferMemoryBarrier preCopyBarrier = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .pNext = NULL,
-        .srcAccessMask = VK_ACCESS_SHADER_READ_BIT |
-                         VK_ACCESS_SHADER_WRITE_BIT |
-                         VK_ACCESS_TRANSFER_READ_BIT |
-                         VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer = grCmdBuffer->atomicCounterBuffer,
-        .offset = bufferCopy.srcOffset,
-        .size = bufferCopy.size,
-    };
-
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer,
-                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-                             VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             0, 0, NULL, 1, &preCopyBarrier, 0, NULL);
-
     VKD.vkCmdCopyBuffer(grCmdBuffer->commandBuffer, grCmdBuffer->atomicCounterBuffer,
                         grDstGpuMemory->buffer, 1, &bufferCopy);
-
-    const VkBufferMemoryBarrier postCopyBarrier = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .pNext = NULL,
-        .srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
-                         VK_ACCESS_SHADER_WRITE_BIT |
-                         VK_ACCESS_TRANSFER_READ_BIT |
-                         VK_ACCESS_TRANSFER_WRITE_BIT,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer = grCmdBuffer->atomicCounterBuffer,
-        .offset = bufferCopy.srcOffset,
-        .size = bufferCopy.size,
-    };
-
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-                             VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             0, 0, NULL, 1, &postCopyBarrier, 0, NULL);
 }
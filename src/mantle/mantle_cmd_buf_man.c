@@ -3,13 +3,17 @@
 void grCmdBufferResetState(
     GrCmdBuffer* grCmdBuffer)
 {
-    GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    // Hand descriptor pools back to the device, the command buffer is no longer in use
+    grCmdBufferReleaseDescriptorPools(grCmdBuffer);
 
-    // Reset descriptor pools
-    unsigned resetCount = MIN(grCmdBuffer->descriptorPoolIndex + 1,
-                              grCmdBuffer->descriptorPoolCount);
-    for (unsigned i = 0; i < resetCount; i++) {
-        VKD.vkResetDescriptorPool(grDevice->device, grCmdBuffer->descriptorPools[i], 0);
+    // Cached descriptor sets went away with the pools, keep the table capacity around
+    for (unsigned i = 0; i < grCmdBuffer->descriptorSetCacheSize; i++) {
+        free(grCmdBuffer->descriptorSetCache[i].payload);
+    }
+    if (grCmdBuffer->descriptorSetCacheCount > 0) {
+        memset(grCmdBuffer->descriptorSetCache, 0,
+               grCmdBuffer->descriptorSetCacheSize * sizeof(DescriptorSetCacheEntry));
+        grCmdBuffer->descriptorSetCacheCount = 0;
     }
 
     // Clear state
@@ -17,36 +21,228 @@ void grCmdBufferResetState(
     memset(&((uint8_t*)grCmdBuffer)[stateOffset], 0, sizeof(GrCmdBuffer) - stateOffset);
 }
 
-// Command Buffer Management Functions
+static VkResult beginVkCommandBuffer(
+    GrCmdBuffer* grCmdBuffer)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
-GR_RESULT GR_STDCALL grCreateCommandBuffer(
-    GR_DEVICE device,
-    const GR_CMD_BUFFER_CREATE_INFO* pCreateInfo,
-    GR_CMD_BUFFER* pCmdBuffer)
+    const VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext = NULL,
+        .flags = grCmdBuffer->usageFlags,
+        .pInheritanceInfo = NULL,
+    };
+
+    VkResult res = VKD.vkBeginCommandBuffer(grCmdBuffer->commandBuffer, &beginInfo);
+    if (res != VK_SUCCESS) {
+        LOGE("vkBeginCommandBuffer failed (%d)\n", res);
+    }
+
+    return res;
+}
+
+static VkResult endVkCommandBuffer(
+    GrCmdBuffer* grCmdBuffer)
 {
-    LOGT("%p %p %p\n", device, pCreateInfo, pCmdBuffer);
-    GrDevice* grDevice = (GrDevice*)device;
-    GrQueue* grQueue;
-    VkResult vkRes;
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+
+    grCmdBufferSyncAtomicCounters(grCmdBuffer);
+    grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushTimestamps(grCmdBuffer);
+
+    VkResult res = VKD.vkEndCommandBuffer(grCmdBuffer->commandBuffer);
+    if (res != VK_SUCCESS) {
+        LOGE("vkEndCommandBuffer failed (%d)\n", res);
+        return res;
+    }
+
+    if (profilerIsCommandStatsEnabled()) {
+        // Reported per frame with the command timings rather than per command buffer
+        uint64_t* counts = grCmdBuffer->cmdStats.counterCounts;
+
+        counts[CMD_COUNTER_DYNAMIC_STATE_EMITTED] += grCmdBuffer->emittedDynamicStateCount;
+        counts[CMD_COUNTER_DYNAMIC_STATE_SKIPPED] += grCmdBuffer->skippedDynamicStateCount;
+        counts[CMD_COUNTER_BARRIER_EMITTED] += grCmdBuffer->emittedBarrierCount;
+        counts[CMD_COUNTER_BARRIER_DROPPED] += grCmdBuffer->droppedBarrierCount;
+        counts[CMD_COUNTER_BARRIER_BATCH] += grCmdBuffer->barrierBatchCount;
+        counts[CMD_COUNTER_TIMESTAMP_COPY] += grCmdBuffer->timestampCopyCount;
+        counts[CMD_COUNTER_COPY_COMMAND] += grCmdBuffer->copyCommandCount;
+        counts[CMD_COUNTER_COPY_BATCHED] += grCmdBuffer->batchedCopyCount;
+        counts[CMD_COUNTER_COPY_REGION_MERGED] += grCmdBuffer->mergedCopyRegionCount;
+        counts[CMD_COUNTER_UPLOAD_RING_BYTES] += grCmdBuffer->uploadedSize;
+        counts[CMD_COUNTER_INLINE_UPDATE_BYTES] += grCmdBuffer->inlineUpdateSize;
+    }
+    profilerAddCommandStats(&grCmdBuffer->cmdStats);
+
+    return VK_SUCCESS;
+}
+
+static void translateCommandBuffer(
+    GrCmdBuffer* grCmdBuffer)
+{
+    unsigned packetCount = grCmdBuffer->cmdPacketCount;
+
+    VkResult res = beginVkCommandBuffer(grCmdBuffer);
+    if (res == VK_SUCCESS) {
+        // Run the recorded commands through the regular translation path
+        grCmdBuffer->isDeferred = false;
+        grCmdBufferReplayPackets(grCmdBuffer);
+        res = endVkCommandBuffer(grCmdBuffer);
+    }
+
+    LOGD("%p: translated %u commands\n", grCmdBuffer, packetCount);
+    grCmdBuffer->translationResult = res;
+}
+
+static DWORD WINAPI translationThreadProc(
+    LPVOID param)
+{
+    GrDevice* grDevice = (GrDevice*)param;
+
+    AcquireSRWLockExclusive(&grDevice->translationLock);
+
+    for (;;) {
+        while (grDevice->translationQueueHead == NULL && !grDevice->stopTranslation) {
+            SleepConditionVariableSRW(&grDevice->translationQueued, &grDevice->translationLock,
+                                      INFINITE, 0);
+        }
+
+        GrCmdBuffer* grCmdBuffer = grDevice->translationQueueHead;
+        if (grCmdBuffer == NULL) {
+            // Stop requested and nothing left to translate
+            break;
+        }
+
+        grDevice->translationQueueHead = grCmdBuffer->nextTranslation;
+        if (grDevice->translationQueueHead == NULL) {
+            grDevice->translationQueueTail = NULL;
+        }
+
+        // Independent command buffers are translated concurrently
+        ReleaseSRWLockExclusive(&grDevice->translationLock);
+        translateCommandBuffer(grCmdBuffer);
+        AcquireSRWLockExclusive(&grDevice->translationLock);
+
+        grCmdBuffer->isTranslating = false;
+        WakeAllConditionVariable(&grDevice->translationDone);
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->translationLock);
+    return 0;
+}
+
+static void queueTranslation(
+    GrCmdBuffer* grCmdBuffer)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+
+    AcquireSRWLockExclusive(&grDevice->translationLock);
+
+    grCmdBuffer->isTranslating = true;
+    grCmdBuffer->translationResult = VK_SUCCESS;
+    grCmdBuffer->nextTranslation = NULL;
+
+    if (grDevice->translationQueueTail != NULL) {
+        grDevice->translationQueueTail->nextTranslation = grCmdBuffer;
+    } else {
+        grDevice->translationQueueHead = grCmdBuffer;
+    }
+    grDevice->translationQueueTail = grCmdBuffer;
+
+    ReleaseSRWLockExclusive(&grDevice->translationLock);
+    WakeConditionVariable(&grDevice->translationQueued);
+}
+
+void grCmdBufferWaitTranslation(
+    GrCmdBuffer* grCmdBuffer)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+
+    if (!grDevice->deferCommandBuffers) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&grDevice->translationLock);
+    while (grCmdBuffer->isTranslating) {
+        SleepConditionVariableSRW(&grDevice->translationDone, &grDevice->translationLock,
+                                  INFINITE, 0);
+    }
+    ReleaseSRWLockExclusive(&grDevice->translationLock);
+}
+
+void grDeviceStartTranslationThreads(
+    GrDevice* grDevice)
+{
+    SYSTEM_INFO systemInfo;
+
+    // Leave a core to the application
+    GetSystemInfo(&systemInfo);
+    unsigned threadCount = MAX(MIN(systemInfo.dwNumberOfProcessors - 1,
+                                   MAX_TRANSLATION_THREADS), 1);
+
+    for (unsigned i = 0; i < threadCount; i++) {
+        HANDLE thread = CreateThread(NULL, 0, translationThreadProc, grDevice, 0, NULL);
+        if (thread == NULL) {
+            LOGE("CreateThread failed (%lu)\n", GetLastError());
+            break;
+        }
+
+        grDevice->translationThreads[grDevice->translationThreadCount] = thread;
+        grDevice->translationThreadCount++;
+    }
+
+    if (grDevice->translationThreadCount == 0) {
+        LOGW("no translation thread available, falling back to immediate translation\n");
+        grDevice->deferCommandBuffers = false;
+        return;
+    }
+
+    LOGI("translating command buffers on %u threads\n", grDevice->translationThreadCount);
+}
+
+void grDeviceStopTranslationThreads(
+    GrDevice* grDevice)
+{
+    if (grDevice->translationThreadCount == 0) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&grDevice->translationLock);
+    grDevice->stopTranslation = true;
+    ReleaseSRWLockExclusive(&grDevice->translationLock);
+    WakeAllConditionVariable(&grDevice->translationQueued);
+
+    WaitForMultipleObjects(grDevice->translationThreadCount, grDevice->translationThreads,
+                           TRUE, INFINITE);
+    for (unsigned i = 0; i < grDevice->translationThreadCount; i++) {
+        CloseHandle(grDevice->translationThreads[i]);
+    }
+    grDevice->translationThreadCount = 0;
+}
+
+static VkResult acquireVkCommandBuffer(
+    GrQueue* grQueue,
+    RecycledCommandBuffer* commandBuffer)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
     VkCommandPool vkCommandPool = VK_NULL_HANDLE;
     VkCommandBuffer vkCommandBuffer = VK_NULL_HANDLE;
-    VkQueryPool vkQueryPool = VK_NULL_HANDLE;
-
-    if (grDevice == NULL) {
-        return GR_ERROR_INVALID_HANDLE;
-    } else if (GET_OBJ_TYPE(grDevice) != GR_OBJ_TYPE_DEVICE) {
-        return GR_ERROR_INVALID_OBJECT_TYPE;
-    } else if (pCreateInfo == NULL || pCmdBuffer == NULL) {
-        return GR_ERROR_INVALID_POINTER;
-    } else if (pCreateInfo->flags != 0) {
-        return GR_ERROR_INVALID_FLAGS;
-    } else if (0) {
-        // TODO check queue type
-        return GR_ERROR_INVALID_QUEUE_TYPE;
+    bool isRecycled = false;
+    VkResult res;
+
+    AcquireSRWLockExclusive(&grQueue->recycleLock);
+    if (grQueue->recycledCommandBufferCount > 0) {
+        grQueue->recycledCommandBufferCount--;
+        *commandBuffer = grQueue->recycledCommandBuffers[grQueue->recycledCommandBufferCount];
+        isRecycled = true;
     }
+    ReleaseSRWLockExclusive(&grQueue->recycleLock);
 
-    grGetDeviceQueue(device, pCreateInfo->queueType, 0, (GR_QUEUE*)&grQueue);
+    if (isRecycled) {
+        return VK_SUCCESS;
+    }
 
+    // Each command buffer keeps its own pool as Mantle allows recording from any thread
     const VkCommandPoolCreateInfo poolCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .pNext = NULL,
@@ -54,10 +250,10 @@ GR_RESULT GR_STDCALL grCreateCommandBuffer(
         .queueFamilyIndex = grQueue->queueFamilyIndex,
     };
 
-    vkRes = VKD.vkCreateCommandPool(grDevice->device, &poolCreateInfo, NULL, &vkCommandPool);
-    if (vkRes != VK_SUCCESS) {
-        LOGE("vkCreateCommandPool failed (%d)\n", vkRes);
-        return getGrResult(vkRes);
+    res = VKD.vkCreateCommandPool(grDevice->device, &poolCreateInfo, NULL, &vkCommandPool);
+    if (res != VK_SUCCESS) {
+        LOGE("vkCreateCommandPool failed (%d)\n", res);
+        return res;
     }
 
     const VkCommandBufferAllocateInfo allocateInfo = {
@@ -68,23 +264,126 @@ GR_RESULT GR_STDCALL grCreateCommandBuffer(
         .commandBufferCount = 1,
     };
 
-    vkRes = VKD.vkAllocateCommandBuffers(grDevice->device, &allocateInfo, &vkCommandBuffer);
-    if (vkRes != VK_SUCCESS) {
-        LOGE("vkAllocateCommandBuffers failed (%d)\n", vkRes);
-        return getGrResult(vkRes);
+    res = VKD.vkAllocateCommandBuffers(grDevice->device, &allocateInfo, &vkCommandBuffer);
+    if (res != VK_SUCCESS) {
+        LOGE("vkAllocateCommandBuffers failed (%d)\n", res);
+        VKD.vkDestroyCommandPool(grDevice->device, vkCommandPool, NULL);
+        return res;
+    }
+
+    *commandBuffer = (RecycledCommandBuffer) {
+        .commandPool = vkCommandPool,
+        .commandBuffer = vkCommandBuffer,
+    };
+
+    return VK_SUCCESS;
+}
+
+static void acquireTimestampQueries(
+    GrCmdBuffer* grCmdBuffer)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    int range = -1;
+
+    AcquireSRWLockExclusive(&grDevice->timestampQueryLock);
+    if (grDevice->freeTimestampQueryRangeCount > 0) {
+        grDevice->freeTimestampQueryRangeCount--;
+        range = grDevice->freeTimestampQueryRanges[grDevice->freeTimestampQueryRangeCount];
+    }
+    ReleaseSRWLockExclusive(&grDevice->timestampQueryLock);
+
+    grCmdBuffer->timestampQueryRange = range;
+
+    if (range >= 0) {
+        grCmdBuffer->timestampQueryPool = grDevice->timestampQueryPool;
+        grCmdBuffer->timestampQueryIndex = range * TIMESTAMP_QUERIES_PER_RANGE;
+        return;
     }
 
-    // Create a query pool for timestamps
+    // All ranges are taken, fall back to a private query pool
     const VkQueryPoolCreateInfo queryPoolCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
         .queryType = VK_QUERY_TYPE_TIMESTAMP,
-        .queryCount = 1,
+        .queryCount = TIMESTAMP_QUERIES_PER_RANGE,
         .pipelineStatistics = 0,
     };
 
-    VKD.vkCreateQueryPool(grDevice->device, &queryPoolCreateInfo, NULL, &vkQueryPool);
+    VKD.vkCreateQueryPool(grDevice->device, &queryPoolCreateInfo, NULL,
+                          &grCmdBuffer->timestampQueryPool);
+    grCmdBuffer->timestampQueryIndex = 0;
+}
+
+void grCmdBufferRecycle(
+    GrCmdBuffer* grCmdBuffer)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    GrQueue* grQueue = grCmdBuffer->grQueue;
+    bool isRecycled = false;
+
+    // Drop recorded commands but keep the pool memory around for the next command buffer
+    VkResult res = VKD.vkResetCommandPool(grDevice->device, grCmdBuffer->commandPool, 0);
+    if (res == VK_SUCCESS) {
+        AcquireSRWLockExclusive(&grQueue->recycleLock);
+        if (grQueue->recycledCommandBufferCount < MAX_RECYCLED_COMMAND_BUFFERS) {
+            grQueue->recycledCommandBuffers[grQueue->recycledCommandBufferCount] =
+                (RecycledCommandBuffer) {
+                    .commandPool = grCmdBuffer->commandPool,
+                    .commandBuffer = grCmdBuffer->commandBuffer,
+                };
+            grQueue->recycledCommandBufferCount++;
+            isRecycled = true;
+        }
+        ReleaseSRWLockExclusive(&grQueue->recycleLock);
+    }
+
+    if (!isRecycled) {
+        VKD.vkDestroyCommandPool(grDevice->device, grCmdBuffer->commandPool, NULL);
+    }
+
+    if (grCmdBuffer->timestampQueryRange >= 0) {
+        AcquireSRWLockExclusive(&grDevice->timestampQueryLock);
+        grDevice->freeTimestampQueryRanges[grDevice->freeTimestampQueryRangeCount] =
+            grCmdBuffer->timestampQueryRange;
+        grDevice->freeTimestampQueryRangeCount++;
+        ReleaseSRWLockExclusive(&grDevice->timestampQueryLock);
+    } else {
+        VKD.vkDestroyQueryPool(grDevice->device, grCmdBuffer->timestampQueryPool, NULL);
+    }
+}
+
+// Command Buffer Management Functions
+
+GR_RESULT GR_STDCALL grCreateCommandBuffer(
+    GR_DEVICE device,
+    const GR_CMD_BUFFER_CREATE_INFO* pCreateInfo,
+    GR_CMD_BUFFER* pCmdBuffer)
+{
+    LOGT("%p %p %p\n", device, pCreateInfo, pCmdBuffer);
+    GrDevice* grDevice = (GrDevice*)device;
+    GrQueue* grQueue;
+
+    if (grDevice == NULL) {
+        return GR_ERROR_INVALID_HANDLE;
+    } else if (GET_OBJ_TYPE(grDevice) != GR_OBJ_TYPE_DEVICE) {
+        return GR_ERROR_INVALID_OBJECT_TYPE;
+    } else if (pCreateInfo == NULL || pCmdBuffer == NULL) {
+        return GR_ERROR_INVALID_POINTER;
+    } else if (pCreateInfo->flags != 0) {
+        return GR_ERROR_INVALID_FLAGS;
+    } else if (0) {
+        // TODO check queue type
+        return GR_ERROR_INVALID_QUEUE_TYPE;
+    }
+
+    grGetDeviceQueue(device, pCreateInfo->queueType, 0, (GR_QUEUE*)&grQueue);
+
+    RecycledCommandBuffer commandBuffer;
+    VkResult res = acquireVkCommandBuffer(grQueue, &commandBuffer);
+    if (res != VK_SUCCESS) {
+        return getGrResult(res);
+    }
 
     VkBuffer atomicCounterBuffer = VK_NULL_HANDLE;
     VkDescriptorSet atomicCounterSet = VK_NULL_HANDLE;
@@ -99,16 +398,37 @@ GR_RESULT GR_STDCALL grCreateCommandBuffer(
     GrCmdBuffer* grCmdBuffer = malloc(sizeof(GrCmdBuffer));
     *grCmdBuffer = (GrCmdBuffer) {
         .grObj = { GR_OBJ_TYPE_COMMAND_BUFFER, grDevice },
-        .commandPool = vkCommandPool,
-        .commandBuffer = vkCommandBuffer,
-        .timestampQueryPool = vkQueryPool,
+        .grQueue = grQueue,
+        .commandPool = commandBuffer.commandPool,
+        .commandBuffer = commandBuffer.commandBuffer,
+        .timestampQueryPool = VK_NULL_HANDLE, // Initialized below
+        .timestampQueryIndex = 0, // Initialized below
+        .timestampQueryRange = -1, // Initialized below
         .atomicCounterBuffer = atomicCounterBuffer,
         .atomicCounterSet = atomicCounterSet,
         .descriptorPoolCount = 0,
         .descriptorPools = NULL,
+        .descriptorSetCacheSize = 0,
+        .descriptorSetCacheCount = 0,
+        .descriptorSetCache = NULL,
+        .descriptorRangeCapacities = { 0 },
+        .descriptorRanges = { NULL },
+        .uploadBufferCount = 0,
+        .uploadBuffers = NULL,
+        .imageBarrierCapacity = 0,
+        .imageBarriers = NULL,
+        .bufferBarrierCapacity = 0,
+        .bufferBarriers = NULL,
+        .copyRegionCapacity = 0,
+        .copyRegions = NULL,
+        .cmdStream = NULL,
+        .isTranslating = false,
+        .translationResult = VK_SUCCESS,
+        .nextTranslation = NULL,
         .descriptorPoolIndex = 0,
     };
 
+    acquireTimestampQueries(grCmdBuffer);
     grCmdBufferResetState(grCmdBuffer);
 
     *pCmdBuffer = (GR_CMD_BUFFER)grCmdBuffer;
@@ -140,20 +460,20 @@ GR_RESULT GR_STDCALL grBeginCommandBuffer(
         vkUsageFlags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     }
 
-    const VkCommandBufferBeginInfo beginInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .pNext = NULL,
-        .flags = vkUsageFlags,
-        .pInheritanceInfo = NULL,
-    };
-
-    VkResult res = VKD.vkBeginCommandBuffer(grCmdBuffer->commandBuffer, &beginInfo);
-    if (res != VK_SUCCESS) {
-        LOGE("vkBeginCommandBuffer failed (%d)\n", res);
-        return getGrResult(res);
+    grCmdBufferWaitTranslation(grCmdBuffer);
+    grCmdBufferResetState(grCmdBuffer);
+    grCmdBuffer->usageFlags = vkUsageFlags;
+    // Translation to Vulkan is deferred to a worker thread at grEndCommandBuffer.
+    // Command statistics time the replay of each recorded command.
+    grCmdBuffer->isDeferred = grDevice->deferCommandBuffers || profilerIsCommandStatsEnabled();
+
+    if (!grCmdBuffer->isDeferred) {
+        VkResult res = beginVkCommandBuffer(grCmdBuffer);
+        if (res != VK_SUCCESS) {
+            return getGrResult(res);
+        }
     }
 
-    grCmdBufferResetState(grCmdBuffer);
     grCmdBuffer->isBuilding = true;
 
     return GR_SUCCESS;
@@ -175,11 +495,22 @@ GR_RESULT GR_STDCALL grEndCommandBuffer(
 
     GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
-    grCmdBufferEndRenderPass(grCmdBuffer);
+    if (grCmdBuffer->isDeferred && grDevice->deferCommandBuffers) {
+        grCmdBuffer->isBuilding = false;
+        queueTranslation(grCmdBuffer);
+        return GR_SUCCESS;
+    } else if (grCmdBuffer->isDeferred) {
+        translateCommandBuffer(grCmdBuffer);
+        if (grCmdBuffer->translationResult != VK_SUCCESS) {
+            return getGrResult(grCmdBuffer->translationResult);
+        }
+
+        grCmdBuffer->isBuilding = false;
+        return GR_SUCCESS;
+    }
 
-    VkResult res = VKD.vkEndCommandBuffer(grCmdBuffer->commandBuffer);
+    VkResult res = endVkCommandBuffer(grCmdBuffer);
     if (res != VK_SUCCESS) {
-        LOGE("vkEndCommandBuffer failed (%d)\n", res);
         return getGrResult(res);
     }
 
@@ -208,6 +539,8 @@ GR_RESULT GR_STDCALL grResetCommandBuffer(
         grWaitForFences((GR_DEVICE)grDevice, 1, (GR_FENCE*)&grCmdBuffer->submitFence, true, 10.0f);
     }
 
+    grCmdBufferWaitTranslation(grCmdBuffer);
+
     VkResult res = VKD.vkResetCommandBuffer(grCmdBuffer->commandBuffer, 0);
     if (res != VK_SUCCESS) {
         LOGE("vkResetCommandBuffer failed (%d)\n", res);
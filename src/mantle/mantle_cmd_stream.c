@@ -0,0 +1,240 @@
+#include "mantle_internal.h"
+
+static CmdStreamBlock* getStreamBlock(
+    GrCmdBuffer* grCmdBuffer,
+    size_t packetSize)
+{
+    CmdStreamBlock* block = grCmdBuffer->cmdStreamTail;
+    CmdStreamBlock* lastBlock = NULL;
+
+    if (block != NULL && block->usedSize + packetSize <= block->size) {
+        return block;
+    }
+
+    // Move on to the next block kept from a previous recording, or allocate a new one
+    block = block != NULL ? block->next : grCmdBuffer->cmdStream;
+    while (block != NULL) {
+        block->usedSize = 0;
+        grCmdBuffer->cmdStreamTail = block;
+
+        if (packetSize <= block->size) {
+            return block;
+        }
+
+        lastBlock = block;
+        block = block->next;
+    }
+
+    if (lastBlock == NULL) {
+        lastBlock = grCmdBuffer->cmdStreamTail;
+    }
+
+    size_t blockSize = MAX(packetSize, CMD_STREAM_BLOCK_SIZE);
+    block = malloc(sizeof(CmdStreamBlock) + blockSize);
+    *block = (CmdStreamBlock) {
+        .next = NULL,
+        .size = blockSize,
+        .usedSize = 0,
+    };
+
+    if (lastBlock != NULL) {
+        lastBlock->next = block;
+    } else {
+        grCmdBuffer->cmdStream = block;
+    }
+    grCmdBuffer->cmdStreamTail = block;
+
+    return block;
+}
+
+CmdPacket* grCmdBufferRecordPacket(
+    GrCmdBuffer* grCmdBuffer,
+    CmdOpcode opcode,
+    unsigned payloadSize)
+{
+    // Keep packets aligned for the argument union
+    size_t packetSize = sizeof(CmdPacket) + ALIGN(payloadSize, sizeof(CmdArg));
+    CmdStreamBlock* block = getStreamBlock(grCmdBuffer, packetSize);
+
+    CmdPacket* packet = (CmdPacket*)&block->data[block->usedSize];
+    packet->opcode = opcode;
+    packet->payloadSize = payloadSize;
+
+    block->usedSize += packetSize;
+    grCmdBuffer->cmdPacketCount++;
+
+    return packet;
+}
+
+static void replayPacket(
+    GrCmdBuffer* grCmdBuffer,
+    const CmdPacket* packet)
+{
+    GR_CMD_BUFFER cmdBuffer = (GR_CMD_BUFFER)grCmdBuffer;
+    const CmdArg* a = packet->args;
+    const void* payload = CMD_PACKET_PAYLOAD(packet);
+
+    switch (packet->opcode) {
+    case CMD_BIND_PIPELINE:
+        grCmdBindPipeline(cmdBuffer, a[0].u, a[1].p);
+        break;
+    case CMD_BIND_STATE_OBJECT:
+        grCmdBindStateObject(cmdBuffer, a[0].u, a[1].p);
+        break;
+    case CMD_BIND_DESCRIPTOR_SET:
+        grCmdBindDescriptorSet(cmdBuffer, a[0].u, a[1].u, a[2].p, a[3].u);
+        break;
+    case CMD_BIND_DYNAMIC_MEMORY_VIEW:
+        grCmdBindDynamicMemoryView(cmdBuffer, a[0].u, payload);
+        break;
+    case CMD_BIND_INDEX_DATA:
+        grCmdBindIndexData(cmdBuffer, a[0].p, a[1].u, a[2].u);
+        break;
+    case CMD_BIND_TARGETS: {
+        const GR_COLOR_TARGET_BIND_INFO* colorTargets = payload;
+        const GR_DEPTH_STENCIL_BIND_INFO* depthTarget =
+            a[1].u ? (const GR_DEPTH_STENCIL_BIND_INFO*)&colorTargets[a[0].u] : NULL;
+
+        grCmdBindTargets(cmdBuffer, a[0].u, colorTargets, depthTarget);
+    }   break;
+    case CMD_PREPARE_MEMORY_REGIONS:
+        grCmdPrepareMemoryRegions(cmdBuffer, a[0].u, payload);
+        break;
+    case CMD_PREPARE_IMAGES:
+        grCmdPrepareImages(cmdBuffer, a[0].u, payload);
+        break;
+    case CMD_DRAW:
+        grCmdDraw(cmdBuffer, a[0].u, a[1].u, a[2].u, a[3].u);
+        break;
+    case CMD_DRAW_INDEXED:
+        grCmdDrawIndexed(cmdBuffer, a[0].u, a[1].u, a[2].i, a[3].u, a[4].u);
+        break;
+    case CMD_DRAW_INDIRECT:
+        grCmdDrawIndirect(cmdBuffer, a[0].p, a[1].u);
+        break;
+    case CMD_DRAW_INDEXED_INDIRECT:
+        grCmdDrawIndexedIndirect(cmdBuffer, a[0].p, a[1].u);
+        break;
+    case CMD_DISPATCH:
+        grCmdDispatch(cmdBuffer, a[0].u, a[1].u, a[2].u);
+        break;
+    case CMD_DISPATCH_INDIRECT:
+        grCmdDispatchIndirect(cmdBuffer, a[0].p, a[1].u);
+        break;
+    case CMD_COPY_MEMORY:
+        grCmdCopyMemory(cmdBuffer, a[0].p, a[1].p, a[2].u, payload);
+        break;
+    case CMD_COPY_IMAGE:
+        grCmdCopyImage(cmdBuffer, a[0].p, a[1].p, a[2].u, payload);
+        break;
+    case CMD_COPY_MEMORY_TO_IMAGE:
+        grCmdCopyMemoryToImage(cmdBuffer, a[0].p, a[1].p, a[2].u, payload);
+        break;
+    case CMD_COPY_IMAGE_TO_MEMORY:
+        grCmdCopyImageToMemory(cmdBuffer, a[0].p, a[1].p, a[2].u, payload);
+        break;
+    case CMD_RESOLVE_IMAGE:
+        grCmdResolveImage(cmdBuffer, a[0].p, a[1].p, a[2].u, payload);
+        break;
+    case CMD_CLONE_IMAGE_DATA:
+        grCmdCloneImageData(cmdBuffer, a[0].p, a[1].u, a[2].p, a[3].u);
+        break;
+    case CMD_UPDATE_MEMORY:
+        grCmdUpdateMemory(cmdBuffer, a[0].p, a[1].u, a[2].u, payload);
+        break;
+    case CMD_FILL_MEMORY:
+        grCmdFillMemory(cmdBuffer, a[0].p, a[1].u, a[2].u, a[3].u);
+        break;
+    case CMD_CLEAR_COLOR_IMAGE: {
+        const GR_FLOAT color[4] = { a[1].f, a[2].f, a[3].f, a[4].f };
+
+        grCmdClearColorImage(cmdBuffer, a[0].p, color, a[5].u, payload);
+    }   break;
+    case CMD_CLEAR_COLOR_IMAGE_RAW: {
+        const GR_UINT32 color[4] = { a[1].u, a[2].u, a[3].u, a[4].u };
+
+        grCmdClearColorImageRaw(cmdBuffer, a[0].p, color, a[5].u, payload);
+    }   break;
+    case CMD_CLEAR_DEPTH_STENCIL:
+        grCmdClearDepthStencil(cmdBuffer, a[0].p, a[1].f, a[2].u, a[3].u, payload);
+        break;
+    case CMD_SET_EVENT:
+        grCmdSetEvent(cmdBuffer, a[0].p);
+        break;
+    case CMD_RESET_EVENT:
+        grCmdResetEvent(cmdBuffer, a[0].p);
+        break;
+    case CMD_BEGIN_QUERY:
+        grCmdBeginQuery(cmdBuffer, a[0].p, a[1].u, a[2].u);
+        break;
+    case CMD_END_QUERY:
+        grCmdEndQuery(cmdBuffer, a[0].p, a[1].u);
+        break;
+    case CMD_RESET_QUERY_POOL:
+        grCmdResetQueryPool(cmdBuffer, a[0].p, a[1].u, a[2].u);
+        break;
+    case CMD_WRITE_TIMESTAMP:
+        grCmdWriteTimestamp(cmdBuffer, a[0].u, a[1].p, a[2].u);
+        break;
+    case CMD_INIT_ATOMIC_COUNTERS:
+        grCmdInitAtomicCounters(cmdBuffer, a[0].u, a[1].u, a[2].u, payload);
+        break;
+    case CMD_SAVE_ATOMIC_COUNTERS:
+        grCmdSaveAtomicCounters(cmdBuffer, a[0].u, a[1].u, a[2].u, a[3].p, a[4].u);
+        break;
+    case CMD_OPCODE_COUNT:
+        LOGE("invalid opcode %d\n", packet->opcode);
+        break;
+    }
+}
+
+void grCmdBufferReplayPackets(
+    GrCmdBuffer* grCmdBuffer)
+{
+    if (grCmdBuffer->cmdStreamTail == NULL) {
+        return;
+    }
+
+    bool isProfiled = profilerIsCommandStatsEnabled();
+
+    // Blocks past the tail hold stale packets from a previous recording
+    for (CmdStreamBlock* block = grCmdBuffer->cmdStream; ; block = block->next) {
+        size_t offset = 0;
+
+        while (offset < block->usedSize) {
+            const CmdPacket* packet = (const CmdPacket*)&block->data[offset];
+
+            if (isProfiled) {
+                uint64_t startTicks = profilerGetCommandTicks();
+
+                replayPacket(grCmdBuffer, packet);
+                grCmdBuffer->cmdStats.commandCounts[packet->opcode]++;
+                grCmdBuffer->cmdStats.commandTicks[packet->opcode] +=
+                    profilerGetCommandTicks() - startTicks;
+            } else {
+                replayPacket(grCmdBuffer, packet);
+            }
+            offset += sizeof(CmdPacket) + ALIGN(packet->payloadSize, sizeof(CmdArg));
+        }
+
+        if (block == grCmdBuffer->cmdStreamTail) {
+            break;
+        }
+    }
+}
+
+void grCmdBufferFreeStream(
+    GrCmdBuffer* grCmdBuffer)
+{
+    CmdStreamBlock* block = grCmdBuffer->cmdStream;
+
+    while (block != NULL) {
+        CmdStreamBlock* nextBlock = block->next;
+
+        free(block);
+        block = nextBlock;
+    }
+
+    grCmdBuffer->cmdStream = NULL;
+    grCmdBuffer->cmdStreamTail = NULL;
+}
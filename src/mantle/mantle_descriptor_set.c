@@ -1,5 +1,14 @@
 #include "mantle_internal.h"
 
+// Generations are unique across sets so a recycled set address never matches a stale record
+static volatile LONG mGeneration = 0;
+
+inline static void bumpGeneration(
+    GrDescriptorSet* grDescriptorSet)
+{
+    grDescriptorSet->generation = (unsigned)InterlockedIncrement(&mGeneration);
+}
+
 inline static void releaseSlot(
     const GrDevice* grDevice,
     DescriptorSetSlot* slot)
@@ -30,10 +39,13 @@ GR_RESULT GR_STDCALL grCreateDescriptorSet(
     GrDescriptorSet* grDescriptorSet = malloc(sizeof(GrDescriptorSet));
     *grDescriptorSet = (GrDescriptorSet) {
         .grObj = { GR_OBJ_TYPE_DESCRIPTOR_SET, grDevice },
+        .generation = 0, // Initialized below
         .slotCount = pCreateInfo->slots,
         .slots = calloc(pCreateInfo->slots, sizeof(DescriptorSetSlot)),
     };
 
+    bumpGeneration(grDescriptorSet);
+
     *pDescriptorSet = (GR_DESCRIPTOR_SET)grDescriptorSet;
     return GR_SUCCESS;
 }
@@ -64,6 +76,8 @@ GR_VOID GR_STDCALL grAttachSamplerDescriptors(
     GrDescriptorSet* grDescriptorSet = (GrDescriptorSet*)descriptorSet;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grDescriptorSet);
 
+    bumpGeneration(grDescriptorSet);
+
     for (unsigned i = 0; i < slotCount; i++) {
         DescriptorSetSlot* slot = &grDescriptorSet->slots[startSlot + i];
         const GrSampler* grSampler = (GrSampler*)pSamplers[i];
@@ -93,6 +107,8 @@ GR_VOID GR_STDCALL grAttachImageViewDescriptors(
     GrDescriptorSet* grDescriptorSet = (GrDescriptorSet*)descriptorSet;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grDescriptorSet);
 
+    bumpGeneration(grDescriptorSet);
+
     for (unsigned i = 0; i < slotCount; i++) {
         DescriptorSetSlot* slot = &grDescriptorSet->slots[startSlot + i];
         const GR_IMAGE_VIEW_ATTACH_INFO* info = &pImageViews[i];
@@ -124,6 +140,8 @@ GR_VOID GR_STDCALL grAttachMemoryViewDescriptors(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grDescriptorSet);
     VkResult vkRes;
 
+    bumpGeneration(grDescriptorSet);
+
     for (unsigned i = 0; i < slotCount; i++) {
         DescriptorSetSlot* slot = &grDescriptorSet->slots[startSlot + i];
         const GR_MEMORY_VIEW_ATTACH_INFO* info = &pMemViews[i];
@@ -176,6 +194,8 @@ GR_VOID GR_STDCALL grAttachNestedDescriptors(
     GrDescriptorSet* grDescriptorSet = (GrDescriptorSet*)descriptorSet;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grDescriptorSet);
 
+    bumpGeneration(grDescriptorSet);
+
     for (unsigned i = 0; i < slotCount; i++) {
         DescriptorSetSlot* slot = &grDescriptorSet->slots[startSlot + i];
         const GR_DESCRIPTOR_SET_ATTACH_INFO* info = &pNestedDescriptorSets[i];
@@ -201,6 +221,8 @@ GR_VOID GR_STDCALL grClearDescriptorSetSlots(
     GrDescriptorSet* grDescriptorSet = (GrDescriptorSet*)descriptorSet;
     const GrDevice* grDevice = GET_OBJ_DEVICE(grDescriptorSet);
 
+    bumpGeneration(grDescriptorSet);
+
     for (unsigned i = 0; i < slotCount; i++) {
         DescriptorSetSlot* slot = &grDescriptorSet->slots[startSlot + i];
 
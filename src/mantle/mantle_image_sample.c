@@ -190,6 +190,7 @@ GR_RESULT GR_STDCALL grCreateImage(
         .image = vkImage,
         .imageType = createInfo.imageType,
         .extent = createInfo.extent,
+        .mipLevels = createInfo.mipLevels,
         .arrayLayers = createInfo.arrayLayers,
         .format = createInfo.format,
         .depthFormat = createInfo.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT ?
@@ -199,6 +200,9 @@ GR_RESULT GR_STDCALL grCreateImage(
         .usage = createInfo.usage,
         .multiplyCubeLayers = quirkHas(QUIRK_CUBEMAP_LAYER_DIV_6) && isCubic,
         .isOpaque = pCreateInfo->tiling == GR_OPTIMAL_TILING,
+        .isInitialImage = false,
+        .prevInitialImage = NULL,
+        .nextInitialImage = NULL,
     };
 
     // Mantle spec: "When [...] non-target images are bound to memory, they are assumed
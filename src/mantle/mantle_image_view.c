@@ -173,6 +173,9 @@ GR_RESULT GR_STDCALL grCreateColorTargetView(
     GrColorTargetView* grColorTargetView = malloc(sizeof(GrColorTargetView));
     *grColorTargetView = (GrColorTargetView) {
         .grObj = { GR_OBJ_TYPE_COLOR_TARGET_VIEW, grDevice },
+        .grImage = grImage,
+        .mipLevel = pCreateInfo->mipLevel,
+        .baseArrayLayer = pCreateInfo->baseArraySlice,
         .imageView = vkImageView,
         .extent = {
             MIP(grImage->extent.width, pCreateInfo->mipLevel),
@@ -263,6 +266,9 @@ GR_RESULT GR_STDCALL grCreateDepthStencilView(
     GrDepthStencilView* grDepthStencilView = malloc(sizeof(GrDepthStencilView));
     *grDepthStencilView = (GrDepthStencilView) {
         .grObj = { GR_OBJ_TYPE_DEPTH_STENCIL_VIEW, grDevice },
+        .grImage = grImage,
+        .mipLevel = pCreateInfo->mipLevel,
+        .baseArrayLayer = pCreateInfo->baseArraySlice,
         .imageView = vkImageView,
         .extent = {
             MIP(grImage->extent.width, pCreateInfo->mipLevel),
@@ -20,6 +20,94 @@ static char* getGrvkEngineName(
     return grvkEngineName;
 }
 
+static bool isStrideSpecializationEnabled()
+{
+    const char* envValue = getenv("GRVK_SPECIALIZE_STRIDES");
+
+    return envValue != NULL && strcmp(envValue, "1") == 0;
+}
+
+static bool isDeferredTranslationEnabled()
+{
+    const char* envValue = getenv("GRVK_DEFERRED_COMMAND_BUFFERS");
+
+    return envValue != NULL && strcmp(envValue, "1") == 0;
+}
+
+static bool isAsyncSubmitEnabled()
+{
+    const char* envValue = getenv("GRVK_ASYNC_SUBMIT");
+
+    return envValue != NULL && strcmp(envValue, "1") == 0;
+}
+
+static void initTimestampQueryPool(
+    GrDevice* grDevice)
+{
+    const VkQueryPoolCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = TIMESTAMP_QUERY_RANGE_COUNT * TIMESTAMP_QUERIES_PER_RANGE,
+        .pipelineStatistics = 0,
+    };
+
+    VkResult res = VKD.vkCreateQueryPool(grDevice->device, &createInfo, NULL,
+                                         &grDevice->timestampQueryPool);
+    if (res != VK_SUCCESS) {
+        // Command buffers will create private query pools
+        LOGW("vkCreateQueryPool failed (%d)\n", res);
+        return;
+    }
+
+    // Hand out lower ranges first
+    for (unsigned i = 0; i < TIMESTAMP_QUERY_RANGE_COUNT; i++) {
+        grDevice->freeTimestampQueryRanges[i] = TIMESTAMP_QUERY_RANGE_COUNT - 1 - i;
+    }
+    grDevice->freeTimestampQueryRangeCount = TIMESTAMP_QUERY_RANGE_COUNT;
+}
+
+static bool isDeviceExtensionSupported(
+    VkPhysicalDevice physicalDevice,
+    const char* extensionName)
+{
+    uint32_t extensionCount = 0;
+    bool isSupported = false;
+
+    vki.vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL);
+    VkExtensionProperties* extensions = malloc(extensionCount * sizeof(VkExtensionProperties));
+    vki.vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, extensions);
+
+    for (unsigned i = 0; i < extensionCount; i++) {
+        if (strcmp(extensions[i].extensionName, extensionName) == 0) {
+            isSupported = true;
+            break;
+        }
+    }
+
+    free(extensions);
+    return isSupported;
+}
+
+static uint32_t getMaxPushDescriptors(
+    VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProps = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR,
+        .pNext = NULL,
+        .maxPushDescriptors = 0,
+    };
+    VkPhysicalDeviceProperties2 props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &pushDescriptorProps,
+    };
+
+    vki.vkGetPhysicalDeviceProperties2(physicalDevice, &props);
+
+    return pushDescriptorProps.maxPushDescriptors;
+}
+
 static VkDescriptorSetLayout getAtomicCounterDescriptorSetLayout(
     const GrDevice* grDevice)
 {
@@ -217,6 +305,7 @@ GR_RESULT GR_STDCALL grInitAndEnumerateGpus(
          pAppInfo->apiVersion);
 
     quirkInit(pAppInfo);
+    profilerInit();
 
     if (pAllocCb != NULL) {
         LOGW("unhandled alloc callbacks\n");
@@ -664,6 +753,7 @@ GR_RESULT GR_STDCALL grCreateDevice(
         .pNext = &vulkan13DeviceFeatures,
         .samplerMirrorClampToEdge = VK_TRUE,
         .separateDepthStencilLayouts = VK_TRUE,
+        .timelineSemaphore = VK_TRUE,
     };
     VkPhysicalDeviceFeatures2 deviceFeatures = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
@@ -694,7 +784,17 @@ GR_RESULT GR_STDCALL grCreateDevice(
         VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME,
         VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME,
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+        NULL, // Optional extensions below
     };
+    unsigned deviceExtensionCount = COUNT_OF(deviceExtensions) - 1;
+
+    // Optional, small descriptor layouts are pushed when available
+    bool hasPushDescriptor = isDeviceExtensionSupported(grPhysicalGpu->physicalDevice,
+                                                        VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    if (hasPushDescriptor) {
+        deviceExtensions[deviceExtensionCount] = VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME;
+        deviceExtensionCount++;
+    }
 
     const VkDeviceCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
@@ -704,7 +804,7 @@ GR_RESULT GR_STDCALL grCreateDevice(
         .pQueueCreateInfos = queueCreateInfos,
         .enabledLayerCount = 0,
         .ppEnabledLayerNames = NULL,
-        .enabledExtensionCount = COUNT_OF(deviceExtensions),
+        .enabledExtensionCount = deviceExtensionCount,
         .ppEnabledExtensionNames = deviceExtensions,
         .pEnabledFeatures = NULL,
     };
@@ -715,7 +815,7 @@ GR_RESULT GR_STDCALL grCreateDevice(
 
         if (vkRes == VK_ERROR_EXTENSION_NOT_PRESENT) {
             LOGE("missing extension, make sure your Vulkan driver supports:\n");
-            for (unsigned i = 0; i < COUNT_OF(deviceExtensions); i++) {
+            for (unsigned i = 0; i < deviceExtensionCount; i++) {
                 LOGE("- %s\n", deviceExtensions[i]);
             }
         } else if (vkRes == VK_ERROR_FEATURE_NOT_PRESENT) {
@@ -769,9 +869,43 @@ GR_RESULT GR_STDCALL grCreateDevice(
         .computeAtomicCounterBuffer = VK_NULL_HANDLE, // Initialized below
         .computeAtomicCounterSet = VK_NULL_HANDLE, // Initialized below
         .grBorderColorPalette = NULL,
+        .updateTemplateSlotListLock = SRWLOCK_INIT,
+        .updateTemplateSlotListCount = 0,
+        .updateTemplateSlotLists = NULL,
+        .specializeStrides = isStrideSpecializationEnabled(),
+        .maxPushDescriptors = hasPushDescriptor ?
+                              getMaxPushDescriptors(grPhysicalGpu->physicalDevice) : 0,
+        .descriptorPoolLock = SRWLOCK_INIT,
+        .descriptorPoolCount = 0,
+        .descriptorPoolFootprint = 0,
+        .freeDescriptorPoolCount = 0,
+        .freeDescriptorPools = { { 0 } },
+        .descriptorSetUsage = 0,
+        .descriptorUsage = { 0 },
+        .descriptorPoolFailureCount = 0,
+        .descriptorSetDestroyCount = 0,
+        .stateObjectLock = SRWLOCK_INIT,
+        .stateObjectKeyBuckets = { NULL },
+        .stateObjectBuckets = { NULL },
+        .renderThreadId = GetCurrentThreadId(),
+        .deferCommandBuffers = isDeferredTranslationEnabled(),
+        .asyncSubmit = isAsyncSubmitEnabled(),
+        .translationThreadCount = 0,
+        .translationThreads = { NULL },
+        .translationLock = SRWLOCK_INIT,
+        .translationQueued = CONDITION_VARIABLE_INIT,
+        .translationDone = CONDITION_VARIABLE_INIT,
+        .translationQueueHead = NULL,
+        .translationQueueTail = NULL,
+        .stopTranslation = false,
+        .timestampQueryLock = SRWLOCK_INIT,
+        .timestampQueryPool = VK_NULL_HANDLE, // Initialized below
+        .freeTimestampQueryRangeCount = 0, // Initialized below
+        .freeTimestampQueryRanges = { 0 }, // Initialized below
     };
 
     memcpy(grDevice->memoryHeapMap, memoryHeapMap, memoryHeapCount * sizeof(uint32_t));
+    initTimestampQueryPool(grDevice);
     grDevice->atomicCounterSetLayout = getAtomicCounterDescriptorSetLayout(grDevice);
 
     if (universalQueueFamilyIndex != INVALID_QUEUE_INDEX) {
@@ -808,6 +942,10 @@ GR_RESULT GR_STDCALL grCreateDevice(
         grDevice->grDmaQueue = grQueueCreate(grDevice, dmaQueueFamilyIndex, dmaQueueIndex);
     }
 
+    if (grDevice->deferCommandBuffers) {
+        grDeviceStartTranslationThreads(grDevice);
+    }
+
     *pDevice = (GR_DEVICE)grDevice;
 
 bail:
@@ -818,6 +956,17 @@ bail:
     return res;
 }
 
+static void destroyRecycledCommandBuffers(
+    const GrDevice* grDevice,
+    GrQueue* grQueue)
+{
+    for (unsigned i = 0; i < grQueue->recycledCommandBufferCount; i++) {
+        VKD.vkDestroyCommandPool(grDevice->device,
+                                 grQueue->recycledCommandBuffers[i].commandPool, NULL);
+    }
+    grQueue->recycledCommandBufferCount = 0;
+}
+
 GR_RESULT GR_STDCALL grDestroyDevice(
     GR_DEVICE device)
 {
@@ -830,9 +979,24 @@ GR_RESULT GR_STDCALL grDestroyDevice(
         return GR_ERROR_INVALID_OBJECT_TYPE;
     }
 
+    grDeviceStopTranslationThreads(grDevice);
+    if (grDevice->grUniversalQueue) {
+        grQueueDestroySubmitThread(grDevice->grUniversalQueue);
+    }
+    if (grDevice->grComputeQueue) {
+        grQueueDestroySubmitThread(grDevice->grComputeQueue);
+    }
+    if (grDevice->grDmaQueue) {
+        grQueueDestroySubmitThread(grDevice->grDmaQueue);
+    }
+
     VKD.vkDestroyDescriptorSetLayout(grDevice->device, grDevice->atomicCounterSetLayout, NULL);
     if (grDevice->grUniversalQueue) {
         free(grDevice->grUniversalQueue->globalMemRefs);
+        free(grDevice->grUniversalQueue->prepCommandBuffers);
+        VKD.vkDestroySemaphore(grDevice->device, grDevice->grUniversalQueue->timelineSemaphore,
+                               NULL);
+        destroyRecycledCommandBuffers(grDevice, grDevice->grUniversalQueue);
         VKD.vkDestroyCommandPool(grDevice->device, grDevice->grUniversalQueue->commandPool, NULL);
 
         VKD.vkDestroyBuffer(grDevice->device, grDevice->universalAtomicCounterBuffer, NULL);
@@ -841,6 +1005,10 @@ GR_RESULT GR_STDCALL grDestroyDevice(
     }
     if (grDevice->grComputeQueue) {
         free(grDevice->grComputeQueue->globalMemRefs);
+        free(grDevice->grComputeQueue->prepCommandBuffers);
+        VKD.vkDestroySemaphore(grDevice->device, grDevice->grComputeQueue->timelineSemaphore,
+                               NULL);
+        destroyRecycledCommandBuffers(grDevice, grDevice->grComputeQueue);
         VKD.vkDestroyCommandPool(grDevice->device, grDevice->grComputeQueue->commandPool, NULL);
 
         VKD.vkDestroyBuffer(grDevice->device, grDevice->computeAtomicCounterBuffer, NULL);
@@ -849,9 +1017,44 @@ GR_RESULT GR_STDCALL grDestroyDevice(
     }
     if (grDevice->grDmaQueue) {
         free(grDevice->grDmaQueue->globalMemRefs);
+        free(grDevice->grDmaQueue->prepCommandBuffers);
+        VKD.vkDestroySemaphore(grDevice->device, grDevice->grDmaQueue->timelineSemaphore, NULL);
+        destroyRecycledCommandBuffers(grDevice, grDevice->grDmaQueue);
         VKD.vkDestroyCommandPool(grDevice->device, grDevice->grDmaQueue->commandPool, NULL);
     }
 
+    grDeviceDestroyDescriptorPools(grDevice);
+    VKD.vkDestroyQueryPool(grDevice->device, grDevice->timestampQueryPool, NULL);
+    profilerWriteReport();
+
+    // Drop templates still referenced by leaked pipelines
+    for (unsigned i = 0; i < grDevice->updateTemplateSlotListCount; i++) {
+        UpdateTemplateSlotList* slotList = grDevice->updateTemplateSlotLists[i];
+
+        for (unsigned j = 0; j < slotList->slotCount; j++) {
+            VKD.vkDestroyDescriptorUpdateTemplate(grDevice->device,
+                                                  slotList->slots[j].updateTemplate, NULL);
+            free(slotList->slots[j].bindings);
+        }
+        free(slotList->slots);
+        free(slotList->key);
+        free(slotList);
+    }
+    free(grDevice->updateTemplateSlotLists);
+
+    // Drop interned state objects the application didn't destroy
+    for (unsigned i = 0; i < STATE_OBJECT_BUCKET_COUNT; i++) {
+        StateObjectCacheEntry* entry = grDevice->stateObjectKeyBuckets[i];
+
+        while (entry != NULL) {
+            StateObjectCacheEntry* nextEntry = entry->nextByKey;
+
+            free(entry->key);
+            free(entry);
+            entry = nextEntry;
+        }
+    }
+
     if (!quirkHas(QUIRK_KEEP_VK_DEVICE)) {
         VKD.vkDestroyDevice(grDevice->device, NULL);
     }
@@ -10,6 +10,7 @@
 #include "mantle/mantleWsiWinExt.h"
 #include "logger.h"
 #include "mantle_object.h"
+#include "profiler.h"
 #include "quirk.h"
 #include "version.h"
 #include "vulkan_loader.h"
@@ -171,12 +172,20 @@ VkImageSubresourceRange getVkImageSubresourceRange(
     GR_IMAGE_SUBRESOURCE_RANGE subresourceRange,
     bool multiplyCubeLayers);
 
+uint64_t getHash(
+    const void* data,
+    size_t size);
+
 void grQueueAddInitialImage(
     GrImage* grImage);
 
 void grQueueRemoveInitialImage(
     GrImage* grImage);
 
+void grQueueRebindInitialImage(
+    GrImage* grImage,
+    GrGpuMemory* grGpuMemory);
+
 void grWsiDestroyImage(
     GrImage* grImage);
 
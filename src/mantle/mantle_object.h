@@ -15,7 +15,30 @@
 #define UNIVERSAL_ATOMIC_COUNTERS_COUNT (512)
 #define COMPUTE_ATOMIC_COUNTERS_COUNT   (1024)
 
-#define IMAGE_PREP_CMD_BUFFER_COUNT     (16)
+#define INITIAL_IMAGE_BUCKET_COUNT      (256) // Buckets indexing initial images by memory
+#define STATE_OBJECT_BUCKET_COUNT       (256) // Buckets indexing state objects by key and object
+#define MAX_RECYCLED_COMMAND_BUFFERS    (32) // Idle command pools kept around per queue
+#define SUBMISSION_RING_SIZE            (64) // Submissions queued for the submission thread
+#define MAX_SUBMISSION_BATCH            (16) // Submissions merged in one vkQueueSubmit2 call
+#define MAX_PENDING_SEMAPHORE_WAITS     (8) // Queue semaphore waits held for the next submission
+#define MAX_PENDING_SEMAPHORE_SIGNALS   (8) // Queue semaphore signals held for the next submission
+
+#define TIMESTAMP_QUERY_RANGE_COUNT     (256) // Command buffers sharing the device timestamp pool
+#define TIMESTAMP_QUERIES_PER_RANGE     (16) // Ring of timestamps written between result copies
+
+#define MAX_PIPELINE_VARIANTS           (8) // Stride-specialized variants per graphics pipeline
+
+#define MAX_PENDING_CLEARS              (GR_MAX_COLOR_TARGETS + 2) // Color, depth and stencil
+
+#define MAX_FREE_DESCRIPTOR_POOLS       (32) // Recycled descriptor pools kept around per device
+#define DESCRIPTOR_TYPE_COUNT           (VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT + 1)
+
+#define MAX_TRANSLATION_THREADS         (4) // Workers translating deferred command buffers
+#define CMD_STREAM_BLOCK_SIZE           (64 * 1024) // Minimum command stream allocation size
+#define MAX_CMD_ARGS                    (6) // Inline arguments per recorded command
+
+#define CMD_PACKET_PAYLOAD(packet) \
+    ((void*)((CmdPacket*)(packet) + 1))
 
 #define GET_OBJ_TYPE(obj) \
     (((GrBaseObject*)(obj))->grObjType)
@@ -58,12 +81,93 @@ typedef enum _DescriptorSetSlotType
     SLOT_TYPE_NESTED,
 } DescriptorSetSlotType;
 
+typedef enum _CopyType
+{
+    COPY_TYPE_NONE,
+    COPY_TYPE_BUFFER,
+    COPY_TYPE_IMAGE,
+    COPY_TYPE_BUFFER_TO_IMAGE,
+    COPY_TYPE_IMAGE_TO_BUFFER,
+} CopyType;
+
+typedef enum _CmdOpcode
+{
+    CMD_BIND_PIPELINE,
+    CMD_BIND_STATE_OBJECT,
+    CMD_BIND_DESCRIPTOR_SET,
+    CMD_BIND_DYNAMIC_MEMORY_VIEW,
+    CMD_BIND_INDEX_DATA,
+    CMD_BIND_TARGETS,
+    CMD_PREPARE_MEMORY_REGIONS,
+    CMD_PREPARE_IMAGES,
+    CMD_DRAW,
+    CMD_DRAW_INDEXED,
+    CMD_DRAW_INDIRECT,
+    CMD_DRAW_INDEXED_INDIRECT,
+    CMD_DISPATCH,
+    CMD_DISPATCH_INDIRECT,
+    CMD_COPY_MEMORY,
+    CMD_COPY_IMAGE,
+    CMD_COPY_MEMORY_TO_IMAGE,
+    CMD_COPY_IMAGE_TO_MEMORY,
+    CMD_RESOLVE_IMAGE,
+    CMD_CLONE_IMAGE_DATA,
+    CMD_UPDATE_MEMORY,
+    CMD_FILL_MEMORY,
+    CMD_CLEAR_COLOR_IMAGE,
+    CMD_CLEAR_COLOR_IMAGE_RAW,
+    CMD_CLEAR_DEPTH_STENCIL,
+    CMD_SET_EVENT,
+    CMD_RESET_EVENT,
+    CMD_BEGIN_QUERY,
+    CMD_END_QUERY,
+    CMD_RESET_QUERY_POOL,
+    CMD_WRITE_TIMESTAMP,
+    CMD_INIT_ATOMIC_COUNTERS,
+    CMD_SAVE_ATOMIC_COUNTERS,
+    CMD_OPCODE_COUNT,
+} CmdOpcode;
+
+typedef enum _CmdCounter
+{
+    CMD_COUNTER_DESCRIPTOR_UPDATE,
+    CMD_COUNTER_PIPELINE_BIND, // Includes lazy pipeline creation
+    CMD_COUNTER_RENDERING_BEGIN,
+    CMD_COUNTER_RENDERING_END,
+    // Tallies gathered while translating, not timed
+    CMD_COUNTER_DYNAMIC_STATE_EMITTED,
+    CMD_COUNTER_DYNAMIC_STATE_SKIPPED,
+    CMD_COUNTER_BARRIER_EMITTED,
+    CMD_COUNTER_BARRIER_DROPPED,
+    CMD_COUNTER_BARRIER_BATCH,
+    CMD_COUNTER_TIMESTAMP_COPY,
+    CMD_COUNTER_COPY_COMMAND,
+    CMD_COUNTER_COPY_BATCHED,
+    CMD_COUNTER_COPY_REGION_MERGED,
+    CMD_COUNTER_UPLOAD_RING_BYTES,
+    CMD_COUNTER_INLINE_UPDATE_BYTES,
+    CMD_COUNTER_COUNT,
+} CmdCounter;
+
+// CPU cost of translated commands, in performance counter ticks
+typedef struct _CmdStats
+{
+    unsigned commandCounts[CMD_OPCODE_COUNT];
+    uint64_t commandTicks[CMD_OPCODE_COUNT];
+    uint64_t counterCounts[CMD_COUNTER_COUNT];
+    uint64_t counterTicks[CMD_COUNTER_COUNT];
+} CmdStats;
+
+typedef struct _GrCmdBuffer GrCmdBuffer;
 typedef struct _GrColorBlendStateObject GrColorBlendStateObject;
+typedef struct _GrColorTargetView GrColorTargetView;
 typedef struct _GrDepthStencilStateObject GrDepthStencilStateObject;
+typedef struct _GrDepthStencilView GrDepthStencilView;
 typedef struct _GrDescriptorSet GrDescriptorSet;
 typedef struct _GrDevice GrDevice;
 typedef struct _GrFence GrFence;
 typedef struct _GrGpuMemory GrGpuMemory;
+typedef struct _GrImage GrImage;
 typedef struct _GrMsaaStateObject GrMsaaStateObject;
 typedef struct _GrPipeline GrPipeline;
 typedef struct _GrQueue GrQueue;
@@ -71,6 +175,42 @@ typedef struct _GrRasterStateObject GrRasterStateObject;
 typedef struct _GrShader GrShader;
 typedef struct _GrViewportStateObject GrViewportStateObject;
 
+typedef union _CmdArg
+{
+    uint64_t u;
+    int32_t i;
+    float f;
+    void* p;
+} CmdArg;
+
+// Recorded command, array arguments follow it in the stream
+typedef struct _CmdPacket
+{
+    CmdOpcode opcode;
+    unsigned payloadSize;
+    CmdArg args[MAX_CMD_ARGS];
+} CmdPacket;
+
+typedef struct _RecycledCommandBuffer
+{
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+} RecycledCommandBuffer;
+
+typedef struct _PrepCommandBuffer
+{
+    VkCommandBuffer commandBuffer;
+    uint64_t timelineValue; // Reusable once the queue timeline reaches it
+} PrepCommandBuffer;
+
+typedef struct _CmdStreamBlock
+{
+    struct _CmdStreamBlock* next;
+    size_t size;
+    size_t usedSize;
+    uint8_t data[];
+} CmdStreamBlock;
+
 typedef struct _DescriptorSetSlot
 {
     DescriptorSetSlotType type;
@@ -90,6 +230,43 @@ typedef struct _DescriptorSetSlot
     };
 } DescriptorSetSlot;
 
+typedef struct _DescriptorSetCacheEntry
+{
+    uint64_t hash;
+    unsigned payloadSize;
+    void* payload; // Layout handle followed by the slots read by the update templates
+    VkDescriptorSet descriptorSet;
+} DescriptorSetCacheEntry;
+
+typedef struct _DescriptorPool
+{
+    VkDescriptorPool descriptorPool;
+    uint32_t descriptorCounts[DESCRIPTOR_TYPE_COUNT]; // Capacity, indexed by type
+} DescriptorPool;
+
+typedef struct _UploadBuffer
+{
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint8_t* data;
+} UploadBuffer;
+
+typedef struct _TrackedDescriptorSet
+{
+    const GrDescriptorSet* grDescriptorSet;
+    unsigned generation;
+} TrackedDescriptorSet;
+
+// Slots read by one update template when they were last flattened
+typedef struct _DescriptorRange
+{
+    const DescriptorSetSlot* slot;
+    unsigned slotOffset; // Into the bound set
+    unsigned setCount;
+    TrackedDescriptorSet sets[MAX_PATH_DEPTH + 1]; // Bound set followed by the nested ones walked
+} DescriptorRange;
+
 typedef struct _BindPoint
 {
     uint32_t dirtyFlags;
@@ -99,8 +276,54 @@ typedef struct _BindPoint
     DescriptorSetSlot dynamicMemoryView;
     uint32_t dynamicOffset;
     VkDescriptorSet descriptorSet;
+    uint32_t strides[ILC_MAX_STRIDE_CONSTANTS];
+    uint32_t strideMask;
+    VkPipeline pipeline;
+    // Ranges making up the current descriptor set, one per template slot of rangeSlotLists
+    unsigned rangeCount;
+    const struct _UpdateTemplateSlotList* rangeSlotLists[GR_MAX_DESCRIPTOR_SETS];
+    LONG rangeSetDestroyCount; // Range sets may be gone once the device count moves past it
+    DescriptorSetSlot rangeDynamicMemoryView;
 } BindPoint;
 
+typedef struct _PendingClear
+{
+    const GrImage* grImage;
+    VkImageSubresourceRange subresourceRange; // Single mip level and aspect, no remaining count
+    VkClearValue clearValue;
+    VkImageLayout imageLayout; // Follows the transitions recorded since the clear
+} PendingClear;
+
+typedef struct _PendingTimestamp
+{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+} PendingTimestamp;
+
+typedef struct _DynamicState
+{
+    unsigned viewportCount;
+    VkViewport viewports[GR_MAX_VIEWPORTS];
+    unsigned scissorCount;
+    VkRect2D scissors[GR_MAX_VIEWPORTS];
+    VkPolygonMode polygonMode;
+    VkCullModeFlags cullMode;
+    VkFrontFace frontFace;
+    float depthBias[3]; // Constant factor, clamp and slope factor
+    VkBool32 depthTestEnable;
+    VkBool32 depthWriteEnable;
+    VkCompareOp depthCompareOp;
+    VkBool32 depthBoundsTestEnable;
+    VkBool32 stencilTestEnable;
+    VkStencilOpState stencilStates[2]; // Front and back
+    float depthBounds[2];
+    VkBool32 colorBlendEnables[GR_MAX_COLOR_TARGETS];
+    VkColorBlendEquationEXT colorBlendEquations[GR_MAX_COLOR_TARGETS];
+    float blendConstants[4];
+    VkSampleCountFlags rasterizationSamples;
+    VkSampleMask sampleMask;
+} DynamicState;
+
 typedef struct _PipelineCreateInfo
 {
     VkPipelineCreateFlags createFlags;
@@ -118,16 +341,34 @@ typedef struct _PipelineCreateInfo
     VkFormat stencilFormat;
 } PipelineCreateInfo;
 
+typedef struct _PipelineVariant {
+    uint32_t strides[ILC_MAX_STRIDE_CONSTANTS];
+    VkPipeline pipeline;
+} PipelineVariant;
+
 typedef struct _UpdateTemplateSlot {
     VkDescriptorUpdateTemplate updateTemplate;
     bool isDynamic;
     unsigned pathDepth;
     unsigned path[MAX_PATH_DEPTH];
+    unsigned slotIndex; // First slot read by the template
+    unsigned slotCount; // Number of slots read by the template
     unsigned strideCount;
     unsigned strideOffsets[MAX_STRIDES];
     unsigned strideSlotIndexes[MAX_STRIDES];
+    unsigned bindingCount;
+    uint32_t* bindings; // Written by the template, one descriptor each
 } UpdateTemplateSlot;
 
+typedef struct _UpdateTemplateSlotList {
+    unsigned refCount;
+    uint64_t hash;
+    unsigned keySize;
+    uint32_t* key;
+    unsigned slotCount;
+    UpdateTemplateSlot* slots;
+} UpdateTemplateSlotList;
+
 // Base object
 typedef struct _GrBaseObject {
     GrObjectType grObjType;
@@ -140,6 +381,17 @@ typedef struct _GrObject {
     GrGpuMemory* grGpuMemory;
 } GrObject;
 
+typedef struct _StateObjectCacheEntry
+{
+    GrObject* grObject;
+    unsigned refCount;
+    uint64_t hash;
+    unsigned keySize;
+    void* key; // Relevant create info bytes
+    struct _StateObjectCacheEntry* nextByKey;
+    struct _StateObjectCacheEntry* nextByObject;
+} StateObjectCacheEntry;
+
 typedef struct _GrBorderColorPalette {
     GrObject grObj;
     unsigned size;
@@ -148,18 +400,72 @@ typedef struct _GrBorderColorPalette {
 
 typedef struct _GrCmdBuffer {
     GrObject grObj;
+    GrQueue* grQueue;
     VkCommandPool commandPool;
     VkCommandBuffer commandBuffer;
     VkQueryPool timestampQueryPool;
+    uint32_t timestampQueryIndex;
+    int timestampQueryRange; // -1 if the query pool is private
     VkBuffer atomicCounterBuffer;
     VkDescriptorSet atomicCounterSet;
     // Resource tracking
     unsigned descriptorPoolCount;
-    VkDescriptorPool* descriptorPools;
+    DescriptorPool* descriptorPools; // Borrowed from the device until reset
+    unsigned descriptorSetCacheSize;
+    unsigned descriptorSetCacheCount;
+    DescriptorSetCacheEntry* descriptorSetCache;
+    unsigned descriptorRangeCapacities[2];
+    DescriptorRange* descriptorRanges[2]; // Indexed by bind point
+    unsigned uploadBufferCount;
+    UploadBuffer* uploadBuffers; // Reused once the command buffer is reset
+    unsigned imageBarrierCapacity;
+    VkImageMemoryBarrier2* imageBarriers;
+    unsigned bufferBarrierCapacity;
+    VkBufferMemoryBarrier2* bufferBarriers;
+    unsigned copyRegionCapacity; // In bytes
+    uint8_t* copyRegions;
+    // Deferred translation
+    CmdStreamBlock* cmdStream; // Blocks are kept around across resets
+    volatile bool isTranslating;
+    VkResult translationResult;
+    GrCmdBuffer* nextTranslation;
     // NOTE: grCmdBufferResetState resets everything past that point
     bool isBuilding;
     bool isRendering;
+    bool isDeferred; // Commands are recorded to the stream instead of being translated
+    VkCommandBufferUsageFlags usageFlags;
+    CmdStreamBlock* cmdStreamTail;
+    unsigned cmdPacketCount;
+    // Barriers waiting for the next command that depends on them
+    unsigned imageBarrierCount;
+    unsigned bufferBarrierCount;
+    unsigned emittedBarrierCount;
+    unsigned droppedBarrierCount;
+    unsigned barrierBatchCount;
+    // Copies sharing a source and destination, recorded at the next non-copy command
+    CopyType copyType;
+    VkBuffer copySrcBuffer;
+    VkImage copySrcImage;
+    VkBuffer copyDstBuffer;
+    VkImage copyDstImage;
+    unsigned copyRegionCount;
+    unsigned copyCommandCount;
+    unsigned batchedCopyCount;
+    unsigned mergedCopyRegionCount;
+    // Atomic counter ranges accessed by transfers since shaders last had access to them
+    bool hasAtomicCounterTransfers;
+    unsigned atomicCounterReadStart;
+    unsigned atomicCounterReadEnd;
+    unsigned atomicCounterWriteStart;
+    unsigned atomicCounterWriteEnd;
     int descriptorPoolIndex;
+    unsigned descriptorSetUsage;
+    unsigned descriptorUsage[DESCRIPTOR_TYPE_COUNT]; // Indexed by type
+    unsigned descriptorPoolFailureCount;
+    unsigned uploadBufferIndex;
+    VkDeviceSize uploadBufferOffset;
+    VkDeviceSize uploadedSize;
+    VkDeviceSize inlineUpdateSize;
     GrFence* submitFence;
     // Graphics and compute bind points
     BindPoint bindPoints[2];
@@ -169,6 +475,10 @@ typedef struct _GrCmdBuffer {
     GrMsaaStateObject* grMsaaState;
     GrDepthStencilStateObject* grDepthStencilState;
     GrColorBlendStateObject* grColorBlendState;
+    uint32_t dynamicStateMask; // Shadow values that were actually recorded
+    DynamicState dynamicState;
+    unsigned emittedDynamicStateCount;
+    unsigned skippedDynamicStateCount;
     // Render pass
     VkRenderingAttachmentInfo colorAttachments[GR_MAX_COLOR_TARGETS];
     bool hasDepth;
@@ -178,6 +488,16 @@ typedef struct _GrCmdBuffer {
     VkFormat depthFormat;
     VkFormat stencilFormat;
     VkExtent3D minExtent;
+    const GrColorTargetView* grColorTargetViews[GR_MAX_COLOR_TARGETS];
+    const GrDepthStencilView* grDepthStencilView;
+    // Clears waiting to be folded into the next render pass
+    unsigned pendingClearCount;
+    PendingClear pendingClears[MAX_PENDING_CLEARS];
+    // Timestamps whose results are copied out in batches
+    unsigned timestampCount;
+    PendingTimestamp pendingTimestamps[TIMESTAMP_QUERIES_PER_RANGE];
+    unsigned timestampCopyCount;
+    CmdStats cmdStats; // Only gathered when command statistics are enabled
 } GrCmdBuffer;
 
 typedef struct _GrColorBlendStateObject {
@@ -189,6 +509,9 @@ typedef struct _GrColorBlendStateObject {
 
 typedef struct _GrColorTargetView {
     GrObject grObj;
+    const GrImage* grImage;
+    unsigned mipLevel;
+    unsigned baseArrayLayer;
     VkImageView imageView;
     VkExtent3D extent;
     VkFormat format;
@@ -209,6 +532,9 @@ typedef struct _GrDepthStencilStateObject {
 
 typedef struct _GrDepthStencilView {
     GrObject grObj;
+    const GrImage* grImage;
+    unsigned mipLevel;
+    unsigned baseArrayLayer;
     VkImageView imageView;
     VkExtent3D extent;
     VkFormat depthFormat;
@@ -219,6 +545,7 @@ typedef struct _GrDepthStencilView {
 
 typedef struct _GrDescriptorSet {
     GrObject grObj;
+    unsigned generation; // Bumped on every modification
     unsigned slotCount;
     DescriptorSetSlot* slots;
 } GrDescriptorSet;
@@ -244,6 +571,38 @@ typedef struct _GrDevice {
     VkDescriptorPool computeAtomicCounterPool;
     VkDescriptorSet computeAtomicCounterSet;
     GrBorderColorPalette* grBorderColorPalette;
+    SRWLOCK updateTemplateSlotListLock;
+    unsigned updateTemplateSlotListCount;
+    UpdateTemplateSlotList** updateTemplateSlotLists;
+    bool specializeStrides;
+    uint32_t maxPushDescriptors; // Zero if VK_KHR_push_descriptor is unsupported
+    SRWLOCK descriptorPoolLock;
+    unsigned descriptorPoolCount; // Live pools, recycled or not
+    uint64_t descriptorPoolFootprint; // Descriptors across live pools
+    unsigned freeDescriptorPoolCount;
+    DescriptorPool freeDescriptorPools[MAX_FREE_DESCRIPTOR_POOLS];
+    uint64_t descriptorSetUsage; // Decayed over time to follow the workload
+    uint64_t descriptorUsage[DESCRIPTOR_TYPE_COUNT]; // Indexed by type
+    unsigned descriptorPoolFailureCount;
+    volatile LONG descriptorSetDestroyCount;
+    SRWLOCK stateObjectLock;
+    StateObjectCacheEntry* stateObjectKeyBuckets[STATE_OBJECT_BUCKET_COUNT]; // Indexed by hash
+    StateObjectCacheEntry* stateObjectBuckets[STATE_OBJECT_BUCKET_COUNT]; // Indexed by object
+    DWORD renderThreadId; // Thread that created the device
+    bool deferCommandBuffers;
+    bool asyncSubmit;
+    unsigned translationThreadCount;
+    HANDLE translationThreads[MAX_TRANSLATION_THREADS];
+    SRWLOCK translationLock;
+    CONDITION_VARIABLE translationQueued;
+    CONDITION_VARIABLE translationDone;
+    GrCmdBuffer* translationQueueHead;
+    GrCmdBuffer* translationQueueTail;
+    bool stopTranslation;
+    SRWLOCK timestampQueryLock;
+    VkQueryPool timestampQueryPool; // Split in ranges handed out to command buffers
+    unsigned freeTimestampQueryRangeCount;
+    unsigned freeTimestampQueryRanges[TIMESTAMP_QUERY_RANGE_COUNT];
 } GrDevice;
 
 typedef struct _GrEvent {
@@ -253,8 +612,8 @@ typedef struct _GrEvent {
 
 typedef struct _GrFence {
     GrObject grObj;
-    VkFence fence;
-    bool submitted;
+    GrQueue* grQueue; // NULL until submitted
+    uint64_t timelineValue; // Signaled on the queue timeline semaphore
 } GrFence;
 
 typedef struct _GrGpuMemory {
@@ -269,6 +628,7 @@ typedef struct _GrImage {
     VkImage image;
     VkImageType imageType;
     VkExtent3D extent;
+    unsigned mipLevels;
     unsigned arrayLayers;
     VkFormat format;
     VkFormat depthFormat;
@@ -276,6 +636,9 @@ typedef struct _GrImage {
     VkImageUsageFlags usage;
     bool multiplyCubeLayers;
     bool isOpaque;
+    bool isInitialImage; // Pending transition to the initial data transfer state
+    struct _GrImage* prevInitialImage;
+    struct _GrImage* nextInitialImage;
 } GrImage;
 
 typedef struct _GrImageView {
@@ -301,19 +664,28 @@ typedef struct _GrPipeline {
     GrShader* grShaderRefs[MAX_STAGE_COUNT];
     PipelineCreateInfo* createInfo;
     bool hasTessellation;
-    VkPipeline pipeline;
+    VkPipeline pipeline; // Lazily compiled for graphics, guarded by variantLock
     VkPipelineLayout pipelineLayout;
     unsigned stageCount;
     VkDescriptorSetLayout descriptorSetLayout;
     unsigned dynamicOffsetCount;
-    unsigned updateTemplateSlotCounts[GR_MAX_DESCRIPTOR_SETS];
-    UpdateTemplateSlot* updateTemplateSlots[GR_MAX_DESCRIPTOR_SETS];
+    bool usePushDescriptors;
+    uint32_t descriptorCounts[DESCRIPTOR_TYPE_COUNT]; // Indexed by type
+    UpdateTemplateSlotList* updateTemplateSlotLists[GR_MAX_DESCRIPTOR_SETS];
+    uint32_t strideMask;
+    SRWLOCK variantLock;
+    unsigned variantCount;
+    PipelineVariant variants[MAX_PIPELINE_VARIANTS];
 } GrPipeline;
 
 typedef struct _GrQueueSemaphore {
     GrObject grObj;
-    VkSemaphore semaphore;
-    unsigned currentCount;
+    VkSemaphore semaphore; // Timeline, counts signals
+    unsigned initialCount;
+    SRWLOCK signalLock;
+    uint64_t signalCount; // Guarded by signalLock
+    GrQueue* signalQueue; // Queue of the last signal, guarded by signalLock
+    volatile LONG64 waitCount;
 } GrQueueSemaphore;
 
 typedef struct _GrRasterStateObject {
@@ -340,6 +712,8 @@ typedef struct _GrShader {
     unsigned inputCount;
     IlcInput* inputs;
     char* name;
+    uint64_t translateTime;
+    uint64_t moduleTime;
 } GrShader;
 
 typedef struct _GrQueryPool {
@@ -348,6 +722,17 @@ typedef struct _GrQueryPool {
     VkQueryType queryType;
 } GrQueryPool;
 
+typedef struct _QueueSubmission {
+    unsigned commandBufferCount;
+    unsigned commandBufferCapacity;
+    VkCommandBufferSubmitInfo* commandBufferInfos; // Kept across ring wraps
+    unsigned waitSemaphoreCount;
+    VkSemaphoreSubmitInfo waitSemaphoreInfos[MAX_PENDING_SEMAPHORE_WAITS + 1]; // Plus a binary wait
+    unsigned signalSemaphoreCount;
+    // Held signals, plus a binary signal and the queue timeline
+    VkSemaphoreSubmitInfo signalSemaphoreInfos[MAX_PENDING_SEMAPHORE_SIGNALS + 2];
+} QueueSubmission;
+
 typedef struct _GrQueue {
     GrObject grObj; // FIXME base object?
     VkQueue queue;
@@ -356,8 +741,36 @@ typedef struct _GrQueue {
     unsigned globalMemRefCount;
     GR_MEMORY_REF* globalMemRefs;
     VkCommandPool commandPool;
-    VkCommandBuffer commandBuffers[IMAGE_PREP_CMD_BUFFER_COUNT];
-    unsigned commandBufferIndex;
+    unsigned prepCommandBufferCount;
+    PrepCommandBuffer* prepCommandBuffers;
+    SRWLOCK recycleLock;
+    unsigned recycledCommandBufferCount;
+    RecycledCommandBuffer recycledCommandBuffers[MAX_RECYCLED_COMMAND_BUFFERS];
+    VkSemaphore timelineSemaphore; // Backs the fences submitted to this queue
+    uint64_t timelineValue; // Last value handed to a fence
+    SRWLOCK pendingLock; // Guards the held waits and signals and the submission producer side
+    unsigned pendingWaitCount;
+    VkSemaphoreSubmitInfo pendingWaits[MAX_PENDING_SEMAPHORE_WAITS]; // For the next submission
+    unsigned pendingSignalCount;
+    VkSemaphoreSubmitInfo pendingSignals[MAX_PENDING_SEMAPHORE_SIGNALS]; // Follow held waits
+    QueueSubmission submission; // Reused by immediate submissions
+    bool asyncSubmit;
+    HANDLE submitThread;
+    HANDLE submitQueued; // Auto-reset event waking up the submission thread
+    volatile LONG submitThreadIdle;
+    volatile bool stopSubmission;
+    volatile LONG submitHead; // Next submission to hand to Vulkan, written by the thread
+    volatile LONG submitTail; // Next free ring slot, written by the application
+    SRWLOCK submitLock; // Only used to wait for the thread to catch up
+    CONDITION_VARIABLE submitDone;
+    volatile LONG submitResult; // First failed submission, reported by the next call
+    QueueSubmission submissions[SUBMISSION_RING_SIZE];
+    unsigned submitCallCount;
+    uint64_t submitCallTime; // Time spent in grQueueSubmit, in microseconds
+    uint64_t maxSubmitCallTime;
+    unsigned batchCount;
+    unsigned batchedSubmissionCount;
+    unsigned maxBatchSize;
 } GrQueue;
 
 typedef struct _GrViewportStateObject {
@@ -376,17 +789,94 @@ typedef struct _GrWsiWinDisplay {
 void grCmdBufferEndRenderPass(
     GrCmdBuffer* grCmdBuffer);
 
+void grCmdBufferFlushTimestamps(
+    GrCmdBuffer* grCmdBuffer);
+
+void grCmdBufferSyncAtomicCounters(
+    GrCmdBuffer* grCmdBuffer);
+
+CmdPacket* grCmdBufferRecordPacket(
+    GrCmdBuffer* grCmdBuffer,
+    CmdOpcode opcode,
+    unsigned payloadSize);
+
+void grCmdBufferReplayPackets(
+    GrCmdBuffer* grCmdBuffer);
+
+void grCmdBufferFreeStream(
+    GrCmdBuffer* grCmdBuffer);
+
+void grCmdBufferWaitTranslation(
+    GrCmdBuffer* grCmdBuffer);
+
+void grDeviceStartTranslationThreads(
+    GrDevice* grDevice);
+
+void grDeviceStopTranslationThreads(
+    GrDevice* grDevice);
+
 void grCmdBufferResetState(
     GrCmdBuffer* grCmdBuffer);
 
+void grCmdBufferRecycle(
+    GrCmdBuffer* grCmdBuffer);
+
+void grCmdBufferReleaseDescriptorPools(
+    GrCmdBuffer* grCmdBuffer);
+
+void grDeviceDestroyDescriptorPools(
+    GrDevice* grDevice);
+
+bool grDeviceReleaseStateObject(
+    GrDevice* grDevice,
+    GrObject* grObject);
+
+void grDeviceReleaseUpdateTemplateSlotList(
+    GrDevice* grDevice,
+    UpdateTemplateSlotList* slotList);
+
 VkPipeline grPipelineGetVkPipeline(
-    const GrPipeline* grPipeline,
+    GrPipeline* grPipeline,
     VkFormat depthFormat,
     VkFormat stencilFormat);
 
+VkPipeline grPipelineGetSpecializedVkPipeline(
+    GrPipeline* grPipeline,
+    VkFormat depthFormat,
+    VkFormat stencilFormat,
+    const uint32_t* strides);
+
 GrQueue* grQueueCreate(
     GrDevice* grDevice,
     uint32_t queueFamilyIndex,
     uint32_t queueIndex);
 
+void grQueueDestroySubmitThread(
+    GrQueue* grQueue);
+
+VkResult grQueueSubmitVkCommandBuffers(
+    GrQueue* grQueue,
+    unsigned commandBufferCount,
+    const VkCommandBuffer* commandBuffers,
+    VkSemaphore waitSemaphore,
+    VkSemaphore signalSemaphore,
+    uint64_t signalValue,
+    uint64_t timelineValue);
+
+VkResult grQueueAddSemaphoreWait(
+    GrQueue* grQueue,
+    VkSemaphore semaphore,
+    uint64_t value);
+
+VkResult grQueueAddSemaphoreSignal(
+    GrQueue* grQueue,
+    VkSemaphore semaphore,
+    uint64_t value);
+
+VkResult grQueueFlushSemaphoreSignals(
+    GrQueue* grQueue);
+
+void grQueueFlushSubmissions(
+    GrQueue* grQueue);
+
 #endif // GR_OBJECT_H_
@@ -12,21 +12,37 @@ GR_RESULT GR_STDCALL grDestroyObject(
         return GR_ERROR_INVALID_HANDLE;
     }
 
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grObject);
+    GrDevice* grDevice = GET_OBJ_DEVICE(grObject);
 
     switch (grObject->grObjType) {
     case GR_OBJ_TYPE_COMMAND_BUFFER: {
         GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)grObject;
 
-        VKD.vkDestroyCommandPool(grDevice->device, grCmdBuffer->commandPool, NULL);
-        VKD.vkDestroyQueryPool(grDevice->device, grCmdBuffer->timestampQueryPool, NULL);
-        for (unsigned i = 0; i < grCmdBuffer->descriptorPoolCount; i++) {
-            VKD.vkDestroyDescriptorPool(grDevice->device, grCmdBuffer->descriptorPools[i], NULL);
-        }
+        grCmdBufferWaitTranslation(grCmdBuffer);
+        grCmdBufferRecycle(grCmdBuffer);
+        grCmdBufferReleaseDescriptorPools(grCmdBuffer);
         free(grCmdBuffer->descriptorPools);
+        for (unsigned i = 0; i < grCmdBuffer->descriptorSetCacheSize; i++) {
+            free(grCmdBuffer->descriptorSetCache[i].payload);
+        }
+        free(grCmdBuffer->descriptorSetCache);
+        for (unsigned i = 0; i < COUNT_OF(grCmdBuffer->descriptorRanges); i++) {
+            free(grCmdBuffer->descriptorRanges[i]);
+        }
+        for (unsigned i = 0; i < grCmdBuffer->uploadBufferCount; i++) {
+            VKD.vkDestroyBuffer(grDevice->device, grCmdBuffer->uploadBuffers[i].buffer, NULL);
+            VKD.vkFreeMemory(grDevice->device, grCmdBuffer->uploadBuffers[i].memory, NULL);
+        }
+        free(grCmdBuffer->uploadBuffers);
+        free(grCmdBuffer->imageBarriers);
+        free(grCmdBuffer->bufferBarriers);
+        free(grCmdBuffer->copyRegions);
+        grCmdBufferFreeStream(grCmdBuffer);
     }   break;
     case GR_OBJ_TYPE_COLOR_BLEND_STATE_OBJECT:
-        // Nothing to do
+        if (!grDeviceReleaseStateObject(grDevice, grObject)) {
+            return GR_SUCCESS;
+        }
         break;
     case GR_OBJ_TYPE_COLOR_TARGET_VIEW: {
         GrColorTargetView* grColorTargetView = (GrColorTargetView*)grObject;
@@ -34,7 +50,9 @@ GR_RESULT GR_STDCALL grDestroyObject(
         VKD.vkDestroyImageView(grDevice->device, grColorTargetView->imageView, NULL);
     }   break;
     case GR_OBJ_TYPE_DEPTH_STENCIL_STATE_OBJECT:
-        // Nothing to do
+        if (!grDeviceReleaseStateObject(grDevice, grObject)) {
+            return GR_SUCCESS;
+        }
         break;
     case GR_OBJ_TYPE_DEPTH_STENCIL_VIEW: {
         GrDepthStencilView* grDepthStencilView = (GrDepthStencilView*)grObject;
@@ -46,17 +64,18 @@ GR_RESULT GR_STDCALL grDestroyObject(
 
         grClearDescriptorSetSlots(grDescriptorSet, 0, grDescriptorSet->slotCount);
         free(grDescriptorSet->slots);
+
+        // Bind points may still track this set, stop them from reading it
+        InterlockedIncrement(&grDevice->descriptorSetDestroyCount);
     }   break;
     case GR_OBJ_TYPE_EVENT: {
         GrEvent* grEvent = (GrEvent*)grObject;
 
         VKD.vkDestroyEvent(grDevice->device, grEvent->event, NULL);
     }   break;
-    case GR_OBJ_TYPE_FENCE: {
-        GrFence* grFence = (GrFence*)grObject;
-
-        VKD.vkDestroyFence(grDevice->device, grFence->fence, NULL);
-    }   break;
+    case GR_OBJ_TYPE_FENCE:
+        // Nothing to do, fences are values of the queue timeline semaphores
+        break;
     case GR_OBJ_TYPE_IMAGE: {
         GrImage* grImage = (GrImage*)grObject;
 
@@ -71,7 +90,9 @@ GR_RESULT GR_STDCALL grDestroyObject(
         VKD.vkDestroyImageView(grDevice->device, grImageView->imageView, NULL);
     }   break;
     case GR_OBJ_TYPE_MSAA_STATE_OBJECT:
-        // Nothing to do
+        if (!grDeviceReleaseStateObject(grDevice, grObject)) {
+            return GR_SUCCESS;
+        }
         break;
     case GR_OBJ_TYPE_PIPELINE: {
         GrPipeline* grPipeline = (GrPipeline*)grObject;
@@ -84,23 +105,28 @@ GR_RESULT GR_STDCALL grDestroyObject(
 
         free(grPipeline->createInfo);
         VKD.vkDestroyPipeline(grDevice->device, grPipeline->pipeline, NULL);
+        for (unsigned i = 0; i < grPipeline->variantCount; i++) {
+            VKD.vkDestroyPipeline(grDevice->device, grPipeline->variants[i].pipeline, NULL);
+        }
         VKD.vkDestroyPipelineLayout(grDevice->device, grPipeline->pipelineLayout, NULL);
         VKD.vkDestroyDescriptorSetLayout(grDevice->device, grPipeline->descriptorSetLayout, NULL);
         for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-            for (unsigned j = 0; j < grPipeline->updateTemplateSlotCounts[i]; j++) {
-                UpdateTemplateSlot* slot = &grPipeline->updateTemplateSlots[i][j];
-                VKD.vkDestroyDescriptorUpdateTemplate(grDevice->device, slot->updateTemplate, NULL);
-            }
-            free(grPipeline->updateTemplateSlots[i]);
+            grDeviceReleaseUpdateTemplateSlotList(grDevice, grPipeline->updateTemplateSlotLists[i]);
         }
     }   break;
     case GR_OBJ_TYPE_QUEUE_SEMAPHORE: {
         GrQueueSemaphore* grQueueSemaphore = (GrQueueSemaphore*)grObject;
 
+        // Don't leave a held signal pointing at the destroyed semaphore
+        if (grQueueSemaphore->signalQueue != NULL) {
+            grQueueFlushSemaphoreSignals(grQueueSemaphore->signalQueue);
+        }
         VKD.vkDestroySemaphore(grDevice->device, grQueueSemaphore->semaphore, NULL);
     }   break;
     case GR_OBJ_TYPE_RASTER_STATE_OBJECT:
-        // Nothing to do
+        if (!grDeviceReleaseStateObject(grDevice, grObject)) {
+            return GR_SUCCESS;
+        }
         break;
     case GR_OBJ_TYPE_SAMPLER: {
         GrSampler* grSampler = (GrSampler*)grObject;
@@ -127,6 +153,10 @@ GR_RESULT GR_STDCALL grDestroyObject(
     case GR_OBJ_TYPE_VIEWPORT_STATE_OBJECT: {
         GrViewportStateObject* grViewportStateObject = (GrViewportStateObject*)grObject;
 
+        if (!grDeviceReleaseStateObject(grDevice, grObject)) {
+            return GR_SUCCESS;
+        }
+
         free(grViewportStateObject->viewports);
         free(grViewportStateObject->scissors);
     }   break;
@@ -323,7 +353,12 @@ GR_RESULT GR_STDCALL grBindObjectMemory(
         }
     }
 
-    grObject->grGpuMemory = grGpuMemory;
+    if (GET_OBJ_TYPE(grObject) == GR_OBJ_TYPE_IMAGE) {
+        // Initial images are indexed by the memory they're bound to
+        grQueueRebindInitialImage((GrImage*)grObject, grGpuMemory);
+    } else {
+        grObject->grGpuMemory = grGpuMemory;
+    }
 
     return getGrResult(vkRes);
 }
@@ -130,25 +130,12 @@ GR_RESULT GR_STDCALL grCreateFence(
 
     // TODO validate parameters
 
-    VkFence vkFence = VK_NULL_HANDLE;
-
-    const VkFenceCreateInfo createInfo = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-    };
-
-    VkResult res = VKD.vkCreateFence(grDevice->device, &createInfo, NULL, &vkFence);
-    if (res != VK_SUCCESS) {
-        LOGE("vkCreateFence failed (%d)\n", res);
-        return getGrResult(res);
-    }
-
+    // The timeline semaphore and value are assigned on submission
     GrFence* grFence = malloc(sizeof(GrFence));
     *grFence = (GrFence) {
         .grObj = { GR_OBJ_TYPE_FENCE, grDevice },
-        .fence = vkFence,
-        .submitted = false,
+        .grQueue = NULL,
+        .timelineValue = 0,
     };
 
     *pFence = (GR_FENCE)grFence;
@@ -170,16 +157,19 @@ GR_RESULT GR_STDCALL grGetFenceStatus(
 
     GrDevice* grDevice = GET_OBJ_DEVICE(grFence);
 
-    if (!grFence->submitted) {
+    if (grFence->grQueue == NULL) {
         return GR_ERROR_UNAVAILABLE;
     }
 
-    VkResult res = VKD.vkGetFenceStatus(grDevice->device, grFence->fence);
-    if (res != VK_SUCCESS && res != VK_NOT_READY) {
-        LOGE("vkGetFenceStatus failed (%d)\n", res);
+    uint64_t value = 0;
+    VkResult res = VKD.vkGetSemaphoreCounterValue(grDevice->device,
+                                                  grFence->grQueue->timelineSemaphore, &value);
+    if (res != VK_SUCCESS) {
+        LOGE("vkGetSemaphoreCounterValue failed (%d)\n", res);
+        return getGrResult(res);
     }
 
-    return getGrResult(res);
+    return value >= grFence->timelineValue ? GR_SUCCESS : GR_NOT_READY;
 }
 
 GR_RESULT GR_STDCALL grWaitForFences(
@@ -203,28 +193,51 @@ GR_RESULT GR_STDCALL grWaitForFences(
         return GR_ERROR_INVALID_POINTER;
     }
 
-    STACK_ARRAY(VkFence, vkFences, 1024, fenceCount);
+    // Fences submitted to the same queue collapse to a single semaphore wait,
+    // there's one timeline semaphore for each of the universal, compute and DMA queues
+    VkSemaphore vkSemaphores[3];
+    uint64_t values[3];
+    unsigned semaphoreCount = 0;
 
     for (unsigned i = 0; i < fenceCount; i++) {
         GrFence* grFence = (GrFence*)pFences[i];
+        unsigned j;
 
         if (grFence == NULL) {
-            STACK_ARRAY_FINISH(vkFences);
             return GR_ERROR_INVALID_HANDLE;
-        } else if (!grFence->submitted) {
-            STACK_ARRAY_FINISH(vkFences);
+        } else if (grFence->grQueue == NULL) {
             return GR_ERROR_UNAVAILABLE;
         }
 
-        vkFences[i] = grFence->fence;
-    }
+        for (j = 0; j < semaphoreCount; j++) {
+            if (vkSemaphores[j] == grFence->grQueue->timelineSemaphore) {
+                break;
+            }
+        }
 
-    VkResult res = VKD.vkWaitForFences(grDevice->device, fenceCount, vkFences, waitAll, vkTimeout);
+        if (j == semaphoreCount) {
+            vkSemaphores[j] = grFence->grQueue->timelineSemaphore;
+            values[j] = grFence->timelineValue;
+            semaphoreCount++;
+        } else if (waitAll) {
+            values[j] = MAX(values[j], grFence->timelineValue);
+        } else {
+            values[j] = MIN(values[j], grFence->timelineValue);
+        }
+    }
 
-    STACK_ARRAY_FINISH(vkFences);
+    const VkSemaphoreWaitInfo waitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .pNext = NULL,
+        .flags = waitAll ? 0 : VK_SEMAPHORE_WAIT_ANY_BIT,
+        .semaphoreCount = semaphoreCount,
+        .pSemaphores = vkSemaphores,
+        .pValues = values,
+    };
 
+    VkResult res = VKD.vkWaitSemaphores(grDevice->device, &waitInfo, vkTimeout);
     if (res != VK_SUCCESS && res != VK_TIMEOUT) {
-        LOGE("vkWaitForFences failed (%d)\n", res);
+        LOGE("vkWaitSemaphores failed (%d)\n", res);
     }
 
     return getGrResult(res);
@@ -255,9 +268,16 @@ GR_RESULT GR_STDCALL grCreateQueueSemaphore(
         LOGW("unhandled shareable semaphore flag\n");
     }
 
+    // The timeline value counts signals, the n-th wait waits for the n-th signal
+    const VkSemaphoreTypeCreateInfo typeCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .pNext = NULL,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = pCreateInfo->initialCount,
+    };
     const VkSemaphoreCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-        .pNext = NULL,
+        .pNext = &typeCreateInfo,
         .flags = 0,
     };
 
@@ -271,7 +291,11 @@ GR_RESULT GR_STDCALL grCreateQueueSemaphore(
     *grQueueSemaphore = (GrQueueSemaphore) {
         .grObj = { GR_OBJ_TYPE_QUEUE_SEMAPHORE, grDevice },
         .semaphore = vkSemaphore,
-        .currentCount = pCreateInfo->initialCount,
+        .initialCount = pCreateInfo->initialCount,
+        .signalLock = SRWLOCK_INIT,
+        .signalCount = pCreateInfo->initialCount,
+        .signalQueue = NULL,
+        .waitCount = 0,
     };
 
     *pSemaphore = (GR_QUEUE_SEMAPHORE)grQueueSemaphore;
@@ -293,26 +317,31 @@ GR_RESULT GR_STDCALL grSignalQueueSemaphore(
         return GR_ERROR_INVALID_OBJECT_TYPE;
     }
 
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
-
-    const VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = NULL,
-        .waitSemaphoreCount = 0,
-        .pWaitSemaphores = NULL,
-        .pWaitDstStageMask = NULL,
-        .commandBufferCount = 0,
-        .pCommandBuffers = NULL,
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &grQueueSemaphore->semaphore,
-    };
-
-    AcquireSRWLockExclusive(&grQueue->queueLock);
-    VkResult res = VKD.vkQueueSubmit(grQueue->queue, 1, &submitInfo, VK_NULL_HANDLE);
-    ReleaseSRWLockExclusive(&grQueue->queueLock);
-    if (res != VK_SUCCESS) {
-        LOGE("vkQueueSubmit failed (%d)\n", res);
+    VkResult res = VK_SUCCESS;
+
+    AcquireSRWLockExclusive(&grQueueSemaphore->signalLock);
+    uint64_t value = grQueueSemaphore->signalCount + 1;
+    if (grQueueSemaphore->signalQueue != NULL && grQueueSemaphore->signalQueue != grQueue) {
+        // Values are handed out in call order but queues execute independently. Make this
+        // signal wait for the previous one from the other queue so the timeline never goes back.
+        res = grQueueFlushSemaphoreSignals(grQueueSemaphore->signalQueue);
+        VkResult waitRes = grQueueAddSemaphoreWait(grQueue, grQueueSemaphore->semaphore,
+                                                   value - 1);
+        res = res != VK_SUCCESS ? res : waitRes;
+    }
+    grQueueSemaphore->signalCount = value;
+    grQueueSemaphore->signalQueue = grQueue;
+
+    // Held for the next submission on this queue, along with pending waits. Waits on this
+    // semaphore flush it first, so deferring it can't deadlock another queue.
+    VkResult signalRes = grQueueAddSemaphoreSignal(grQueue, grQueueSemaphore->semaphore, value);
+    res = res != VK_SUCCESS ? res : signalRes;
+    if (value <= (uint64_t)InterlockedCompareExchange64(&grQueueSemaphore->waitCount, 0, 0)) {
+        // Already waited on
+        signalRes = grQueueFlushSemaphoreSignals(grQueue);
+        res = res != VK_SUCCESS ? res : signalRes;
     }
+    ReleaseSRWLockExclusive(&grQueueSemaphore->signalLock);
 
     return getGrResult(res);
 }
@@ -331,34 +360,24 @@ GR_RESULT GR_STDCALL grWaitQueueSemaphore(
         return GR_ERROR_INVALID_OBJECT_TYPE;
     }
 
-    if (grQueueSemaphore->currentCount > 0) {
-        // Mantle spec: "At creation time, an application can specify an initial semaphore count
-        // that is equivalent to signaling the semaphore that many times."
-        grQueueSemaphore->currentCount--;
+    // Mantle spec: "At creation time, an application can specify an initial semaphore count
+    // that is equivalent to signaling the semaphore that many times."
+    uint64_t value = InterlockedIncrement64(&grQueueSemaphore->waitCount);
+    if (value <= grQueueSemaphore->initialCount) {
         return GR_SUCCESS;
     }
 
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
-
-    VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    const VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = NULL,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &grQueueSemaphore->semaphore,
-        .pWaitDstStageMask = &stageMask,
-        .commandBufferCount = 0,
-        .pCommandBuffers = NULL,
-        .signalSemaphoreCount = 0,
-        .pSignalSemaphores = NULL,
-    };
-
-    AcquireSRWLockExclusive(&grQueue->queueLock);
-    VkResult res = VKD.vkQueueSubmit(grQueue->queue, 1, &submitInfo, VK_NULL_HANDLE);
-    ReleaseSRWLockExclusive(&grQueue->queueLock);
-    if (res != VK_SUCCESS) {
-        LOGE("vkQueueSubmit failed (%d)\n", res);
+    // The matching signal may be held on its queue, submit it before depending on it
+    VkResult res = VK_SUCCESS;
+    AcquireSRWLockExclusive(&grQueueSemaphore->signalLock);
+    if (grQueueSemaphore->signalQueue != NULL) {
+        res = grQueueFlushSemaphoreSignals(grQueueSemaphore->signalQueue);
     }
+    ReleaseSRWLockExclusive(&grQueueSemaphore->signalLock);
+
+    // Attached to the next submission on this queue
+    VkResult waitRes = grQueueAddSemaphoreWait(grQueue, grQueueSemaphore->semaphore, value);
+    res = res != VK_SUCCESS ? res : waitRes;
 
     return getGrResult(res);
 }
@@ -1,21 +1,63 @@
 #include "mantle_internal.h"
 
-// Keep track of images that need transition to the initial data transfer state
-static unsigned mInitialImageCount = 0;
-static GrImage** mInitialImages = NULL;
+// Keep track of images that need transition to the initial data transfer state,
+// chained in buckets indexed by the memory they're bound to
+static volatile LONG mInitialImageCount = 0;
+static GrImage* mInitialImageBuckets[INITIAL_IMAGE_BUCKET_COUNT] = { NULL };
 static SRWLOCK mInitialImagesLock = SRWLOCK_INIT;
 
+static PrepCommandBuffer* getPrepCommandBuffer(
+    GrQueue* grQueue)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
+    uint64_t completedValue = 0;
+
+    VKD.vkGetSemaphoreCounterValue(grDevice->device, grQueue->timelineSemaphore,
+                                   &completedValue);
+
+    for (unsigned i = 0; i < grQueue->prepCommandBufferCount; i++) {
+        if (grQueue->prepCommandBuffers[i].timelineValue <= completedValue) {
+            return &grQueue->prepCommandBuffers[i];
+        }
+    }
+
+    // All command buffers are in flight, allocate a new one
+    const VkCommandBufferAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = grQueue->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer vkCommandBuffer = VK_NULL_HANDLE;
+    VkResult res = VKD.vkAllocateCommandBuffers(grDevice->device, &allocateInfo,
+                                                &vkCommandBuffer);
+    if (res != VK_SUCCESS) {
+        LOGE("vkAllocateCommandBuffers failed (%d)\n", res);
+        return NULL;
+    }
+
+    grQueue->prepCommandBufferCount++;
+    grQueue->prepCommandBuffers = realloc(grQueue->prepCommandBuffers,
+                                          grQueue->prepCommandBufferCount *
+                                          sizeof(PrepCommandBuffer));
+    grQueue->prepCommandBuffers[grQueue->prepCommandBufferCount - 1] = (PrepCommandBuffer) {
+        .commandBuffer = vkCommandBuffer,
+        .timelineValue = 0,
+    };
+
+    return &grQueue->prepCommandBuffers[grQueue->prepCommandBufferCount - 1];
+}
+
 static void prepareImagesForDataTransfer(
     GrQueue* grQueue,
+    VkCommandBuffer vkCommandBuffer,
     unsigned imageCount,
     GrImage** images)
 {
     const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
 
-    // Pick the next command buffer (and hope it's not pending...)
-    VkCommandBuffer vkCommandBuffer = grQueue->commandBuffers[grQueue->commandBufferIndex];
-    grQueue->commandBufferIndex = (grQueue->commandBufferIndex + 1) % IMAGE_PREP_CMD_BUFFER_COUNT;
-
     const VkCommandBufferBeginInfo beginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .pNext = NULL,
@@ -54,70 +96,213 @@ static void prepareImagesForDataTransfer(
     VKD.vkEndCommandBuffer(vkCommandBuffer);
 
     STACK_ARRAY_FINISH(barriers);
+}
 
-    const VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = NULL,
-        .waitSemaphoreCount = 0,
-        .pWaitSemaphores = NULL,
-        .pWaitDstStageMask = NULL,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &vkCommandBuffer,
-        .signalSemaphoreCount = 0,
-        .pSignalSemaphores = NULL,
-    };
+static GrImage** getInitialImageBucket(
+    const GrGpuMemory* grGpuMemory)
+{
+    uint64_t hash = getHash(&grGpuMemory, sizeof(grGpuMemory));
 
-    AcquireSRWLockExclusive(&grQueue->queueLock);
-    VKD.vkQueueSubmit(grQueue->queue, 1, &submitInfo, VK_NULL_HANDLE);
-    ReleaseSRWLockExclusive(&grQueue->queueLock);
+    return &mInitialImageBuckets[hash % INITIAL_IMAGE_BUCKET_COUNT];
 }
 
-static void checkMemoryReferences(
+static void linkInitialImage(
+    GrImage* grImage)
+{
+    GrImage** bucket = getInitialImageBucket(grImage->grObj.grGpuMemory);
+
+    grImage->prevInitialImage = NULL;
+    grImage->nextInitialImage = *bucket;
+    if (*bucket != NULL) {
+        (*bucket)->prevInitialImage = grImage;
+    }
+    *bucket = grImage;
+}
+
+static void unlinkInitialImage(
+    GrImage* grImage)
+{
+    if (grImage->prevInitialImage != NULL) {
+        grImage->prevInitialImage->nextInitialImage = grImage->nextInitialImage;
+    } else {
+        *getInitialImageBucket(grImage->grObj.grGpuMemory) = grImage->nextInitialImage;
+    }
+    if (grImage->nextInitialImage != NULL) {
+        grImage->nextInitialImage->prevInitialImage = grImage->prevInitialImage;
+    }
+
+    grImage->prevInitialImage = NULL;
+    grImage->nextInitialImage = NULL;
+}
+
+static unsigned takeInitialImages(
+    const GrGpuMemory* grGpuMemory,
+    GrImage** images)
+{
+    unsigned imageCount = 0;
+
+    if (grGpuMemory == NULL) {
+        return 0;
+    }
+
+    GrImage* grImage = *getInitialImageBucket(grGpuMemory);
+    while (grImage != NULL) {
+        GrImage* nextImage = grImage->nextInitialImage;
+
+        if (grImage->grObj.grGpuMemory == grGpuMemory) {
+            unlinkInitialImage(grImage);
+            grImage->isInitialImage = false;
+            InterlockedDecrement(&mInitialImageCount);
+
+            images[imageCount] = grImage;
+            imageCount++;
+        }
+
+        grImage = nextImage;
+    }
+
+    return imageCount;
+}
+
+// Returns the command buffer to submit ahead of the application command buffers, if any
+static PrepCommandBuffer* checkMemoryReferences(
     GrQueue* grQueue,
     unsigned memRefCount,
     const GR_MEMORY_REF* memRefs)
 {
+    PrepCommandBuffer* prepCommandBuffer = NULL;
+
+    // Skip the lock once every initial image has been transitioned
+    if (InterlockedCompareExchange(&mInitialImageCount, 0, 0) == 0) {
+        return NULL;
+    }
+
     AcquireSRWLockExclusive(&mInitialImagesLock);
 
     unsigned imageCount = 0;
     STACK_ARRAY(GrImage*, images, 1024, mInitialImageCount);
 
-    // Check if the initial images are bound to the memory references of this submission
-    for (unsigned i = 0; i < mInitialImageCount; i++) {
-        GrImage* grImage = mInitialImages[i];
-        bool found = false;
+    // Look up the initial images bound to the memory references of this submission
+    for (unsigned i = 0; mInitialImageCount > 0 && i < memRefCount; i++) {
+        imageCount += takeInitialImages((GrGpuMemory*)memRefs[i].mem, &images[imageCount]);
+    }
+    for (unsigned i = 0; mInitialImageCount > 0 && i < grQueue->globalMemRefCount; i++) {
+        imageCount += takeInitialImages((GrGpuMemory*)grQueue->globalMemRefs[i].mem,
+                                        &images[imageCount]);
+    }
 
-        for (unsigned j = 0; !found && j < memRefCount; j++) {
-            if (grImage->grObj.grGpuMemory == memRefs[j].mem) {
-                found = true;
-            }
-        }
-        for (unsigned j = 0; !found && j < grQueue->globalMemRefCount; j++) {
-            if (grImage->grObj.grGpuMemory == grQueue->globalMemRefs[j].mem) {
-                found = true;
+    ReleaseSRWLockExclusive(&mInitialImagesLock);
+
+    // Perform data transfer state transition
+    if (imageCount > 0) {
+        prepCommandBuffer = getPrepCommandBuffer(grQueue);
+
+        if (prepCommandBuffer != NULL) {
+            prepareImagesForDataTransfer(grQueue, prepCommandBuffer->commandBuffer,
+                                         imageCount, images);
+        } else {
+            // Try again on the next submission
+            for (unsigned i = 0; i < imageCount; i++) {
+                grQueueAddInitialImage(images[i]);
             }
         }
+    }
 
-        if (found) {
-            images[imageCount] = grImage;
-            imageCount++;
+    STACK_ARRAY_FINISH(images);
 
-            // Remove initial image entry (skip realloc)
-            mInitialImageCount--;
-            memmove(&mInitialImages[i], &mInitialImages[i + 1],
-                    (mInitialImageCount - i) * sizeof(GrImage*));
-            i--;
-        }
+    return prepCommandBuffer;
+}
+
+static VkSemaphoreSubmitInfo getSemaphoreSubmitInfo(
+    VkSemaphore semaphore,
+    uint64_t value)
+{
+    return (VkSemaphoreSubmitInfo) {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .pNext = NULL,
+        .semaphore = semaphore,
+        .value = value,
+        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        .deviceIndex = 0,
+    };
+}
+
+static VkSubmitInfo2 getSubmitInfo(
+    const QueueSubmission* submission)
+{
+    return (VkSubmitInfo2) {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+        .pNext = NULL,
+        .flags = 0,
+        .waitSemaphoreInfoCount = submission->waitSemaphoreCount,
+        .pWaitSemaphoreInfos = submission->waitSemaphoreInfos,
+        .commandBufferInfoCount = submission->commandBufferCount,
+        .pCommandBufferInfos = submission->commandBufferInfos,
+        .signalSemaphoreInfoCount = submission->signalSemaphoreCount,
+        .pSignalSemaphoreInfos = submission->signalSemaphoreInfos,
+    };
+}
+
+static void submitBatch(
+    GrQueue* grQueue,
+    unsigned head,
+    unsigned count)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
+    VkSubmitInfo2 submitInfos[MAX_SUBMISSION_BATCH];
+
+    for (unsigned i = 0; i < count; i++) {
+        submitInfos[i] = getSubmitInfo(&grQueue->submissions[(head + i) % SUBMISSION_RING_SIZE]);
     }
 
-    ReleaseSRWLockExclusive(&mInitialImagesLock);
+    AcquireSRWLockExclusive(&grQueue->queueLock);
+    VkResult res = VKD.vkQueueSubmit2(grQueue->queue, count, submitInfos, VK_NULL_HANDLE);
+    ReleaseSRWLockExclusive(&grQueue->queueLock);
 
-    // Perform data transfer state transition
-    if (imageCount > 0) {
-        prepareImagesForDataTransfer(grQueue, imageCount, images);
+    if (res != VK_SUCCESS) {
+        LOGE("vkQueueSubmit2 failed (%d)\n", res);
+        InterlockedCompareExchange(&grQueue->submitResult, res, VK_SUCCESS);
     }
+}
 
-    STACK_ARRAY_FINISH(images);
+static DWORD WINAPI submitThreadProc(
+    LPVOID param)
+{
+    GrQueue* grQueue = (GrQueue*)param;
+
+    for (;;) {
+        unsigned head = grQueue->submitHead;
+        unsigned tail = InterlockedCompareExchange(&grQueue->submitTail, 0, 0);
+
+        if (head == tail) {
+            // Announce the thread is going idle before looking at the ring again,
+            // so that the application either sees it idle or we see the new submission
+            InterlockedExchange(&grQueue->submitThreadIdle, 1);
+            if (head == (unsigned)InterlockedCompareExchange(&grQueue->submitTail, 0, 0)) {
+                if (grQueue->stopSubmission) {
+                    break;
+                }
+
+                WaitForSingleObject(grQueue->submitQueued, INFINITE);
+            }
+            InterlockedExchange(&grQueue->submitThreadIdle, 0);
+            continue;
+        }
+
+        unsigned count = MIN(tail - head, MAX_SUBMISSION_BATCH);
+
+        submitBatch(grQueue, head, count);
+
+        AcquireSRWLockExclusive(&grQueue->submitLock);
+        InterlockedExchange(&grQueue->submitHead, head + count);
+        grQueue->batchCount++;
+        grQueue->batchedSubmissionCount += count;
+        grQueue->maxBatchSize = MAX(grQueue->maxBatchSize, count);
+        ReleaseSRWLockExclusive(&grQueue->submitLock);
+        WakeAllConditionVariable(&grQueue->submitDone);
+    }
+
+    return 0;
 }
 
 // Exported functions
@@ -129,12 +314,11 @@ GrQueue* grQueueCreate(
 {
     VkQueue vkQueue = VK_NULL_HANDLE;
     VkCommandPool vkCommandPool = VK_NULL_HANDLE;
-    VkCommandBuffer commandBuffers[IMAGE_PREP_CMD_BUFFER_COUNT];
 
     VKD.vkGetDeviceQueue(grDevice->device, queueFamilyIndex, queueIndex, &vkQueue);
 
-    // Allocate a pool of command buffers.
-    // This will be used to transition images to the initial data transfer state
+    // Create a pool for the command buffers transitioning images to the initial data transfer
+    // state. They're allocated on demand and submitted ahead of the application command buffers
     const VkCommandPoolCreateInfo poolCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .pNext = NULL,
@@ -144,15 +328,21 @@ GrQueue* grQueueCreate(
 
     VKD.vkCreateCommandPool(grDevice->device, &poolCreateInfo, NULL, &vkCommandPool);
 
-    const VkCommandBufferAllocateInfo allocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    // Fences are values signaled on a timeline semaphore
+    const VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
         .pNext = NULL,
-        .commandPool = vkCommandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = COUNT_OF(commandBuffers),
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0,
+    };
+    const VkSemaphoreCreateInfo semaphoreCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &semaphoreTypeCreateInfo,
+        .flags = 0,
     };
 
-    VKD.vkAllocateCommandBuffers(grDevice->device, &allocateInfo, commandBuffers);
+    VkSemaphore vkTimelineSemaphore = VK_NULL_HANDLE;
+    VKD.vkCreateSemaphore(grDevice->device, &semaphoreCreateInfo, NULL, &vkTimelineSemaphore);
 
     GrQueue* grQueue = malloc(sizeof(GrQueue));
     *grQueue = (GrQueue) {
@@ -163,22 +353,297 @@ GrQueue* grQueueCreate(
         .globalMemRefCount = 0,
         .globalMemRefs = NULL,
         .commandPool = vkCommandPool,
-        .commandBuffers = { 0 }, // Initialized below
-        .commandBufferIndex = 0,
+        .prepCommandBufferCount = 0,
+        .prepCommandBuffers = NULL,
+        .recycleLock = SRWLOCK_INIT,
+        .recycledCommandBufferCount = 0,
+        .recycledCommandBuffers = { { 0 } },
+        .timelineSemaphore = vkTimelineSemaphore,
+        .timelineValue = 0,
+        .pendingLock = SRWLOCK_INIT,
+        .pendingWaitCount = 0,
+        .pendingWaits = { { 0 } },
+        .pendingSignalCount = 0,
+        .pendingSignals = { { 0 } },
+        .submission = { 0 },
+        .asyncSubmit = grDevice->asyncSubmit,
+        .submitThread = NULL, // Initialized below
+        .submitQueued = NULL, // Initialized below
+        .submitThreadIdle = 0,
+        .stopSubmission = false,
+        .submitHead = 0,
+        .submitTail = 0,
+        .submitLock = SRWLOCK_INIT,
+        .submitDone = CONDITION_VARIABLE_INIT,
+        .submitResult = VK_SUCCESS,
+        .submissions = { { 0 } },
+        .submitCallCount = 0,
+        .submitCallTime = 0,
+        .maxSubmitCallTime = 0,
+        .batchCount = 0,
+        .batchedSubmissionCount = 0,
+        .maxBatchSize = 0,
     };
-    memcpy(grQueue->commandBuffers, commandBuffers, sizeof(grQueue->commandBuffers));
+
+    if (grQueue->asyncSubmit) {
+        grQueue->submitQueued = CreateEventW(NULL, FALSE, FALSE, NULL);
+        grQueue->submitThread = grQueue->submitQueued != NULL ?
+                                CreateThread(NULL, 0, submitThreadProc, grQueue, 0, NULL) : NULL;
+
+        if (grQueue->submitThread == NULL) {
+            LOGW("failed to start submission thread (%lu), submitting immediately\n",
+                 GetLastError());
+            if (grQueue->submitQueued != NULL) {
+                CloseHandle(grQueue->submitQueued);
+                grQueue->submitQueued = NULL;
+            }
+            grQueue->asyncSubmit = false;
+        }
+    }
 
     return grQueue;
 }
 
+void grQueueDestroySubmitThread(
+    GrQueue* grQueue)
+{
+    if (grQueue->submitCallCount > 0) {
+        LOGV("queue %p: %u submissions, %.1f us average, %llu us max\n", grQueue,
+             grQueue->submitCallCount,
+             (double)grQueue->submitCallTime / grQueue->submitCallCount,
+             grQueue->maxSubmitCallTime);
+    }
+
+    free(grQueue->submission.commandBufferInfos);
+
+    if (!grQueue->asyncSubmit) {
+        return;
+    }
+
+    // Let the thread drain the ring before it exits
+    grQueue->stopSubmission = true;
+    SetEvent(grQueue->submitQueued);
+    WaitForSingleObject(grQueue->submitThread, INFINITE);
+    CloseHandle(grQueue->submitThread);
+    CloseHandle(grQueue->submitQueued);
+    grQueue->asyncSubmit = false;
+
+    for (unsigned i = 0; i < SUBMISSION_RING_SIZE; i++) {
+        free(grQueue->submissions[i].commandBufferInfos);
+    }
+
+    if (grQueue->batchCount > 0) {
+        LOGV("queue %p: %u batches, %.1f submissions per batch, %u max\n", grQueue,
+             grQueue->batchCount, (double)grQueue->batchedSubmissionCount / grQueue->batchCount,
+             grQueue->maxBatchSize);
+    }
+}
+
+// Called with pendingLock held
+static VkResult submitVkCommandBuffers(
+    GrQueue* grQueue,
+    unsigned commandBufferCount,
+    const VkCommandBuffer* commandBuffers,
+    VkSemaphore waitSemaphore,
+    VkSemaphore signalSemaphore,
+    uint64_t signalValue,
+    uint64_t timelineValue)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
+    QueueSubmission* submission = &grQueue->submission;
+    unsigned tail = grQueue->submitTail;
+
+    if (grQueue->asyncSubmit) {
+        if (tail - (unsigned)grQueue->submitHead >= SUBMISSION_RING_SIZE) {
+            AcquireSRWLockExclusive(&grQueue->submitLock);
+            while (tail - (unsigned)grQueue->submitHead >= SUBMISSION_RING_SIZE) {
+                SleepConditionVariableSRW(&grQueue->submitDone, &grQueue->submitLock,
+                                          INFINITE, 0);
+            }
+            ReleaseSRWLockExclusive(&grQueue->submitLock);
+        }
+
+        submission = &grQueue->submissions[tail % SUBMISSION_RING_SIZE];
+    }
+
+    if (commandBufferCount > submission->commandBufferCapacity) {
+        submission->commandBufferCapacity = commandBufferCount;
+        submission->commandBufferInfos =
+            realloc(submission->commandBufferInfos,
+                    commandBufferCount * sizeof(VkCommandBufferSubmitInfo));
+    }
+
+    for (unsigned i = 0; i < commandBufferCount; i++) {
+        submission->commandBufferInfos[i] = (VkCommandBufferSubmitInfo) {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+            .pNext = NULL,
+            .commandBuffer = commandBuffers[i],
+            .deviceMask = 0,
+        };
+    }
+    submission->commandBufferCount = commandBufferCount;
+
+    // Queue semaphore waits are held until the next submission
+    memcpy(submission->waitSemaphoreInfos, grQueue->pendingWaits,
+           grQueue->pendingWaitCount * sizeof(VkSemaphoreSubmitInfo));
+    submission->waitSemaphoreCount = grQueue->pendingWaitCount;
+    grQueue->pendingWaitCount = 0;
+
+    if (waitSemaphore != VK_NULL_HANDLE) {
+        submission->waitSemaphoreInfos[submission->waitSemaphoreCount] =
+            getSemaphoreSubmitInfo(waitSemaphore, 0);
+        submission->waitSemaphoreCount++;
+    }
+
+    // Held signals come after the held waits and before everything else they're attached to
+    memcpy(submission->signalSemaphoreInfos, grQueue->pendingSignals,
+           grQueue->pendingSignalCount * sizeof(VkSemaphoreSubmitInfo));
+    submission->signalSemaphoreCount = grQueue->pendingSignalCount;
+    grQueue->pendingSignalCount = 0;
+
+    if (signalSemaphore != VK_NULL_HANDLE) {
+        submission->signalSemaphoreInfos[submission->signalSemaphoreCount] =
+            getSemaphoreSubmitInfo(signalSemaphore, signalValue);
+        submission->signalSemaphoreCount++;
+    }
+    if (timelineValue != 0) {
+        submission->signalSemaphoreInfos[submission->signalSemaphoreCount] =
+            getSemaphoreSubmitInfo(grQueue->timelineSemaphore, timelineValue);
+        submission->signalSemaphoreCount++;
+    }
+
+    if (grQueue->asyncSubmit) {
+        InterlockedIncrement(&grQueue->submitTail);
+        if (InterlockedCompareExchange(&grQueue->submitThreadIdle, 0, 0)) {
+            SetEvent(grQueue->submitQueued);
+        }
+
+        // Report errors from previous submissions
+        return InterlockedExchange(&grQueue->submitResult, VK_SUCCESS);
+    }
+
+    const VkSubmitInfo2 submitInfo = getSubmitInfo(submission);
+
+    AcquireSRWLockExclusive(&grQueue->queueLock);
+    VkResult res = VKD.vkQueueSubmit2(grQueue->queue, 1, &submitInfo, VK_NULL_HANDLE);
+    ReleaseSRWLockExclusive(&grQueue->queueLock);
+
+    if (res != VK_SUCCESS) {
+        LOGE("vkQueueSubmit2 failed (%d)\n", res);
+    }
+
+    return res;
+}
+
+VkResult grQueueSubmitVkCommandBuffers(
+    GrQueue* grQueue,
+    unsigned commandBufferCount,
+    const VkCommandBuffer* commandBuffers,
+    VkSemaphore waitSemaphore,
+    VkSemaphore signalSemaphore,
+    uint64_t signalValue,
+    uint64_t timelineValue)
+{
+    // Other queues may flush the held signals while the application submits
+    AcquireSRWLockExclusive(&grQueue->pendingLock);
+    VkResult res = submitVkCommandBuffers(grQueue, commandBufferCount, commandBuffers,
+                                          waitSemaphore, signalSemaphore, signalValue,
+                                          timelineValue);
+    ReleaseSRWLockExclusive(&grQueue->pendingLock);
+
+    return res;
+}
+
+VkResult grQueueAddSemaphoreWait(
+    GrQueue* grQueue,
+    VkSemaphore semaphore,
+    uint64_t value)
+{
+    VkResult res = VK_SUCCESS;
+
+    AcquireSRWLockExclusive(&grQueue->pendingLock);
+    if (grQueue->pendingSignalCount > 0 ||
+        grQueue->pendingWaitCount == MAX_PENDING_SEMAPHORE_WAITS) {
+        // Held signals must not wait on this, and held waits may be out of room.
+        // Submit them on their own
+        res = submitVkCommandBuffers(grQueue, 0, NULL, VK_NULL_HANDLE, VK_NULL_HANDLE, 0, 0);
+    }
+
+    grQueue->pendingWaits[grQueue->pendingWaitCount] = getSemaphoreSubmitInfo(semaphore, value);
+    grQueue->pendingWaitCount++;
+    ReleaseSRWLockExclusive(&grQueue->pendingLock);
+
+    return res;
+}
+
+VkResult grQueueAddSemaphoreSignal(
+    GrQueue* grQueue,
+    VkSemaphore semaphore,
+    uint64_t value)
+{
+    VkResult res = VK_SUCCESS;
+
+    AcquireSRWLockExclusive(&grQueue->pendingLock);
+    for (unsigned i = 0; i < grQueue->pendingSignalCount; i++) {
+        if (grQueue->pendingSignals[i].semaphore == semaphore) {
+            // Signal operations in a batch are unordered, only keep the highest value
+            grQueue->pendingSignals[i].value = value;
+            ReleaseSRWLockExclusive(&grQueue->pendingLock);
+            return res;
+        }
+    }
+
+    if (grQueue->pendingSignalCount == MAX_PENDING_SEMAPHORE_SIGNALS) {
+        // Out of room, submit the held signals on their own
+        res = submitVkCommandBuffers(grQueue, 0, NULL, VK_NULL_HANDLE, VK_NULL_HANDLE, 0, 0);
+    }
+
+    grQueue->pendingSignals[grQueue->pendingSignalCount] =
+        getSemaphoreSubmitInfo(semaphore, value);
+    grQueue->pendingSignalCount++;
+    ReleaseSRWLockExclusive(&grQueue->pendingLock);
+
+    return res;
+}
+
+VkResult grQueueFlushSemaphoreSignals(
+    GrQueue* grQueue)
+{
+    VkResult res = VK_SUCCESS;
+
+    AcquireSRWLockExclusive(&grQueue->pendingLock);
+    if (grQueue->pendingSignalCount > 0) {
+        res = submitVkCommandBuffers(grQueue, 0, NULL, VK_NULL_HANDLE, VK_NULL_HANDLE, 0, 0);
+    }
+    ReleaseSRWLockExclusive(&grQueue->pendingLock);
+
+    return res;
+}
+
+void grQueueFlushSubmissions(
+    GrQueue* grQueue)
+{
+    if (!grQueue->asyncSubmit) {
+        return;
+    }
+
+    unsigned tail = grQueue->submitTail;
+
+    AcquireSRWLockExclusive(&grQueue->submitLock);
+    while ((int)(tail - (unsigned)grQueue->submitHead) > 0) {
+        SleepConditionVariableSRW(&grQueue->submitDone, &grQueue->submitLock, INFINITE, 0);
+    }
+    ReleaseSRWLockExclusive(&grQueue->submitLock);
+}
+
 void grQueueAddInitialImage(
     GrImage* grImage)
 {
     AcquireSRWLockExclusive(&mInitialImagesLock);
 
-    mInitialImageCount++;
-    mInitialImages = realloc(mInitialImages, mInitialImageCount * sizeof(GrImage*));
-    mInitialImages[mInitialImageCount - 1] = grImage;
+    linkInitialImage(grImage);
+    grImage->isInitialImage = true;
+    InterlockedIncrement(&mInitialImageCount);
 
     ReleaseSRWLockExclusive(&mInitialImagesLock);
 }
@@ -188,14 +653,28 @@ void grQueueRemoveInitialImage(
 {
     AcquireSRWLockExclusive(&mInitialImagesLock);
 
-    for (unsigned i = 0; i < mInitialImageCount; i++) {
-        if (grImage == mInitialImages[i]) {
-            // Remove initial image entry (skip realloc)
-            mInitialImageCount--;
-            memmove(&mInitialImages[i], &mInitialImages[i + 1],
-                    (mInitialImageCount - i) * sizeof(GrImage*));
-            break;
-        }
+    if (grImage->isInitialImage) {
+        unlinkInitialImage(grImage);
+        grImage->isInitialImage = false;
+        InterlockedDecrement(&mInitialImageCount);
+    }
+
+    ReleaseSRWLockExclusive(&mInitialImagesLock);
+}
+
+void grQueueRebindInitialImage(
+    GrImage* grImage,
+    GrGpuMemory* grGpuMemory)
+{
+    AcquireSRWLockExclusive(&mInitialImagesLock);
+
+    // Move the image to the bucket of its new memory
+    if (grImage->isInitialImage) {
+        unlinkInitialImage(grImage);
+        grImage->grObj.grGpuMemory = grGpuMemory;
+        linkInitialImage(grImage);
+    } else {
+        grImage->grObj.grGpuMemory = grGpuMemory;
     }
 
     ReleaseSRWLockExclusive(&mInitialImagesLock);
@@ -260,57 +739,63 @@ GR_RESULT GR_STDCALL grQueueSubmit(
     LOGT("%p %u %p %u %p %p\n", queue, cmdBufferCount, pCmdBuffers, memRefCount, pMemRefs, fence);
     GrQueue* grQueue = (GrQueue*)queue;
     GrFence* grFence = (GrFence*)fence;
-    VkFence vkFence = VK_NULL_HANDLE;
-    VkResult res;
+    uint64_t timelineValue = 0;
 
     // TODO validate args
 
-    GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
-
-    checkMemoryReferences(grQueue, memRefCount, pMemRefs);
+    uint64_t startTime = profilerGetTime();
 
-    if (grFence != NULL) {
-        vkFence = grFence->fence;
+    for (unsigned i = 0; i < cmdBufferCount; i++) {
+        GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)pCmdBuffers[i];
 
-        res = VKD.vkResetFences(grDevice->device, 1, &vkFence);
-        if (res != VK_SUCCESS) {
-            LOGE("vkResetFences failed (%d)\n", res);
-            return getGrResult(res);
+        // Deferred command buffers may still be translating
+        grCmdBufferWaitTranslation(grCmdBuffer);
+        if (grCmdBuffer->translationResult != VK_SUCCESS) {
+            return getGrResult(grCmdBuffer->translationResult);
         }
+    }
+
+    PrepCommandBuffer* prepCommandBuffer = checkMemoryReferences(grQueue, memRefCount, pMemRefs);
 
-        grFence->submitted = true;
+    if (grFence != NULL || prepCommandBuffer != NULL) {
+        // Mantle queues are externally synchronized, no need for atomics
+        grQueue->timelineValue++;
+        timelineValue = grQueue->timelineValue;
+    }
+
+    if (grFence != NULL) {
+        grFence->grQueue = grQueue;
+        grFence->timelineValue = timelineValue;
     }
 
-    STACK_ARRAY(VkCommandBuffer, vkCommandBuffers, 1024, cmdBufferCount);
+    STACK_ARRAY(VkCommandBuffer, vkCommandBuffers, 1024, cmdBufferCount + 1);
+    unsigned vkCommandBufferCount = 0;
+
+    if (prepCommandBuffer != NULL) {
+        // Image transitions lead the submission, the command buffer is busy until it completes
+        prepCommandBuffer->timelineValue = timelineValue;
+        vkCommandBuffers[vkCommandBufferCount] = prepCommandBuffer->commandBuffer;
+        vkCommandBufferCount++;
+    }
 
     for (unsigned i = 0; i < cmdBufferCount; i++) {
         GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)pCmdBuffers[i];
 
         grCmdBuffer->submitFence = grFence;
-        vkCommandBuffers[i] = grCmdBuffer->commandBuffer;
+        vkCommandBuffers[vkCommandBufferCount] = grCmdBuffer->commandBuffer;
+        vkCommandBufferCount++;
     }
 
-    const VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = NULL,
-        .waitSemaphoreCount = 0,
-        .pWaitSemaphores = NULL,
-        .pWaitDstStageMask = NULL,
-        .commandBufferCount = cmdBufferCount,
-        .pCommandBuffers = vkCommandBuffers,
-        .signalSemaphoreCount = 0,
-        .pSignalSemaphores = NULL,
-    };
-
-    AcquireSRWLockExclusive(&grQueue->queueLock);
-    res = VKD.vkQueueSubmit(grQueue->queue, 1, &submitInfo, vkFence);
-    ReleaseSRWLockExclusive(&grQueue->queueLock);
+    // Handed over to the submission thread, if any
+    VkResult res = grQueueSubmitVkCommandBuffers(grQueue, vkCommandBufferCount, vkCommandBuffers,
+                                                 VK_NULL_HANDLE, VK_NULL_HANDLE, 0, timelineValue);
 
     STACK_ARRAY_FINISH(vkCommandBuffers);
 
-    if (res != VK_SUCCESS) {
-        LOGE("vkQueueSubmit failed (%d)\n", res);
-    }
+    uint64_t submitTime = profilerGetTime() - startTime;
+    grQueue->submitCallCount++;
+    grQueue->submitCallTime += submitTime;
+    grQueue->maxSubmitCallTime = MAX(grQueue->maxSubmitCallTime, submitTime);
 
     return getGrResult(res);
 }
@@ -328,6 +813,8 @@ GR_RESULT GR_STDCALL grQueueWaitIdle(
         return GR_ERROR_INVALID_OBJECT_TYPE;
     }
 
+    grQueueFlushSubmissions(grQueue);
+
     AcquireSRWLockExclusive(&grQueue->queueLock);
     VkResult res = VKD.vkQueueWaitIdle(grQueue->queue);
     ReleaseSRWLockExclusive(&grQueue->queueLock);
@@ -350,6 +837,15 @@ GR_RESULT GR_STDCALL grDeviceWaitIdle(
         return GR_ERROR_INVALID_OBJECT_TYPE;
     }
 
+    GrQueue* grQueues[] = {
+        grDevice->grUniversalQueue, grDevice->grComputeQueue, grDevice->grDmaQueue,
+    };
+    for (unsigned i = 0; i < COUNT_OF(grQueues); i++) {
+        if (grQueues[i] != NULL) {
+            grQueueFlushSubmissions(grQueues[i]);
+        }
+    }
+
     VkResult res = VKD.vkDeviceWaitIdle(grDevice->device);
     if (res != VK_SUCCESS) {
         LOGE("vkDeviceWaitIdle failed (%d)\n", res);
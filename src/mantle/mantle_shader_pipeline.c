@@ -6,26 +6,48 @@ typedef struct _Stage {
     const VkShaderStageFlagBits flags;
 } Stage;
 
+typedef struct _UpdateTemplateEntry {
+    unsigned order;
+    bool isDynamic;
+    unsigned pathDepth;
+    unsigned path[MAX_PATH_DEPTH];
+    VkDescriptorUpdateTemplateEntry entry;
+    int strideOffset; // <0 means non-existent
+    unsigned strideSlotIndex;
+} UpdateTemplateEntry;
+
+typedef struct _UpdateTemplateBuilder {
+    unsigned entryCount;
+    unsigned maxEntryCount;
+    UpdateTemplateEntry* entries;
+} UpdateTemplateBuilder;
+
 static VkDescriptorUpdateTemplate getVkDescriptorUpdateTemplate(
     const GrDevice* grDevice,
     unsigned descriptorUpdateEntryCount,
     const VkDescriptorUpdateTemplateEntry* descriptorUpdateEntries,
-    VkDescriptorSetLayout descriptorSetLayout)
+    VkDescriptorSetLayout descriptorSetLayout,
+    VkPipelineBindPoint pipelineBindPoint,
+    VkPipelineLayout pushPipelineLayout)
 {
     VkDescriptorUpdateTemplate descriptorUpdateTemplate = VK_NULL_HANDLE;
     VkResult res;
 
+    // A pipeline layout is only passed for push descriptor templates
+    bool isPushDescriptor = pushPipelineLayout != VK_NULL_HANDLE;
+
     const VkDescriptorUpdateTemplateCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
         .descriptorUpdateEntryCount = descriptorUpdateEntryCount,
         .pDescriptorUpdateEntries = descriptorUpdateEntries,
-        .templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
-        .descriptorSetLayout = descriptorSetLayout,
-        .pipelineBindPoint = 0, // Ignored
-        .pipelineLayout = VK_NULL_HANDLE, // Ignored
-        .set = 0, // Ignored
+        .templateType = isPushDescriptor ? VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR
+                                         : VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+        .descriptorSetLayout = isPushDescriptor ? VK_NULL_HANDLE : descriptorSetLayout,
+        .pipelineBindPoint = isPushDescriptor ? pipelineBindPoint : 0,
+        .pipelineLayout = pushPipelineLayout,
+        .set = 0,
     };
 
     res = VKD.vkCreateDescriptorUpdateTemplate(grDevice->device, &createInfo, NULL,
@@ -38,9 +60,41 @@ static VkDescriptorUpdateTemplate getVkDescriptorUpdateTemplate(
     return descriptorUpdateTemplate;
 }
 
-static void addDynamicUpdateTemplateSlots(
-    unsigned* updateTemplateSlotCount,
-    UpdateTemplateSlot** updateTemplateSlots,
+static unsigned countMappingSlots(
+    const GR_DESCRIPTOR_SET_MAPPING* mapping)
+{
+    unsigned count = 0;
+
+    for (unsigned i = 0; i < mapping->descriptorCount; i++) {
+        const GR_DESCRIPTOR_SLOT_INFO* slotInfo = &mapping->pDescriptorInfo[i];
+
+        if (slotInfo->slotObjectType == GR_SLOT_NEXT_DESCRIPTOR_SET) {
+            count += countMappingSlots(slotInfo->pNextLevelSet);
+        } else if (slotInfo->slotObjectType != GR_SLOT_UNUSED) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static UpdateTemplateEntry* addUpdateTemplateEntry(
+    UpdateTemplateBuilder* builder)
+{
+    if (builder->entryCount >= builder->maxEntryCount) {
+        LOGE("exceeded update template entry count of %d\n", builder->maxEntryCount);
+        assert(false);
+    }
+
+    UpdateTemplateEntry* entry = &builder->entries[builder->entryCount];
+    entry->order = builder->entryCount;
+    builder->entryCount++;
+
+    return entry;
+}
+
+static void addDynamicUpdateTemplateEntries(
+    UpdateTemplateBuilder* builder,
     const GR_DYNAMIC_MEMORY_VIEW_SLOT_INFO* dynamicMapping,
     unsigned bindingCount,
     const IlcBinding* bindings)
@@ -52,45 +106,31 @@ static void addDynamicUpdateTemplateSlots(
             binding->ilIndex == dynamicMapping->shaderEntityIndex &&
             binding->type == ILC_BINDING_RESOURCE) {
             // Found a dynamic memory view descriptor
-            VkDescriptorUpdateTemplateEntry* entry =
-                malloc(sizeof(VkDescriptorUpdateTemplateEntry));
-            *entry = (VkDescriptorUpdateTemplateEntry) {
-                .dstBinding = binding->vkIndex,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
-                .offset = OFFSET_OF_UNION(DescriptorSetSlot, buffer, bufferInfo),
-                .stride = 0,
-            };
+            UpdateTemplateEntry* entry = addUpdateTemplateEntry(builder);
 
-            (*updateTemplateSlotCount)++;
-            *updateTemplateSlots = realloc(*updateTemplateSlots,
-                                           *updateTemplateSlotCount *
-                                           sizeof(UpdateTemplateSlot));
-            (*updateTemplateSlots)[*updateTemplateSlotCount - 1] = (UpdateTemplateSlot) {
-                .updateTemplate = (VkDescriptorUpdateTemplate)entry, // Stuff the entry here
+            *entry = (UpdateTemplateEntry) {
+                .order = entry->order,
                 .isDynamic = true,
                 .pathDepth = 0,
                 .path = { 0 },
-                .strideCount = 0, // Initialized below
-                .strideOffsets = { 0 }, // Initialized below
-                .strideSlotIndexes = { 0 }, // Initialized below
+                .entry = {
+                    .dstBinding = binding->vkIndex,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+                    .offset = OFFSET_OF_UNION(DescriptorSetSlot, buffer, bufferInfo),
+                    .stride = 0,
+                },
+                .strideOffset = binding->strideIndex >= 0 ?
+                                binding->strideIndex * (int)sizeof(uint32_t) : -1,
+                .strideSlotIndex = 0,
             };
-
-            if (binding->strideIndex >= 0) {
-                unsigned strideOffset = binding->strideIndex * sizeof(uint32_t);
-                (*updateTemplateSlots)[*updateTemplateSlotCount - 1].strideCount = 1;
-                (*updateTemplateSlots)[*updateTemplateSlotCount - 1].strideOffsets[0] =
-                    strideOffset;
-                (*updateTemplateSlots)[*updateTemplateSlotCount - 1].strideSlotIndexes[0] = 0;
-            }
         }
     }
 }
 
-static void addUpdateTemplateSlotsFromMapping(
-    unsigned* updateTemplateSlotCount,
-    UpdateTemplateSlot** updateTemplateSlots,
+static void addUpdateTemplateEntriesFromMapping(
+    UpdateTemplateBuilder* builder,
     const GR_DESCRIPTOR_SET_MAPPING* mapping,
     unsigned bindingCount,
     const IlcBinding* bindings,
@@ -112,10 +152,9 @@ static void addUpdateTemplateSlotsFromMapping(
             // Mark path
             path[pathDepth] = i;
 
-            // Add slots from the nested set
-            addUpdateTemplateSlotsFromMapping(updateTemplateSlotCount, updateTemplateSlots,
-                                              slotInfo->pNextLevelSet, bindingCount, bindings,
-                                              pathDepth + 1, path);
+            // Add entries from the nested set
+            addUpdateTemplateEntriesFromMapping(builder, slotInfo->pNextLevelSet,
+                                                bindingCount, bindings, pathDepth + 1, path);
             continue;
         }
 
@@ -155,147 +194,248 @@ static void addUpdateTemplateSlotsFromMapping(
             assert(false);
         }
 
-        VkDescriptorUpdateTemplateEntry* entry = malloc(sizeof(VkDescriptorUpdateTemplateEntry));
-        *entry = (VkDescriptorUpdateTemplateEntry) {
-            .dstBinding = binding->vkIndex,
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = binding->descriptorType,
-            .offset = i * sizeof(DescriptorSetSlot) + slotDataOffset,
-            .stride = 0,
-        };
+        UpdateTemplateEntry* entry = addUpdateTemplateEntry(builder);
 
-        (*updateTemplateSlotCount)++;
-        *updateTemplateSlots = realloc(*updateTemplateSlots,
-                                       *updateTemplateSlotCount * sizeof(UpdateTemplateSlot));
-        (*updateTemplateSlots)[*updateTemplateSlotCount - 1] = (UpdateTemplateSlot) {
-            .updateTemplate = (VkDescriptorUpdateTemplate)entry, // Stuff the entry here
+        *entry = (UpdateTemplateEntry) {
+            .order = entry->order,
             .isDynamic = false,
             .pathDepth = pathDepth,
             .path = { 0 }, // Initialized below
-            .strideCount = 0, // Initialized below
-            .strideOffsets = { 0 }, // Initialized below
-            .strideSlotIndexes = { 0 }, // Initialized below
+            .entry = {
+                .dstBinding = binding->vkIndex,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = binding->descriptorType,
+                .offset = i * sizeof(DescriptorSetSlot) + slotDataOffset,
+                .stride = 0,
+            },
+            .strideOffset = binding->strideIndex >= 0 ?
+                            binding->strideIndex * (int)sizeof(uint32_t) : -1,
+            .strideSlotIndex = i,
         };
 
-        memcpy((*updateTemplateSlots)[*updateTemplateSlotCount - 1].path,
-               path, pathDepth * sizeof(unsigned));
-
-        if (binding->strideIndex >= 0) {
-            unsigned strideOffset = binding->strideIndex * sizeof(uint32_t);
-            (*updateTemplateSlots)[*updateTemplateSlotCount - 1].strideCount = 1;
-            (*updateTemplateSlots)[*updateTemplateSlotCount - 1].strideOffsets[0] = strideOffset;
-            (*updateTemplateSlots)[*updateTemplateSlotCount - 1].strideSlotIndexes[0] = i;
-        }
+        memcpy(entry->path, path, pathDepth * sizeof(unsigned));
     }
 }
 
-static int compareUpdateTemplateSlots(
+static bool isSameUpdateTemplatePath(
+    const UpdateTemplateEntry* entryA,
+    const UpdateTemplateEntry* entryB)
+{
+    return entryA->isDynamic == entryB->isDynamic &&
+           entryA->pathDepth == entryB->pathDepth &&
+           memcmp(entryA->path, entryB->path, entryA->pathDepth * sizeof(entryA->path[0])) == 0;
+}
+
+static int compareUpdateTemplateEntries(
     const void* a,
     const void* b)
 {
-    const UpdateTemplateSlot* slotA = a;
-    const UpdateTemplateSlot* slotB = b;
+    const UpdateTemplateEntry* entryA = a;
+    const UpdateTemplateEntry* entryB = b;
+    int pathCmp;
 
-    // Make slots with the same path adjacent
-    if (slotA->isDynamic != slotB->isDynamic) {
-        return (int)slotA->isDynamic - (int)slotB->isDynamic;
+    // Make entries with the same path adjacent
+    if (entryA->isDynamic != entryB->isDynamic) {
+        return (int)entryA->isDynamic - (int)entryB->isDynamic;
     }
-    if (slotA->pathDepth != slotB->pathDepth) {
-        return (int)slotA->pathDepth - (int)slotB->pathDepth;
+    if (entryA->pathDepth != entryB->pathDepth) {
+        return (int)entryA->pathDepth - (int)entryB->pathDepth;
     }
-    return memcmp(slotA->path, slotB->path, slotA->pathDepth * sizeof(slotA->path[0]));
+    pathCmp = memcmp(entryA->path, entryB->path, entryA->pathDepth * sizeof(entryA->path[0]));
+    if (pathCmp != 0) {
+        return pathCmp;
+    }
+
+    // Keep insertion order so that the result is deterministic
+    return (int)entryA->order - (int)entryB->order;
 }
 
-static void mergeUpdateTemplateSlots(
+static void addUpdateTemplateStride(
+    UpdateTemplateSlot* slot,
+    unsigned strideOffset,
+    unsigned strideSlotIndex)
+{
+    for (unsigned i = 0; i < slot->strideCount; i++) {
+        if (slot->strideOffsets[i] == strideOffset) {
+            // Same push constant, the last write wins like for descriptors
+            slot->strideSlotIndexes[i] = strideSlotIndex;
+            return;
+        }
+    }
+
+    if (slot->strideCount >= MAX_STRIDES) {
+        LOGE("exceeded max strides of %d\n", MAX_STRIDES);
+        assert(false);
+    }
+
+    slot->strideOffsets[slot->strideCount] = strideOffset;
+    slot->strideSlotIndexes[slot->strideCount] = strideSlotIndex;
+    slot->strideCount++;
+}
+
+static uint32_t* getUpdateTemplateKey(
+    unsigned* keySize,
+    unsigned layoutBindingCount,
+    const VkDescriptorSetLayoutBinding* layoutBindings,
+    const UpdateTemplateBuilder* builder,
+    VkPipelineBindPoint pipelineBindPoint,
+    bool isPushDescriptor)
+{
+    // The template depends on the set layout definition and the sorted entries only.
+    // Push descriptor templates are additionally tied to a bind point.
+    unsigned maxKeySize = 4 + 4 * layoutBindingCount +
+                          (8 + MAX_PATH_DEPTH) * builder->entryCount;
+    uint32_t* key = malloc(maxKeySize * sizeof(uint32_t));
+    unsigned idx = 0;
+
+    key[idx++] = isPushDescriptor;
+    key[idx++] = isPushDescriptor ? pipelineBindPoint : 0;
+    key[idx++] = layoutBindingCount;
+    for (unsigned i = 0; i < layoutBindingCount; i++) {
+        const VkDescriptorSetLayoutBinding* binding = &layoutBindings[i];
+
+        key[idx++] = binding->binding;
+        key[idx++] = binding->descriptorType;
+        key[idx++] = binding->descriptorCount;
+        key[idx++] = binding->stageFlags;
+    }
+
+    key[idx++] = builder->entryCount;
+    for (unsigned i = 0; i < builder->entryCount; i++) {
+        const UpdateTemplateEntry* entry = &builder->entries[i];
+
+        key[idx++] = entry->isDynamic;
+        key[idx++] = entry->pathDepth;
+        for (unsigned j = 0; j < entry->pathDepth; j++) {
+            key[idx++] = entry->path[j];
+        }
+        key[idx++] = entry->entry.dstBinding;
+        key[idx++] = entry->entry.descriptorType;
+        key[idx++] = entry->entry.descriptorCount;
+        key[idx++] = (uint32_t)entry->entry.offset;
+        key[idx++] = (uint32_t)entry->strideOffset;
+        key[idx++] = entry->strideSlotIndex;
+    }
+
+    *keySize = idx * sizeof(uint32_t);
+    return key;
+}
+
+static UpdateTemplateSlot* mergeUpdateTemplateEntries(
     unsigned* updateTemplateSlotCount,
-    UpdateTemplateSlot** updateTemplateSlots,
     const GrDevice* grDevice,
-    VkDescriptorSetLayout descriptorSetLayout)
+    const UpdateTemplateBuilder* builder,
+    VkDescriptorSetLayout descriptorSetLayout,
+    VkPipelineBindPoint pipelineBindPoint,
+    VkPipelineLayout pushPipelineLayout)
 {
-    // Group slots by path
-    qsort(*updateTemplateSlots, *updateTemplateSlotCount, sizeof(UpdateTemplateSlot),
-          compareUpdateTemplateSlots);
-
-    unsigned descriptorUpdateEntryCount = 0;
-    VkDescriptorUpdateTemplateEntry* descriptorUpdateEntries = NULL;
-
-    for (unsigned i = 0; i < *updateTemplateSlotCount; i++) {
-        bool isLastSlot = (i + 1) == *updateTemplateSlotCount;
-        UpdateTemplateSlot* slot = &(*updateTemplateSlots)[i];
-        UpdateTemplateSlot* nextSlot = &(*updateTemplateSlots)[i + 1];
-
-        // Add new entry
-        VkDescriptorUpdateTemplateEntry* entry =
-            (VkDescriptorUpdateTemplateEntry*)slot->updateTemplate;
-
-        descriptorUpdateEntryCount++;
-        descriptorUpdateEntries = realloc(descriptorUpdateEntries,
-                                          descriptorUpdateEntryCount *
-                                          sizeof(VkDescriptorUpdateTemplateEntry));
-        descriptorUpdateEntries[descriptorUpdateEntryCount - 1] = *entry;
-        free(entry);
-
-        if (!isLastSlot &&
-            slot->isDynamic == nextSlot->isDynamic &&
-            slot->pathDepth == nextSlot->pathDepth &&
-            memcmp(slot->path, nextSlot->path, slot->pathDepth * sizeof(slot->path[0])) == 0) {
-            // Can't merge yet
-            continue;
+    unsigned slotCount = 0;
+
+    // Entries are grouped by path, each group becomes one slot
+    for (unsigned i = 0; i < builder->entryCount; i++) {
+        if (i == 0 || !isSameUpdateTemplatePath(&builder->entries[i - 1], &builder->entries[i])) {
+            slotCount++;
+        }
+    }
+
+    UpdateTemplateSlot* slots = malloc(slotCount * sizeof(UpdateTemplateSlot));
+    STACK_ARRAY(VkDescriptorUpdateTemplateEntry, descriptorUpdateEntries, 64, builder->entryCount);
+
+    for (unsigned i = 0; i < builder->entryCount; i++) {
+        descriptorUpdateEntries[i] = builder->entries[i].entry;
+    }
+
+    unsigned slotIdx = 0;
+    for (unsigned i = 0; i < builder->entryCount; slotIdx++) {
+        const UpdateTemplateEntry* firstEntry = &builder->entries[i];
+        UpdateTemplateSlot* slot = &slots[slotIdx];
+        unsigned groupSize = 1;
+
+        while (i + groupSize < builder->entryCount &&
+               isSameUpdateTemplatePath(firstEntry, &builder->entries[i + groupSize])) {
+            groupSize++;
         }
 
-        unsigned mergedIdx = i - descriptorUpdateEntryCount + 1;
-        UpdateTemplateSlot* mergedSlot = &(*updateTemplateSlots)[mergedIdx];
-
-        mergedSlot->updateTemplate =
-            getVkDescriptorUpdateTemplate(grDevice, descriptorUpdateEntryCount,
-                                          descriptorUpdateEntries, descriptorSetLayout);
-        free(descriptorUpdateEntries);
-
-        // TODO deduplicate strides
-        for (unsigned j = mergedIdx + 1; j <= i; j++) {
-            UpdateTemplateSlot* slotToMerge = &(*updateTemplateSlots)[j];
-
-            if (slotToMerge->strideCount == 1) {
-                if (mergedSlot->strideCount >= MAX_STRIDES) {
-                    LOGE("exceeded max strides of %d\n", MAX_STRIDES);
-                    assert(false);
-                }
-
-                mergedSlot->strideCount++;
-                mergedSlot->strideOffsets[mergedSlot->strideCount - 1] =
-                    slotToMerge->strideOffsets[0];
-                mergedSlot->strideSlotIndexes[mergedSlot->strideCount - 1] =
-                    slotToMerge->strideSlotIndexes[0];
+        *slot = (UpdateTemplateSlot) {
+            .updateTemplate = getVkDescriptorUpdateTemplate(grDevice, groupSize,
+                                                            &descriptorUpdateEntries[i],
+                                                            descriptorSetLayout,
+                                                            pipelineBindPoint,
+                                                            pushPipelineLayout),
+            .isDynamic = firstEntry->isDynamic,
+            .pathDepth = firstEntry->pathDepth,
+            .path = { 0 }, // Initialized below
+            .slotIndex = 0, // Initialized below
+            .slotCount = 0, // Initialized below
+            .strideCount = 0, // Initialized below
+            .strideOffsets = { 0 }, // Initialized below
+            .strideSlotIndexes = { 0 }, // Initialized below
+            .bindingCount = groupSize,
+            .bindings = malloc(groupSize * sizeof(uint32_t)), // Initialized below
+        };
+
+        memcpy(slot->path, firstEntry->path, firstEntry->pathDepth * sizeof(unsigned));
+
+        unsigned minSlotIndex = UINT32_MAX;
+        unsigned maxSlotIndex = 0;
+        for (unsigned j = i; j < i + groupSize; j++) {
+            const UpdateTemplateEntry* entry = &builder->entries[j];
+            unsigned entrySlotIndex = entry->entry.offset / sizeof(DescriptorSetSlot);
+
+            minSlotIndex = MIN(minSlotIndex, entrySlotIndex);
+            maxSlotIndex = MAX(maxSlotIndex, entrySlotIndex);
+            slot->bindings[j - i] = entry->entry.dstBinding;
+
+            if (entry->strideOffset >= 0) {
+                addUpdateTemplateStride(slot, entry->strideOffset, entry->strideSlotIndex);
             }
         }
 
-        // Drop temporary slots
-        memmove(mergedSlot + 1, nextSlot,
-                (*updateTemplateSlotCount - i - 1) * sizeof(UpdateTemplateSlot));
-        *updateTemplateSlotCount -= descriptorUpdateEntryCount - 1;
-        *updateTemplateSlots = realloc(*updateTemplateSlots,
-                                       *updateTemplateSlotCount * sizeof(UpdateTemplateSlot));
+        slot->slotIndex = minSlotIndex;
+        slot->slotCount = maxSlotIndex - minSlotIndex + 1;
 
-        // Update state
-        i = mergedIdx;
-        descriptorUpdateEntryCount = 0;
-        descriptorUpdateEntries = NULL;
+        i += groupSize;
     }
+
+    STACK_ARRAY_FINISH(descriptorUpdateEntries);
+
+    *updateTemplateSlotCount = slotCount;
+    return slots;
 }
 
-static void getUpdateTemplateSlots(
-    unsigned* updateTemplateSlotCount,
-    UpdateTemplateSlot** updateTemplateSlots,
-    const GrDevice* grDevice,
+static UpdateTemplateSlotList* getUpdateTemplateSlotList(
+    GrDevice* grDevice,
+    unsigned layoutBindingCount,
+    const VkDescriptorSetLayoutBinding* layoutBindings,
     unsigned stageCount,
     const Stage* stages,
     unsigned mappingIndex,
-    VkDescriptorSetLayout descriptorSetLayout)
+    VkDescriptorSetLayout descriptorSetLayout,
+    VkPipelineBindPoint pipelineBindPoint,
+    VkPipelineLayout pushPipelineLayout)
 {
+    UpdateTemplateBuilder builder = {
+        .entryCount = 0,
+        .maxEntryCount = 0, // Initialized below
+        .entries = NULL, // Initialized below
+    };
+
+    // Size the arena upfront to avoid reallocating for each entry
     for (unsigned i = 0; i < stageCount; i++) {
-        const Stage* stage = &stages[i];
-        const GR_PIPELINE_SHADER* shader = stage->shader;
+        const GR_PIPELINE_SHADER* shader = stages[i].shader;
+        const GrShader* grShader = shader->shader;
+
+        if (grShader != NULL) {
+            builder.maxEntryCount += grShader->bindingCount +
+                                     countMappingSlots(&shader->descriptorSetMapping[mappingIndex]);
+        }
+    }
+
+    builder.entries = malloc(builder.maxEntryCount * sizeof(UpdateTemplateEntry));
+
+    for (unsigned i = 0; i < stageCount; i++) {
+        const GR_PIPELINE_SHADER* shader = stages[i].shader;
         const GrShader* grShader = shader->shader;
         unsigned path[MAX_PATH_DEPTH];
 
@@ -303,27 +443,84 @@ static void getUpdateTemplateSlots(
             continue;
         }
 
-        addDynamicUpdateTemplateSlots(updateTemplateSlotCount, updateTemplateSlots,
-                                      &shader->dynamicMemoryViewMapping,
-                                      grShader->bindingCount, grShader->bindings);
-        addUpdateTemplateSlotsFromMapping(updateTemplateSlotCount, updateTemplateSlots,
-                                          &shader->descriptorSetMapping[mappingIndex],
-                                          grShader->bindingCount, grShader->bindings, 0, path);
+        addDynamicUpdateTemplateEntries(&builder, &shader->dynamicMemoryViewMapping,
+                                        grShader->bindingCount, grShader->bindings);
+        addUpdateTemplateEntriesFromMapping(&builder, &shader->descriptorSetMapping[mappingIndex],
+                                            grShader->bindingCount, grShader->bindings, 0, path);
     }
 
-    mergeUpdateTemplateSlots(updateTemplateSlotCount, updateTemplateSlots, grDevice,
-                             descriptorSetLayout);
+    // Group entries by path
+    qsort(builder.entries, builder.entryCount, sizeof(UpdateTemplateEntry),
+          compareUpdateTemplateEntries);
+
+    unsigned keySize = 0;
+    uint32_t* key = getUpdateTemplateKey(&keySize, layoutBindingCount, layoutBindings, &builder,
+                                         pipelineBindPoint, pushPipelineLayout != VK_NULL_HANDLE);
+    uint64_t hash = getHash(key, keySize);
+    UpdateTemplateSlotList* slotList = NULL;
+
+    // Share templates between pipelines with identical descriptor mappings
+    AcquireSRWLockExclusive(&grDevice->updateTemplateSlotListLock);
+
+    for (unsigned i = 0; i < grDevice->updateTemplateSlotListCount; i++) {
+        UpdateTemplateSlotList* cachedList = grDevice->updateTemplateSlotLists[i];
+
+        if (cachedList->hash == hash && cachedList->keySize == keySize &&
+            memcmp(cachedList->key, key, keySize) == 0) {
+            slotList = cachedList;
+            slotList->refCount++;
+            break;
+        }
+    }
+
+    if (slotList == NULL) {
+        slotList = malloc(sizeof(UpdateTemplateSlotList));
+        *slotList = (UpdateTemplateSlotList) {
+            .refCount = 1,
+            .hash = hash,
+            .keySize = keySize,
+            .key = key,
+            .slotCount = 0, // Initialized below
+            .slots = NULL, // Initialized below
+        };
+
+        slotList->slots = mergeUpdateTemplateEntries(&slotList->slotCount, grDevice, &builder,
+                                                     descriptorSetLayout, pipelineBindPoint,
+                                                     pushPipelineLayout);
+        key = NULL;
+
+        grDevice->updateTemplateSlotListCount++;
+        grDevice->updateTemplateSlotLists = realloc(grDevice->updateTemplateSlotLists,
+                                                    grDevice->updateTemplateSlotListCount *
+                                                    sizeof(UpdateTemplateSlotList*));
+        grDevice->updateTemplateSlotLists[grDevice->updateTemplateSlotListCount - 1] = slotList;
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->updateTemplateSlotListLock);
+
+    free(key);
+    free(builder.entries);
+    return slotList;
 }
 
-static VkDescriptorSetLayout getVkDescriptorSetLayout(
+static VkDescriptorSetLayoutBinding* getDescriptorSetLayoutBindings(
+    unsigned* bindingCount,
     unsigned* dynamicOffsetCount,
-    const GrDevice* grDevice,
     unsigned stageCount,
     const Stage* stages)
 {
-    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
-    unsigned bindingCount = 0;
-    VkDescriptorSetLayoutBinding* bindings = NULL;
+    unsigned maxBindingCount = 0;
+
+    for (unsigned i = 0; i < stageCount; i++) {
+        const GrShader* grShader = stages[i].shader->shader;
+
+        if (grShader != NULL) {
+            maxBindingCount += grShader->bindingCount;
+        }
+    }
+
+    VkDescriptorSetLayoutBinding* bindings =
+        malloc(maxBindingCount * sizeof(VkDescriptorSetLayoutBinding));
 
     for (unsigned i = 0; i < stageCount; i++) {
         const Stage* stage = &stages[i];
@@ -349,9 +546,7 @@ static VkDescriptorSetLayout getVkDescriptorSetLayout(
             }
 
             // Add new binding
-            bindingCount++;
-            bindings = realloc(bindings, bindingCount * sizeof(VkDescriptorSetLayoutBinding));
-            bindings[bindingCount - 1] = (VkDescriptorSetLayoutBinding) {
+            bindings[*bindingCount] = (VkDescriptorSetLayoutBinding) {
                 .binding = binding->vkIndex,
                 .descriptorType = isDynamic ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC
                                             : binding->descriptorType,
@@ -359,13 +554,55 @@ static VkDescriptorSetLayout getVkDescriptorSetLayout(
                 .stageFlags = stage->flags,
                 .pImmutableSamplers = NULL,
             };
+            (*bindingCount)++;
         }
     }
 
+    return bindings;
+}
+
+static void getDescriptorCounts(
+    uint32_t* descriptorCounts,
+    unsigned bindingCount,
+    const VkDescriptorSetLayoutBinding* bindings)
+{
+    for (unsigned i = 0; i < bindingCount; i++) {
+        descriptorCounts[bindings[i].descriptorType] += bindings[i].descriptorCount;
+    }
+}
+
+static bool canUsePushDescriptors(
+    const GrDevice* grDevice,
+    unsigned bindingCount,
+    const VkDescriptorSetLayoutBinding* bindings,
+    unsigned dynamicOffsetCount)
+{
+    unsigned descriptorCount = 0;
+
+    // Dynamic buffers can't be pushed
+    if (grDevice->maxPushDescriptors == 0 || dynamicOffsetCount > 0) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < bindingCount; i++) {
+        descriptorCount += bindings[i].descriptorCount;
+    }
+
+    return descriptorCount <= grDevice->maxPushDescriptors;
+}
+
+static VkDescriptorSetLayout getVkDescriptorSetLayout(
+    const GrDevice* grDevice,
+    unsigned bindingCount,
+    const VkDescriptorSetLayoutBinding* bindings,
+    bool isPushDescriptor)
+{
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+
     const VkDescriptorSetLayoutCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
         .pNext = NULL,
-        .flags = 0,
+        .flags = isPushDescriptor ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0,
         .bindingCount = bindingCount,
         .pBindings = bindings,
     };
@@ -375,7 +612,6 @@ static VkDescriptorSetLayout getVkDescriptorSetLayout(
         LOGE("vkCreateDescriptorSetLayout failed (%d)\n", res);
     }
 
-    free(bindings);
     return layout;
 }
 
@@ -415,18 +651,65 @@ static VkPipelineLayout getVkPipelineLayout(
     return pipelineLayout;
 }
 
-// Exported Functions
+static void addPipelineProfilerEvent(
+    const GrPipeline* grPipeline,
+    ProfilerPipelineEventType type,
+    uint64_t setupTime,
+    uint64_t compileTime,
+    bool isCacheHit)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
 
-VkPipeline grPipelineGetVkPipeline(
+    if (!profilerIsEnabled()) {
+        return;
+    }
+
+    ProfilerPipelineEvent profilerEvent = {
+        .type = type,
+        .object = grPipeline,
+        .shaderNames = { NULL }, // Initialized below
+        .translateTime = 0, // Initialized below
+        .moduleTime = 0, // Initialized below
+        .setupTime = setupTime,
+        .compileTime = compileTime,
+        .isRenderThread = GetCurrentThreadId() == grDevice->renderThreadId,
+        .isCacheHit = isCacheHit,
+    };
+
+    for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
+        const GrShader* grShader = grPipeline->grShaderRefs[i];
+
+        if (grShader != NULL) {
+            profilerEvent.shaderNames[i] = grShader->name;
+            profilerEvent.translateTime += grShader->translateTime;
+            profilerEvent.moduleTime += grShader->moduleTime;
+        }
+    }
+
+    profilerAddPipelineEvent(&profilerEvent);
+}
+
+static VkPipeline getVkPipeline(
     const GrPipeline* grPipeline,
     VkFormat depthFormat,
-    VkFormat stencilFormat)
+    VkFormat stencilFormat,
+    const VkSpecializationInfo* vertexSpecializationInfo)
 {
     const GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
     const PipelineCreateInfo* createInfo = grPipeline->createInfo;
     VkPipeline vkPipeline = VK_NULL_HANDLE;
     VkResult vkRes;
 
+    VkPipelineShaderStageCreateInfo stageCreateInfos[MAX_STAGE_COUNT];
+
+    memcpy(stageCreateInfos, createInfo->stageCreateInfos,
+           createInfo->stageCount * sizeof(VkPipelineShaderStageCreateInfo));
+    for (unsigned i = 0; i < createInfo->stageCount; i++) {
+        if (stageCreateInfos[i].stage == VK_SHADER_STAGE_VERTEX_BIT) {
+            stageCreateInfos[i].pSpecializationInfo = vertexSpecializationInfo;
+        }
+    }
+
     const VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
         .pNext = NULL,
@@ -592,7 +875,7 @@ VkPipeline grPipelineGetVkPipeline(
         .pNext = &renderingCreateInfo,
         .flags = createInfo->createFlags,
         .stageCount = createInfo->stageCount,
-        .pStages = createInfo->stageCreateInfos,
+        .pStages = stageCreateInfos,
         .pVertexInputState = &vertexInputStateCreateInfo,
         .pInputAssemblyState = &inputAssemblyStateCreateInfo,
         .pTessellationState = &tessellationStateCreateInfo,
@@ -609,12 +892,192 @@ VkPipeline grPipelineGetVkPipeline(
         .basePipelineIndex = 0,
     };
 
+    uint64_t startTime = profilerGetTime();
     vkRes = VKD.vkCreateGraphicsPipelines(grDevice->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
                                           NULL, &vkPipeline);
     if (vkRes != VK_SUCCESS) {
         LOGE("vkCreateGraphicsPipelines failed (%d)\n", vkRes);
     }
 
+    // Creation is deferred until the first draw, which may be replayed by a translation thread
+    addPipelineProfilerEvent(grPipeline, PROFILER_GRAPHICS_PIPELINE_COMPILE,
+                             0, profilerGetTime() - startTime, false);
+
+    return vkPipeline;
+}
+
+static VkPipeline findPipelineVariant(
+    const GrPipeline* grPipeline,
+    const uint32_t* strides)
+{
+    for (unsigned i = 0; i < grPipeline->variantCount; i++) {
+        const PipelineVariant* variant = &grPipeline->variants[i];
+
+        if (memcmp(variant->strides, strides, sizeof(variant->strides)) == 0) {
+            return variant->pipeline;
+        }
+    }
+
+    return VK_NULL_HANDLE;
+}
+
+// Exported Functions
+
+void grDeviceReleaseUpdateTemplateSlotList(
+    GrDevice* grDevice,
+    UpdateTemplateSlotList* slotList)
+{
+    AcquireSRWLockExclusive(&grDevice->updateTemplateSlotListLock);
+
+    if (--slotList->refCount > 0) {
+        ReleaseSRWLockExclusive(&grDevice->updateTemplateSlotListLock);
+        return;
+    }
+
+    for (unsigned i = 0; i < grDevice->updateTemplateSlotListCount; i++) {
+        if (grDevice->updateTemplateSlotLists[i] == slotList) {
+            // Remove entry
+            grDevice->updateTemplateSlotListCount--;
+            memmove(&grDevice->updateTemplateSlotLists[i], &grDevice->updateTemplateSlotLists[i + 1],
+                    (grDevice->updateTemplateSlotListCount - i) * sizeof(UpdateTemplateSlotList*));
+            break;
+        }
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->updateTemplateSlotListLock);
+
+    for (unsigned i = 0; i < slotList->slotCount; i++) {
+        VKD.vkDestroyDescriptorUpdateTemplate(grDevice->device, slotList->slots[i].updateTemplate,
+                                              NULL);
+        free(slotList->slots[i].bindings);
+    }
+    free(slotList->slots);
+    free(slotList->key);
+    free(slotList);
+}
+
+VkPipeline grPipelineGetVkPipeline(
+    GrPipeline* grPipeline,
+    VkFormat depthFormat,
+    VkFormat stencilFormat)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+
+    AcquireSRWLockExclusive(&grPipeline->variantLock);
+    VkPipeline vkPipeline = grPipeline->pipeline;
+    ReleaseSRWLockExclusive(&grPipeline->variantLock);
+
+    if (vkPipeline != VK_NULL_HANDLE) {
+        return vkPipeline;
+    }
+
+    // Command buffers using the same pipeline may be translated on several threads at once,
+    // compile without holding the lock and keep whichever pipeline gets published first
+    VkPipeline newPipeline = getVkPipeline(grPipeline, depthFormat, stencilFormat, NULL);
+    if (newPipeline == VK_NULL_HANDLE) {
+        return VK_NULL_HANDLE;
+    }
+
+    AcquireSRWLockExclusive(&grPipeline->variantLock);
+
+    if (grPipeline->pipeline == VK_NULL_HANDLE) {
+        grPipeline->pipeline = newPipeline;
+        newPipeline = VK_NULL_HANDLE;
+    }
+    vkPipeline = grPipeline->pipeline;
+
+    ReleaseSRWLockExclusive(&grPipeline->variantLock);
+
+    if (newPipeline != VK_NULL_HANDLE) {
+        // Lost the race
+        VKD.vkDestroyPipeline(grDevice->device, newPipeline, NULL);
+    }
+
+    return vkPipeline;
+}
+
+VkPipeline grPipelineGetSpecializedVkPipeline(
+    GrPipeline* grPipeline,
+    VkFormat depthFormat,
+    VkFormat stencilFormat,
+    const uint32_t* strides)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    VkPipeline vkPipeline = VK_NULL_HANDLE;
+    uint32_t variantStrides[ILC_MAX_STRIDE_CONSTANTS] = { 0 };
+
+    // Only the strides used by the vertex shader select a variant
+    for (unsigned i = 0; i < ILC_MAX_STRIDE_CONSTANTS; i++) {
+        if (grPipeline->strideMask & (1u << i)) {
+            if (strides[i] == 0) {
+                // Zero means unspecialized, use push constants
+                return VK_NULL_HANDLE;
+            }
+
+            variantStrides[i] = strides[i];
+        }
+    }
+
+    AcquireSRWLockExclusive(&grPipeline->variantLock);
+    vkPipeline = findPipelineVariant(grPipeline, variantStrides);
+    bool isFull = grPipeline->variantCount == MAX_PIPELINE_VARIANTS;
+    ReleaseSRWLockExclusive(&grPipeline->variantLock);
+
+    if (vkPipeline != VK_NULL_HANDLE || isFull) {
+        return vkPipeline;
+    }
+
+    VkSpecializationMapEntry mapEntries[ILC_MAX_STRIDE_CONSTANTS];
+
+    for (unsigned i = 0; i < ILC_MAX_STRIDE_CONSTANTS; i++) {
+        mapEntries[i] = (VkSpecializationMapEntry) {
+            .constantID = i,
+            .offset = i * sizeof(uint32_t),
+            .size = sizeof(uint32_t),
+        };
+    }
+
+    const VkSpecializationInfo specializationInfo = {
+        .mapEntryCount = COUNT_OF(mapEntries),
+        .pMapEntries = mapEntries,
+        .dataSize = sizeof(variantStrides),
+        .pData = variantStrides,
+    };
+
+    // Compile without holding the lock, other threads keep drawing with existing variants
+    VkPipeline newPipeline = getVkPipeline(grPipeline, depthFormat, stencilFormat,
+                                           &specializationInfo);
+    if (newPipeline == VK_NULL_HANDLE) {
+        return VK_NULL_HANDLE;
+    }
+
+    AcquireSRWLockExclusive(&grPipeline->variantLock);
+
+    // Another thread may have compiled the same variant in the meantime
+    vkPipeline = findPipelineVariant(grPipeline, variantStrides);
+
+    if (vkPipeline == VK_NULL_HANDLE && grPipeline->variantCount < MAX_PIPELINE_VARIANTS) {
+        PipelineVariant* variant = &grPipeline->variants[grPipeline->variantCount];
+
+        memcpy(variant->strides, variantStrides, sizeof(variantStrides));
+        variant->pipeline = newPipeline;
+        grPipeline->variantCount++;
+        vkPipeline = newPipeline;
+        newPipeline = VK_NULL_HANDLE;
+
+        if (grPipeline->variantCount == MAX_PIPELINE_VARIANTS) {
+            LOGD("pipeline %p reached %d stride variants, falling back to push constants\n",
+                 grPipeline, MAX_PIPELINE_VARIANTS);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&grPipeline->variantLock);
+
+    if (newPipeline != VK_NULL_HANDLE) {
+        // Lost the race or ran out of variant slots
+        VKD.vkDestroyPipeline(grDevice->device, newPipeline, NULL);
+    }
+
     return vkPipeline;
 }
 
@@ -631,7 +1094,9 @@ GR_RESULT GR_STDCALL grCreateShader(
 
     // ALLOW_RE_Z flag doesn't have a Vulkan equivalent. RADV determines it automatically.
 
+    uint64_t startTime = profilerGetTime();
     IlcShader ilcShader = ilcCompileShader(pCreateInfo->pCode, pCreateInfo->codeSize);
+    uint64_t translateTime = profilerGetTime();
 
     const VkShaderModuleCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -642,6 +1107,7 @@ GR_RESULT GR_STDCALL grCreateShader(
     };
 
     VkResult res = VKD.vkCreateShaderModule(grDevice->device, &createInfo, NULL, &vkShaderModule);
+    uint64_t moduleTime = profilerGetTime();
     if (res != VK_SUCCESS) {
         LOGE("vkCreateShaderModule failed (%d)\n", res);
         free(ilcShader.code);
@@ -663,8 +1129,24 @@ GR_RESULT GR_STDCALL grCreateShader(
         .inputCount = ilcShader.inputCount,
         .inputs = ilcShader.inputs,
         .name = ilcShader.name,
+        .translateTime = translateTime - startTime,
+        .moduleTime = moduleTime - translateTime,
     };
 
+    const ProfilerPipelineEvent profilerEvent = {
+        .type = PROFILER_SHADER,
+        .object = grShader,
+        .shaderNames = { grShader->name },
+        .translateTime = grShader->translateTime,
+        .moduleTime = grShader->moduleTime,
+        .setupTime = 0,
+        .compileTime = 0,
+        .isRenderThread = GetCurrentThreadId() == grDevice->renderThreadId,
+        .isCacheHit = false,
+    };
+
+    profilerAddPipelineEvent(&profilerEvent);
+
     *pShader = (GR_SHADER)grShader;
     return GR_SUCCESS;
 }
@@ -682,8 +1164,11 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
     VkShaderModule rectangleShaderModule = VK_NULL_HANDLE;
     unsigned dynamicOffsetCount = 0;
-    unsigned updateTemplateSlotCounts[GR_MAX_DESCRIPTOR_SETS] = { 0 };
-    UpdateTemplateSlot* updateTemplateSlots[GR_MAX_DESCRIPTOR_SETS] = { NULL };
+    bool usePushDescriptors = false;
+    uint32_t descriptorCounts[DESCRIPTOR_TYPE_COUNT] = { 0 };
+    unsigned layoutBindingCount = 0;
+    VkDescriptorSetLayoutBinding* layoutBindings = NULL;
+    UpdateTemplateSlotList* updateTemplateSlotLists[GR_MAX_DESCRIPTOR_SETS] = { NULL };
     GrShader* grShaderRefs[MAX_STAGE_COUNT] = { NULL };
     VkResult vkRes;
 
@@ -694,6 +1179,8 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
     // - iaState.disableVertexReuse (hint)
     // - tessState.optimalTessFactor (hint)
 
+    uint64_t startTime = profilerGetTime();
+
     Stage stages[MAX_STAGE_COUNT] = {
         { &pCreateInfo->vs, VK_SHADER_STAGE_VERTEX_BIT },
         { &pCreateInfo->hs, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT },
@@ -819,8 +1306,13 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
     memcpy(pipelineCreateInfo->colorWriteMasks, colorWriteMasks,
            GR_MAX_COLOR_TARGETS * sizeof(VkColorComponentFlags));
 
-    descriptorSetLayout = getVkDescriptorSetLayout(&dynamicOffsetCount, grDevice,
-                                                   COUNT_OF(stages), stages);
+    layoutBindings = getDescriptorSetLayoutBindings(&layoutBindingCount, &dynamicOffsetCount,
+                                                    COUNT_OF(stages), stages);
+    getDescriptorCounts(descriptorCounts, layoutBindingCount, layoutBindings);
+    usePushDescriptors = canUsePushDescriptors(grDevice, layoutBindingCount, layoutBindings,
+                                               dynamicOffsetCount);
+    descriptorSetLayout = getVkDescriptorSetLayout(grDevice, layoutBindingCount, layoutBindings,
+                                                   usePushDescriptors);
     if (descriptorSetLayout == VK_NULL_HANDLE) {
         res = GR_ERROR_OUT_OF_MEMORY;
         goto bail;
@@ -834,8 +1326,30 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
     }
 
     for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        getUpdateTemplateSlots(&updateTemplateSlotCounts[i], &updateTemplateSlots[i],
-                               grDevice, COUNT_OF(stages), stages, i, descriptorSetLayout);
+        updateTemplateSlotLists[i] =
+            getUpdateTemplateSlotList(grDevice, layoutBindingCount, layoutBindings,
+                                      COUNT_OF(stages), stages, i, descriptorSetLayout,
+                                      VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                      usePushDescriptors ? pipelineLayout : VK_NULL_HANDLE);
+    }
+
+    free(layoutBindings);
+
+    // Keep track of the strides that can be specialized
+    uint32_t strideMask = 0;
+    bool isTemplateCacheHit = true;
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        const UpdateTemplateSlotList* slotList = updateTemplateSlotLists[i];
+
+        isTemplateCacheHit &= slotList->refCount > 1;
+
+        for (unsigned j = 0; j < slotList->slotCount; j++) {
+            const UpdateTemplateSlot* slot = &slotList->slots[j];
+
+            for (unsigned k = 0; k < slot->strideCount; k++) {
+                strideMask |= 1u << (slot->strideOffsets[k] / sizeof(uint32_t));
+            }
+        }
     }
 
     // TODO keep track of rectangle shader module
@@ -850,20 +1364,28 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         .stageCount = COUNT_OF(stages),
         .descriptorSetLayout = descriptorSetLayout,
         .dynamicOffsetCount = dynamicOffsetCount,
-        .updateTemplateSlotCounts = { 0 }, // Initialized below
-        .updateTemplateSlots = { NULL }, // Initialized below
+        .usePushDescriptors = usePushDescriptors,
+        .descriptorCounts = { 0 }, // Initialized below
+        .updateTemplateSlotLists = { NULL }, // Initialized below
+        .strideMask = grDevice->specializeStrides ? strideMask : 0,
+        .variantLock = SRWLOCK_INIT,
+        .variantCount = 0,
+        .variants = { { { 0 } } },
     };
 
     memcpy(grPipeline->grShaderRefs, grShaderRefs, sizeof(grPipeline->grShaderRefs));
-    memcpy(grPipeline->updateTemplateSlotCounts, updateTemplateSlotCounts,
-           sizeof(grPipeline->updateTemplateSlotCounts));
-    memcpy(grPipeline->updateTemplateSlots, updateTemplateSlots,
-           sizeof(grPipeline->updateTemplateSlots));
+    memcpy(grPipeline->updateTemplateSlotLists, updateTemplateSlotLists,
+           sizeof(grPipeline->updateTemplateSlotLists));
+    memcpy(grPipeline->descriptorCounts, descriptorCounts, sizeof(grPipeline->descriptorCounts));
+
+    addPipelineProfilerEvent(grPipeline, PROFILER_GRAPHICS_PIPELINE,
+                             profilerGetTime() - startTime, 0, isTemplateCacheHit);
 
     *pPipeline = (GR_PIPELINE)grPipeline;
     return GR_SUCCESS;
 
 bail:
+    free(layoutBindings);
     VKD.vkDestroyDescriptorSetLayout(grDevice->device, descriptorSetLayout, NULL);
     VKD.vkDestroyPipelineLayout(grDevice->device, pipelineLayout, NULL);
     VKD.vkDestroyShaderModule(grDevice->device, rectangleShaderModule, NULL);
@@ -883,11 +1405,16 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
     VkPipeline pipeline = VK_NULL_HANDLE;
     unsigned dynamicOffsetCount = 0;
-    unsigned updateTemplateSlotCounts[GR_MAX_DESCRIPTOR_SETS] = { 0 };
-    UpdateTemplateSlot* updateTemplateSlots[GR_MAX_DESCRIPTOR_SETS] = { NULL };
+    bool usePushDescriptors = false;
+    uint32_t descriptorCounts[DESCRIPTOR_TYPE_COUNT] = { 0 };
+    unsigned layoutBindingCount = 0;
+    VkDescriptorSetLayoutBinding* layoutBindings = NULL;
+    UpdateTemplateSlotList* updateTemplateSlotLists[GR_MAX_DESCRIPTOR_SETS] = { NULL };
 
     // TODO validate parameters
 
+    uint64_t startTime = profilerGetTime();
+
     Stage stage = { &pCreateInfo->cs, VK_SHADER_STAGE_COMPUTE_BIT };
 
     if (stage.shader->linkConstBufferCount > 0) {
@@ -909,7 +1436,13 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
         .pSpecializationInfo = NULL,
     };
 
-    descriptorSetLayout = getVkDescriptorSetLayout(&dynamicOffsetCount, grDevice, 1, &stage);
+    layoutBindings = getDescriptorSetLayoutBindings(&layoutBindingCount, &dynamicOffsetCount,
+                                                    1, &stage);
+    getDescriptorCounts(descriptorCounts, layoutBindingCount, layoutBindings);
+    usePushDescriptors = canUsePushDescriptors(grDevice, layoutBindingCount, layoutBindings,
+                                               dynamicOffsetCount);
+    descriptorSetLayout = getVkDescriptorSetLayout(grDevice, layoutBindingCount, layoutBindings,
+                                                   usePushDescriptors);
     if (descriptorSetLayout == VK_NULL_HANDLE) {
         res = GR_ERROR_OUT_OF_MEMORY;
         goto bail;
@@ -923,10 +1456,23 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
     }
 
     for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        getUpdateTemplateSlots(&updateTemplateSlotCounts[i], &updateTemplateSlots[i],
-                               grDevice, 1, &stage, i, descriptorSetLayout);
+        updateTemplateSlotLists[i] =
+            getUpdateTemplateSlotList(grDevice, layoutBindingCount, layoutBindings,
+                                      1, &stage, i, descriptorSetLayout,
+                                      VK_PIPELINE_BIND_POINT_COMPUTE,
+                                      usePushDescriptors ? pipelineLayout : VK_NULL_HANDLE);
+    }
+
+    free(layoutBindings);
+    layoutBindings = NULL;
+
+    bool isTemplateCacheHit = true;
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        isTemplateCacheHit &= updateTemplateSlotLists[i]->refCount > 1;
     }
 
+    uint64_t setupTime = profilerGetTime();
+
     const VkComputePipelineCreateInfo pipelineCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
         .pNext = NULL,
@@ -940,6 +1486,7 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
 
     vkRes = VKD.vkCreateComputePipelines(grDevice->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
                                          NULL, &pipeline);
+    uint64_t compileTime = profilerGetTime();
     if (vkRes != VK_SUCCESS) {
         LOGE("vkCreateComputePipelines failed (%d)\n", vkRes);
         res = getGrResult(vkRes);
@@ -957,19 +1504,32 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
         .stageCount = 1,
         .descriptorSetLayout = descriptorSetLayout,
         .dynamicOffsetCount = dynamicOffsetCount,
-        .updateTemplateSlotCounts = { 0 }, // Initialized below
-        .updateTemplateSlots = { NULL }, // Initialized below
+        .usePushDescriptors = usePushDescriptors,
+        .descriptorCounts = { 0 }, // Initialized below
+        .updateTemplateSlotLists = { NULL }, // Initialized below
+        .strideMask = 0,
+        .variantLock = SRWLOCK_INIT,
+        .variantCount = 0,
+        .variants = { { { 0 } } },
     };
 
-    memcpy(grPipeline->updateTemplateSlotCounts, updateTemplateSlotCounts,
-           sizeof(grPipeline->updateTemplateSlotCounts));
-    memcpy(grPipeline->updateTemplateSlots, updateTemplateSlots,
-           sizeof(grPipeline->updateTemplateSlots));
+    memcpy(grPipeline->updateTemplateSlotLists, updateTemplateSlotLists,
+           sizeof(grPipeline->updateTemplateSlotLists));
+    memcpy(grPipeline->descriptorCounts, descriptorCounts, sizeof(grPipeline->descriptorCounts));
+
+    addPipelineProfilerEvent(grPipeline, PROFILER_COMPUTE_PIPELINE, setupTime - startTime,
+                             compileTime - setupTime, isTemplateCacheHit);
 
     *pPipeline = (GR_PIPELINE)grPipeline;
     return GR_SUCCESS;
 
 bail:
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        if (updateTemplateSlotLists[i] != NULL) {
+            grDeviceReleaseUpdateTemplateSlotList(grDevice, updateTemplateSlotLists[i]);
+        }
+    }
+    free(layoutBindings);
     VKD.vkDestroyDescriptorSetLayout(grDevice->device, descriptorSetLayout, NULL);
     VKD.vkDestroyPipelineLayout(grDevice->device, pipelineLayout, NULL);
     return res;
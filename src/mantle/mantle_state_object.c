@@ -1,5 +1,121 @@
 #include "mantle_internal.h"
 
+static StateObjectCacheEntry** getStateObjectKeyBucket(
+    GrDevice* grDevice,
+    uint64_t hash)
+{
+    return &grDevice->stateObjectKeyBuckets[hash % STATE_OBJECT_BUCKET_COUNT];
+}
+
+static StateObjectCacheEntry** getStateObjectBucket(
+    GrDevice* grDevice,
+    const GrObject* grObject)
+{
+    uint64_t hash = getHash(&grObject, sizeof(grObject));
+
+    return &grDevice->stateObjectBuckets[hash % STATE_OBJECT_BUCKET_COUNT];
+}
+
+static GrObject* findStateObject(
+    GrDevice* grDevice,
+    GrObjectType objType,
+    uint64_t hash,
+    unsigned keySize,
+    const void* key)
+{
+    GrObject* grObject = NULL;
+
+    AcquireSRWLockExclusive(&grDevice->stateObjectLock);
+
+    for (StateObjectCacheEntry* entry = *getStateObjectKeyBucket(grDevice, hash);
+         entry != NULL; entry = entry->nextByKey) {
+        if (entry->hash == hash && entry->keySize == keySize &&
+            GET_OBJ_TYPE(entry->grObject) == objType &&
+            memcmp(entry->key, key, keySize) == 0) {
+            entry->refCount++;
+            grObject = entry->grObject;
+            break;
+        }
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->stateObjectLock);
+
+    return grObject;
+}
+
+static void addStateObject(
+    GrDevice* grDevice,
+    GrObject* grObject,
+    uint64_t hash,
+    unsigned keySize,
+    const void* key)
+{
+    StateObjectCacheEntry* entry = malloc(sizeof(StateObjectCacheEntry));
+    void* keyCopy = malloc(keySize);
+    memcpy(keyCopy, key, keySize);
+
+    AcquireSRWLockExclusive(&grDevice->stateObjectLock);
+
+    StateObjectCacheEntry** keyBucket = getStateObjectKeyBucket(grDevice, hash);
+    StateObjectCacheEntry** bucket = getStateObjectBucket(grDevice, grObject);
+
+    *entry = (StateObjectCacheEntry) {
+        .grObject = grObject,
+        .refCount = 1,
+        .hash = hash,
+        .keySize = keySize,
+        .key = keyCopy,
+        .nextByKey = *keyBucket,
+        .nextByObject = *bucket,
+    };
+    *keyBucket = entry;
+    *bucket = entry;
+
+    ReleaseSRWLockExclusive(&grDevice->stateObjectLock);
+}
+
+bool grDeviceReleaseStateObject(
+    GrDevice* grDevice,
+    GrObject* grObject)
+{
+    StateObjectCacheEntry* removedEntry = NULL;
+    bool isLastRef = true;
+
+    AcquireSRWLockExclusive(&grDevice->stateObjectLock);
+
+    for (StateObjectCacheEntry** link = getStateObjectBucket(grDevice, grObject);
+         *link != NULL; link = &(*link)->nextByObject) {
+        StateObjectCacheEntry* entry = *link;
+
+        if (entry->grObject == grObject) {
+            if (--entry->refCount > 0) {
+                isLastRef = false;
+            } else {
+                // Unlink entry from both indices
+                *link = entry->nextByObject;
+
+                StateObjectCacheEntry** keyLink = getStateObjectKeyBucket(grDevice, entry->hash);
+                while (*keyLink != entry) {
+                    keyLink = &(*keyLink)->nextByKey;
+                }
+                *keyLink = entry->nextByKey;
+
+                removedEntry = entry;
+            }
+            break;
+        }
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->stateObjectLock);
+
+    if (removedEntry != NULL) {
+        free(removedEntry->key);
+        free(removedEntry);
+    }
+
+    return isLastRef;
+}
+
 // State Object Functions
 
 GR_RESULT GR_STDCALL grCreateViewportState(
@@ -20,6 +136,21 @@ GR_RESULT GR_STDCALL grCreateViewportState(
         return GR_ERROR_INVALID_VALUE;
     }
 
+    // Identical states share the same object, unused viewports are left out of the key
+    GR_VIEWPORT_STATE_CREATE_INFO key = { 0 };
+    key.viewportCount = pCreateInfo->viewportCount;
+    key.scissorEnable = pCreateInfo->scissorEnable;
+    memcpy(key.viewports, pCreateInfo->viewports, key.viewportCount * sizeof(GR_VIEWPORT));
+    memcpy(key.scissors, pCreateInfo->scissors, key.viewportCount * sizeof(GR_RECT));
+
+    uint64_t hash = getHash(&key, sizeof(key));
+    GrObject* grObject = findStateObject(grDevice, GR_OBJ_TYPE_VIEWPORT_STATE_OBJECT, hash,
+                                         sizeof(key), &key);
+    if (grObject != NULL) {
+        *pState = (GR_VIEWPORT_STATE_OBJECT)grObject;
+        return GR_SUCCESS;
+    }
+
     VkViewport *vkViewports = malloc(sizeof(VkViewport) * pCreateInfo->viewportCount);
     for (int i = 0; i < pCreateInfo->viewportCount; i++) {
         const GR_VIEWPORT* viewport = &pCreateInfo->viewports[i];
@@ -87,6 +218,8 @@ GR_RESULT GR_STDCALL grCreateViewportState(
         .scissorCount = pCreateInfo->viewportCount,
     };
 
+    addStateObject(grDevice, &grViewportStateObject->grObj, hash, sizeof(key), &key);
+
     *pState = (GR_VIEWPORT_STATE_OBJECT)grViewportStateObject;
     return GR_SUCCESS;
 }
@@ -101,6 +234,15 @@ GR_RESULT GR_STDCALL grCreateRasterState(
 
     // TODO validate args
 
+    // Identical states share the same object
+    uint64_t hash = getHash(pCreateInfo, sizeof(*pCreateInfo));
+    GrObject* grObject = findStateObject(grDevice, GR_OBJ_TYPE_RASTER_STATE_OBJECT, hash,
+                                         sizeof(*pCreateInfo), pCreateInfo);
+    if (grObject != NULL) {
+        *pState = (GR_RASTER_STATE_OBJECT)grObject;
+        return GR_SUCCESS;
+    }
+
     GrRasterStateObject* grRasterStateObject = malloc(sizeof(GrRasterStateObject));
 
     *grRasterStateObject = (GrRasterStateObject) {
@@ -113,6 +255,8 @@ GR_RESULT GR_STDCALL grCreateRasterState(
         .depthBiasSlopeFactor = pCreateInfo->slopeScaledDepthBias,
     };
 
+    addStateObject(grDevice, &grRasterStateObject->grObj, hash, sizeof(*pCreateInfo), pCreateInfo);
+
     *pState = (GR_RASTER_STATE_OBJECT)grRasterStateObject;
     return GR_SUCCESS;
 }
@@ -127,6 +271,15 @@ GR_RESULT GR_STDCALL grCreateColorBlendState(
 
     // TODO validate args
 
+    // Identical states share the same object
+    uint64_t hash = getHash(pCreateInfo, sizeof(*pCreateInfo));
+    GrObject* grObject = findStateObject(grDevice, GR_OBJ_TYPE_COLOR_BLEND_STATE_OBJECT, hash,
+                                         sizeof(*pCreateInfo), pCreateInfo);
+    if (grObject != NULL) {
+        *pState = (GR_COLOR_BLEND_STATE_OBJECT)grObject;
+        return GR_SUCCESS;
+    }
+
     GrColorBlendStateObject* grColorBlendStateObject =
         malloc(sizeof(GrColorBlendStateObject));
 
@@ -166,6 +319,9 @@ GR_RESULT GR_STDCALL grCreateColorBlendState(
         }
     }
 
+    addStateObject(grDevice, &grColorBlendStateObject->grObj, hash, sizeof(*pCreateInfo),
+                   pCreateInfo);
+
     *pState = (GR_COLOR_BLEND_STATE_OBJECT)grColorBlendStateObject;
     return GR_SUCCESS;
 }
@@ -180,6 +336,15 @@ GR_RESULT GR_STDCALL grCreateDepthStencilState(
 
     // TODO validate args
 
+    // Identical states share the same object
+    uint64_t hash = getHash(pCreateInfo, sizeof(*pCreateInfo));
+    GrObject* grObject = findStateObject(grDevice, GR_OBJ_TYPE_DEPTH_STENCIL_STATE_OBJECT, hash,
+                                         sizeof(*pCreateInfo), pCreateInfo);
+    if (grObject != NULL) {
+        *pState = (GR_DEPTH_STENCIL_STATE_OBJECT)grObject;
+        return GR_SUCCESS;
+    }
+
     GrDepthStencilStateObject* grDepthStencilStateObject =
         malloc(sizeof(GrDepthStencilStateObject));
 
@@ -212,6 +377,9 @@ GR_RESULT GR_STDCALL grCreateDepthStencilState(
         .maxDepthBounds = pCreateInfo->maxDepth,
     };
 
+    addStateObject(grDevice, &grDepthStencilStateObject->grObj, hash, sizeof(*pCreateInfo),
+                   pCreateInfo);
+
     *pState = (GR_DEPTH_STENCIL_STATE_OBJECT)grDepthStencilStateObject;
     return GR_SUCCESS;
 }
@@ -226,6 +394,15 @@ GR_RESULT GR_STDCALL grCreateMsaaState(
 
     // TODO validate args
 
+    // Identical states share the same object
+    uint64_t hash = getHash(pCreateInfo, sizeof(*pCreateInfo));
+    GrObject* grObject = findStateObject(grDevice, GR_OBJ_TYPE_MSAA_STATE_OBJECT, hash,
+                                         sizeof(*pCreateInfo), pCreateInfo);
+    if (grObject != NULL) {
+        *pState = (GR_MSAA_STATE_OBJECT)grObject;
+        return GR_SUCCESS;
+    }
+
     GrMsaaStateObject* grMsaaStateObject = malloc(sizeof(GrMsaaStateObject));
     *grMsaaStateObject = (GrMsaaStateObject) {
         .grObj = { GR_OBJ_TYPE_MSAA_STATE_OBJECT, grDevice },
@@ -233,6 +410,8 @@ GR_RESULT GR_STDCALL grCreateMsaaState(
         .sampleMask = pCreateInfo->sampleMask,
     };
 
+    addStateObject(grDevice, &grMsaaStateObject->grObj, hash, sizeof(*pCreateInfo), pCreateInfo);
+
     *pState = (GR_MSAA_STATE_OBJECT)grMsaaStateObject;
     return GR_SUCCESS;
 }
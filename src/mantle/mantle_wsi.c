@@ -582,6 +582,8 @@ GR_RESULT GR_STDCALL grWsiWinQueuePresent(
 
     // TODO validate args
 
+    profilerEndFrame();
+
     GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
     GrImage* srcGrImage = (GrImage*)pPresentInfo->srcImage;
 
@@ -627,27 +629,17 @@ GR_RESULT GR_STDCALL grWsiWinQueuePresent(
         return GR_SUCCESS;
     }
 
-    VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    const VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pNext = NULL,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &acquireSemaphore,
-        .pWaitDstStageMask = &stageMask,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &vkCopyCommandBuffer,
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &copySemaphore,
-    };
-
-    AcquireSRWLockExclusive(&grQueue->queueLock);
-    vkRes = VKD.vkQueueSubmit(grQueue->queue, 1, &submitInfo, VK_NULL_HANDLE);
-    ReleaseSRWLockExclusive(&grQueue->queueLock);
+    // Queued behind previous submissions, also carries the queue semaphore waits held so far
+    vkRes = grQueueSubmitVkCommandBuffers(grQueue, 1, &vkCopyCommandBuffer, acquireSemaphore,
+                                          copySemaphore, 0, 0);
     if (vkRes != VK_SUCCESS) {
-        LOGE("vkQueueSubmit failed (%d)\n", vkRes);
         return getGrResult(vkRes);
     }
 
+    // The copy must be submitted before the present, wait for the submission thread to get
+    // past it (not for the GPU)
+    grQueueFlushSubmissions(grQueue);
+
     const VkPresentInfoKHR vkPresentInfo = {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .pNext = NULL,
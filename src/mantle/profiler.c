@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include "profiler.h"
+
+#define SHADER_NAMES_LEN    (MAX_STAGE_COUNT * 64)
+
+typedef struct {
+    ProfilerPipelineEventType type;
+    const void* object;
+    char shaderNames[SHADER_NAMES_LEN];
+    uint64_t translateTime;
+    uint64_t moduleTime;
+    uint64_t setupTime;
+    uint64_t compileTime;
+    bool isRenderThread;
+    bool isCacheHit;
+} PipelineRecord;
+
+static const char* mPipelineEventTypeNames[] = {
+    [PROFILER_SHADER] = "shader",
+    [PROFILER_GRAPHICS_PIPELINE] = "graphics",
+    [PROFILER_GRAPHICS_PIPELINE_COMPILE] = "graphics_compile",
+    [PROFILER_COMPUTE_PIPELINE] = "compute",
+};
+
+static const char* mCommandNames[] = {
+    [CMD_BIND_PIPELINE] = "grCmdBindPipeline",
+    [CMD_BIND_STATE_OBJECT] = "grCmdBindStateObject",
+    [CMD_BIND_DESCRIPTOR_SET] = "grCmdBindDescriptorSet",
+    [CMD_BIND_DYNAMIC_MEMORY_VIEW] = "grCmdBindDynamicMemoryView",
+    [CMD_BIND_INDEX_DATA] = "grCmdBindIndexData",
+    [CMD_BIND_TARGETS] = "grCmdBindTargets",
+    [CMD_PREPARE_MEMORY_REGIONS] = "grCmdPrepareMemoryRegions",
+    [CMD_PREPARE_IMAGES] = "grCmdPrepareImages",
+    [CMD_DRAW] = "grCmdDraw",
+    [CMD_DRAW_INDEXED] = "grCmdDrawIndexed",
+    [CMD_DRAW_INDIRECT] = "grCmdDrawIndirect",
+    [CMD_DRAW_INDEXED_INDIRECT] = "grCmdDrawIndexedIndirect",
+    [CMD_DISPATCH] = "grCmdDispatch",
+    [CMD_DISPATCH_INDIRECT] = "grCmdDispatchIndirect",
+    [CMD_COPY_MEMORY] = "grCmdCopyMemory",
+    [CMD_COPY_IMAGE] = "grCmdCopyImage",
+    [CMD_COPY_MEMORY_TO_IMAGE] = "grCmdCopyMemoryToImage",
+    [CMD_COPY_IMAGE_TO_MEMORY] = "grCmdCopyImageToMemory",
+    [CMD_RESOLVE_IMAGE] = "grCmdResolveImage",
+    [CMD_CLONE_IMAGE_DATA] = "grCmdCloneImageData",
+    [CMD_UPDATE_MEMORY] = "grCmdUpdateMemory",
+    [CMD_FILL_MEMORY] = "grCmdFillMemory",
+    [CMD_CLEAR_COLOR_IMAGE] = "grCmdClearColorImage",
+    [CMD_CLEAR_COLOR_IMAGE_RAW] = "grCmdClearColorImageRaw",
+    [CMD_CLEAR_DEPTH_STENCIL] = "grCmdClearDepthStencil",
+    [CMD_SET_EVENT] = "grCmdSetEvent",
+    [CMD_RESET_EVENT] = "grCmdResetEvent",
+    [CMD_BEGIN_QUERY] = "grCmdBeginQuery",
+    [CMD_END_QUERY] = "grCmdEndQuery",
+    [CMD_RESET_QUERY_POOL] = "grCmdResetQueryPool",
+    [CMD_WRITE_TIMESTAMP] = "grCmdWriteTimestamp",
+    [CMD_INIT_ATOMIC_COUNTERS] = "grCmdInitAtomicCounters",
+    [CMD_SAVE_ATOMIC_COUNTERS] = "grCmdSaveAtomicCounters",
+};
+
+static const char* mCounterNames[] = {
+    [CMD_COUNTER_DESCRIPTOR_UPDATE] = "descriptor_update",
+    [CMD_COUNTER_PIPELINE_BIND] = "pipeline_bind",
+    [CMD_COUNTER_RENDERING_BEGIN] = "rendering_begin",
+    [CMD_COUNTER_RENDERING_END] = "rendering_end",
+    [CMD_COUNTER_DYNAMIC_STATE_EMITTED] = "dynamic_state_emitted",
+    [CMD_COUNTER_DYNAMIC_STATE_SKIPPED] = "dynamic_state_skipped",
+    [CMD_COUNTER_BARRIER_EMITTED] = "barrier_emitted",
+    [CMD_COUNTER_BARRIER_DROPPED] = "barrier_dropped",
+    [CMD_COUNTER_BARRIER_BATCH] = "barrier_batch",
+    [CMD_COUNTER_TIMESTAMP_COPY] = "timestamp_copy",
+    [CMD_COUNTER_COPY_COMMAND] = "copy_command",
+    [CMD_COUNTER_COPY_BATCHED] = "copy_batched",
+    [CMD_COUNTER_COPY_REGION_MERGED] = "copy_region_merged",
+    [CMD_COUNTER_UPLOAD_RING_BYTES] = "upload_ring_bytes",
+    [CMD_COUNTER_INLINE_UPDATE_BYTES] = "inline_update_bytes",
+};
+
+static const char* mReportPath = NULL;
+static uint64_t mSummaryInterval = 0;
+static uint64_t mFrequency = 0;
+static SRWLOCK mPipelineRecordsLock = SRWLOCK_INIT;
+static unsigned mPipelineRecordCount = 0;
+static PipelineRecord* mPipelineRecords = NULL;
+static unsigned mSummaryRecordIndex = 0;
+static uint64_t mLastSummaryTime = 0;
+static FILE* mCommandStatsFile = NULL;
+static SRWLOCK mCommandStatsLock = SRWLOCK_INIT;
+static CmdStats mFrameCommandStats;
+static unsigned mFrameIndex = 0;
+
+static void logSummary(
+    uint64_t now)
+{
+    unsigned renderThreadCount = 0;
+    unsigned cacheHitCount = 0;
+    uint64_t totalTime = 0;
+    uint64_t maxTime = 0;
+
+    for (unsigned i = mSummaryRecordIndex; i < mPipelineRecordCount; i++) {
+        const PipelineRecord* record = &mPipelineRecords[i];
+        uint64_t time = record->translateTime + record->moduleTime +
+                        record->setupTime + record->compileTime;
+
+        renderThreadCount += record->isRenderThread;
+        cacheHitCount += record->isCacheHit;
+        totalTime += time;
+        maxTime = MAX(maxTime, time);
+    }
+
+    LOGI("%u pipeline events in the last %llus: total %llums, max %llums, "
+         "%u on render thread, %u cache hits\n",
+         mPipelineRecordCount - mSummaryRecordIndex, (now - mLastSummaryTime) / 1000000,
+         totalTime / 1000, maxTime / 1000, renderThreadCount, cacheHitCount);
+
+    mSummaryRecordIndex = mPipelineRecordCount;
+    mLastSummaryTime = now;
+}
+
+static void writeCsvReport(
+    FILE* file)
+{
+    fprintf(file, "type,object,shaders,translate_us,module_us,setup_us,compile_us,"
+                  "render_thread,cache_hit\n");
+
+    for (unsigned i = 0; i < mPipelineRecordCount; i++) {
+        const PipelineRecord* record = &mPipelineRecords[i];
+
+        fprintf(file, "%s,%p,%s,%llu,%llu,%llu,%llu,%d,%d\n",
+                mPipelineEventTypeNames[record->type], record->object, record->shaderNames,
+                record->translateTime, record->moduleTime, record->setupTime,
+                record->compileTime, record->isRenderThread, record->isCacheHit);
+    }
+}
+
+static void writeJsonString(
+    FILE* file,
+    const char* str)
+{
+    fputc('"', file);
+
+    for (const char* c = str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)*c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+static void writeJsonReport(
+    FILE* file)
+{
+    fprintf(file, "[\n");
+
+    for (unsigned i = 0; i < mPipelineRecordCount; i++) {
+        const PipelineRecord* record = &mPipelineRecords[i];
+
+        // Shader names come from the application
+        fprintf(file, "  { \"type\": \"%s\", \"object\": \"%p\", \"shaders\": ",
+                mPipelineEventTypeNames[record->type], record->object);
+        writeJsonString(file, record->shaderNames);
+        fprintf(file, ", \"translate_us\": %llu, \"module_us\": %llu, \"setup_us\": %llu, "
+                      "\"compile_us\": %llu, \"render_thread\": %s, \"cache_hit\": %s }%s\n",
+                record->translateTime, record->moduleTime, record->setupTime,
+                record->compileTime, record->isRenderThread ? "true" : "false",
+                record->isCacheHit ? "true" : "false",
+                i + 1 < mPipelineRecordCount ? "," : "");
+    }
+
+    fprintf(file, "]\n");
+}
+
+void profilerInit()
+{
+    const char* pathEnvValue = getenv("GRVK_PIPELINE_STATS_PATH");
+    const char* intervalEnvValue = getenv("GRVK_PIPELINE_STATS_INTERVAL");
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceFrequency(&frequency);
+    mFrequency = frequency.QuadPart;
+
+    if (pathEnvValue != NULL && strlen(pathEnvValue) > 0) {
+        mReportPath = pathEnvValue;
+    }
+    if (intervalEnvValue != NULL) {
+        mSummaryInterval = strtoull(intervalEnvValue, NULL, 10) * 1000000;
+    }
+
+    if (profilerIsEnabled()) {
+        LOGI("pipeline statistics enabled\n");
+        mLastSummaryTime = profilerGetTime();
+    }
+
+    const char* commandStatsEnvValue = getenv("GRVK_COMMAND_STATS_PATH");
+
+    if (mCommandStatsFile == NULL &&
+        commandStatsEnvValue != NULL && strlen(commandStatsEnvValue) > 0) {
+        mCommandStatsFile = fopen(commandStatsEnvValue, "w");
+
+        if (mCommandStatsFile == NULL) {
+            LOGW("failed to open command statistics report %s\n", commandStatsEnvValue);
+        } else {
+            fprintf(mCommandStatsFile, "frame,name,calls,time_us\n");
+            LOGI("command statistics enabled\n");
+        }
+    }
+}
+
+bool profilerIsEnabled()
+{
+    return mReportPath != NULL || mSummaryInterval > 0;
+}
+
+uint64_t profilerGetTime()
+{
+    LARGE_INTEGER counter;
+
+    if (mFrequency == 0) {
+        return 0;
+    }
+
+    // Microseconds, split to avoid overflowing
+    QueryPerformanceCounter(&counter);
+    return (counter.QuadPart / mFrequency) * 1000000 +
+           (counter.QuadPart % mFrequency) * 1000000 / mFrequency;
+}
+
+void profilerAddPipelineEvent(
+    const ProfilerPipelineEvent* event)
+{
+    if (!profilerIsEnabled()) {
+        return;
+    }
+
+    PipelineRecord record = {
+        .type = event->type,
+        .object = event->object,
+        .shaderNames = "", // Initialized below
+        .translateTime = event->translateTime,
+        .moduleTime = event->moduleTime,
+        .setupTime = event->setupTime,
+        .compileTime = event->compileTime,
+        .isRenderThread = event->isRenderThread,
+        .isCacheHit = event->isCacheHit,
+    };
+
+    for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
+        const char* name = event->shaderNames[i];
+        size_t len = strlen(record.shaderNames);
+
+        if (name != NULL) {
+            snprintf(&record.shaderNames[len], SHADER_NAMES_LEN - len, "%s%s",
+                     len > 0 ? " " : "", name);
+        }
+    }
+
+    AcquireSRWLockExclusive(&mPipelineRecordsLock);
+
+    mPipelineRecordCount++;
+    mPipelineRecords = realloc(mPipelineRecords, mPipelineRecordCount * sizeof(PipelineRecord));
+    mPipelineRecords[mPipelineRecordCount - 1] = record;
+
+    if (mSummaryInterval > 0) {
+        uint64_t now = profilerGetTime();
+
+        if (now - mLastSummaryTime >= mSummaryInterval) {
+            logSummary(now);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&mPipelineRecordsLock);
+}
+
+bool profilerIsCommandStatsEnabled()
+{
+    return mCommandStatsFile != NULL;
+}
+
+uint64_t profilerGetCommandTicks()
+{
+    LARGE_INTEGER counter;
+
+    if (mCommandStatsFile == NULL) {
+        return 0;
+    }
+
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+void profilerAddCommandCounter(
+    CmdStats* stats,
+    CmdCounter counter,
+    uint64_t startTicks)
+{
+    if (mCommandStatsFile == NULL) {
+        return;
+    }
+
+    stats->counterCounts[counter]++;
+    stats->counterTicks[counter] += profilerGetCommandTicks() - startTicks;
+}
+
+void profilerAddCommandStats(
+    const CmdStats* stats)
+{
+    if (mCommandStatsFile == NULL) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&mCommandStatsLock);
+
+    for (unsigned i = 0; i < CMD_OPCODE_COUNT; i++) {
+        mFrameCommandStats.commandCounts[i] += stats->commandCounts[i];
+        mFrameCommandStats.commandTicks[i] += stats->commandTicks[i];
+    }
+    for (unsigned i = 0; i < CMD_COUNTER_COUNT; i++) {
+        mFrameCommandStats.counterCounts[i] += stats->counterCounts[i];
+        mFrameCommandStats.counterTicks[i] += stats->counterTicks[i];
+    }
+
+    ReleaseSRWLockExclusive(&mCommandStatsLock);
+}
+
+static void writeCommandStatsRow(
+    const char* name,
+    uint64_t count,
+    uint64_t ticks)
+{
+    if (count == 0) {
+        return;
+    }
+
+    fprintf(mCommandStatsFile, "%u,%s,%llu,%.3f\n",
+            mFrameIndex, name, (unsigned long long)count, (double)ticks * 1000000.0 / mFrequency);
+}
+
+void profilerEndFrame()
+{
+    if (mCommandStatsFile == NULL) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&mCommandStatsLock);
+
+    for (unsigned i = 0; i < CMD_OPCODE_COUNT; i++) {
+        writeCommandStatsRow(mCommandNames[i], mFrameCommandStats.commandCounts[i],
+                             mFrameCommandStats.commandTicks[i]);
+    }
+    for (unsigned i = 0; i < CMD_COUNTER_COUNT; i++) {
+        writeCommandStatsRow(mCounterNames[i], mFrameCommandStats.counterCounts[i],
+                             mFrameCommandStats.counterTicks[i]);
+    }
+
+    memset(&mFrameCommandStats, 0, sizeof(mFrameCommandStats));
+    mFrameIndex++;
+
+    ReleaseSRWLockExclusive(&mCommandStatsLock);
+}
+
+void profilerWriteReport()
+{
+    if (mCommandStatsFile != NULL) {
+        fflush(mCommandStatsFile);
+        LOGI("wrote command statistics for %u frames\n", mFrameIndex);
+    }
+
+    if (mReportPath == NULL) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&mPipelineRecordsLock);
+
+    FILE* file = fopen(mReportPath, "w");
+    if (file == NULL) {
+        LOGW("failed to open pipeline statistics report %s\n", mReportPath);
+    } else {
+        const char* ext = strrchr(mReportPath, '.');
+
+        if (ext != NULL && strcmp(ext, ".json") == 0) {
+            writeJsonReport(file);
+        } else {
+            writeCsvReport(file);
+        }
+
+        fclose(file);
+        LOGI("wrote %u pipeline events to %s\n", mPipelineRecordCount, mReportPath);
+    }
+
+    ReleaseSRWLockExclusive(&mPipelineRecordsLock);
+}
@@ -0,0 +1,50 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include "mantle_internal.h"
+
+typedef enum {
+    PROFILER_SHADER,
+    PROFILER_GRAPHICS_PIPELINE,
+    PROFILER_GRAPHICS_PIPELINE_COMPILE,
+    PROFILER_COMPUTE_PIPELINE,
+} ProfilerPipelineEventType;
+
+typedef struct {
+    ProfilerPipelineEventType type;
+    const void* object;
+    const char* shaderNames[MAX_STAGE_COUNT];
+    uint64_t translateTime; // IL to SPIR-V (us)
+    uint64_t moduleTime; // vkCreateShaderModule (us)
+    uint64_t setupTime; // Layouts and update templates (us)
+    uint64_t compileTime; // vkCreate*Pipelines (us)
+    bool isRenderThread; // Created on the thread that created the device
+    bool isCacheHit; // Reused update templates, variant lookups aren't recorded
+} ProfilerPipelineEvent;
+
+void profilerInit();
+
+bool profilerIsEnabled();
+
+uint64_t profilerGetTime();
+
+void profilerAddPipelineEvent(
+    const ProfilerPipelineEvent* event);
+
+bool profilerIsCommandStatsEnabled();
+
+uint64_t profilerGetCommandTicks();
+
+void profilerAddCommandCounter(
+    CmdStats* stats,
+    CmdCounter counter,
+    uint64_t startTicks);
+
+void profilerAddCommandStats(
+    const CmdStats* stats);
+
+void profilerEndFrame();
+
+void profilerWriteReport();
+
+#endif // PROFILER_H_
@@ -90,26 +90,6 @@ GR_RESULT GR_STDCALL grOpenPeerImage(
 
 // Command Buffer Building Functions
 
-GR_VOID GR_STDCALL grCmdResolveImage(
-    GR_CMD_BUFFER cmdBuffer,
-    GR_IMAGE srcImage,
-    GR_IMAGE destImage,
-    GR_UINT regionCount,
-    const GR_IMAGE_RESOLVE* pRegions)
-{
-    LOGW("STUB\n");
-}
-
-GR_VOID GR_STDCALL grCmdCloneImageData(
-    GR_CMD_BUFFER cmdBuffer,
-    GR_IMAGE srcImage,
-    GR_ENUM srcImageState,
-    GR_IMAGE destImage,
-    GR_ENUM destImageState)
-{
-    LOGW("STUB\n");
-}
-
 GR_VOID GR_STDCALL grCmdMemoryAtomic(
     GR_CMD_BUFFER cmdBuffer,
     GR_GPU_MEMORY destMem,
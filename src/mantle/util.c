@@ -369,6 +369,10 @@ VkImageLayout getVkImageLayout(
         return VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     case GR_IMAGE_STATE_DISCARD:
         return VK_IMAGE_LAYOUT_UNDEFINED;
+    case GR_IMAGE_STATE_RESOLVE_SOURCE:
+        return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    case GR_IMAGE_STATE_RESOLVE_DESTINATION:
+        return VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     default:
         break;
     }
@@ -476,6 +480,10 @@ VkAccessFlags getVkAccessFlagsImage(
         return VK_ACCESS_TRANSFER_WRITE_BIT;
     case GR_IMAGE_STATE_DISCARD:
         return 0;
+    case GR_IMAGE_STATE_RESOLVE_SOURCE:
+        return VK_ACCESS_TRANSFER_READ_BIT;
+    case GR_IMAGE_STATE_RESOLVE_DESTINATION:
+        return VK_ACCESS_TRANSFER_WRITE_BIT;
     default:
         break;
     }
@@ -533,6 +541,8 @@ VkPipelineStageFlags getVkPipelineStageFlagsImage(
                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     case GR_IMAGE_STATE_CLEAR:
+    case GR_IMAGE_STATE_RESOLVE_SOURCE:
+    case GR_IMAGE_STATE_RESOLVE_DESTINATION:
         return VK_PIPELINE_STAGE_TRANSFER_BIT;
     case GR_IMAGE_STATE_DISCARD:
         return VK_PIPELINE_STAGE_NONE;
@@ -1134,3 +1144,18 @@ VkImageSubresourceRange getVkImageSubresourceRange(
                       VK_REMAINING_ARRAY_LAYERS : subresourceRange.arraySize * layerFactor,
     };
 }
+
+uint64_t getHash(
+    const void* data,
+    size_t size)
+{
+    const uint8_t* bytes = data;
+    uint64_t hash = 0xCBF29CE484222325ull; // FNV-1a offset basis
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull; // FNV-1a prime
+    }
+
+    return hash;
+}
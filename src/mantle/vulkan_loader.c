@@ -108,6 +108,7 @@ void vulkanLoaderDeviceInit(
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdFillBuffer);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdNextSubpass);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdPipelineBarrier);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdPipelineBarrier2);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdPushConstants);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdResetEvent);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdResetQueryPool);
@@ -177,6 +178,7 @@ void vulkanLoaderDeviceInit(
     LOAD_VULKAN_DEV_FN(vkd, device, vkGetDeviceQueue);
     LOAD_VULKAN_DEV_FN(vkd, device, vkGetEventStatus);
     LOAD_VULKAN_DEV_FN(vkd, device, vkGetFenceStatus);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkGetSemaphoreCounterValue);
     LOAD_VULKAN_DEV_FN(vkd, device, vkGetImageMemoryRequirements);
     LOAD_VULKAN_DEV_FN(vkd, device, vkGetImageMemoryRequirements2);
     LOAD_VULKAN_DEV_FN(vkd, device, vkGetImageSparseMemoryRequirements);
@@ -190,6 +192,7 @@ void vulkanLoaderDeviceInit(
     LOAD_VULKAN_DEV_FN(vkd, device, vkMergePipelineCaches);
     LOAD_VULKAN_DEV_FN(vkd, device, vkQueueBindSparse);
     LOAD_VULKAN_DEV_FN(vkd, device, vkQueueSubmit);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkQueueSubmit2);
     LOAD_VULKAN_DEV_FN(vkd, device, vkQueueWaitIdle);
     LOAD_VULKAN_DEV_FN(vkd, device, vkResetCommandBuffer);
     LOAD_VULKAN_DEV_FN(vkd, device, vkResetCommandPool);
@@ -201,6 +204,7 @@ void vulkanLoaderDeviceInit(
     LOAD_VULKAN_DEV_FN(vkd, device, vkUpdateDescriptorSetWithTemplate);
     LOAD_VULKAN_DEV_FN(vkd, device, vkUpdateDescriptorSets);
     LOAD_VULKAN_DEV_FN(vkd, device, vkWaitForFences);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkWaitSemaphores);
 
 #ifdef VK_KHR_swapchain
     LOAD_VULKAN_DEV_FN(vkd, device, vkCreateSwapchainKHR);
@@ -213,6 +217,11 @@ void vulkanLoaderDeviceInit(
     LOAD_VULKAN_DEV_FN(vkd, device, vkAcquireNextImage2KHR);
 #endif
 
+#ifdef VK_KHR_push_descriptor
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdPushDescriptorSetKHR);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdPushDescriptorSetWithTemplateKHR);
+#endif
+
 #ifdef VK_EXT_extended_dynamic_state
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdBindVertexBuffers2EXT);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetCullModeEXT);
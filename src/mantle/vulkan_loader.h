@@ -90,6 +90,7 @@ typedef struct _VULKAN_DEVICE {
     VULKAN_FN(vkCmdFillBuffer);
     VULKAN_FN(vkCmdNextSubpass);
     VULKAN_FN(vkCmdPipelineBarrier);
+    VULKAN_FN(vkCmdPipelineBarrier2);
     VULKAN_FN(vkCmdPushConstants);
     VULKAN_FN(vkCmdResetEvent);
     VULKAN_FN(vkCmdResetQueryPool);
@@ -159,6 +160,7 @@ typedef struct _VULKAN_DEVICE {
     VULKAN_FN(vkGetDeviceQueue);
     VULKAN_FN(vkGetEventStatus);
     VULKAN_FN(vkGetFenceStatus);
+    VULKAN_FN(vkGetSemaphoreCounterValue);
     VULKAN_FN(vkGetImageMemoryRequirements);
     VULKAN_FN(vkGetImageMemoryRequirements2);
     VULKAN_FN(vkGetImageSparseMemoryRequirements);
@@ -172,6 +174,7 @@ typedef struct _VULKAN_DEVICE {
     VULKAN_FN(vkMergePipelineCaches);
     VULKAN_FN(vkQueueBindSparse);
     VULKAN_FN(vkQueueSubmit);
+    VULKAN_FN(vkQueueSubmit2);
     VULKAN_FN(vkQueueWaitIdle);
     VULKAN_FN(vkResetCommandBuffer);
     VULKAN_FN(vkResetCommandPool);
@@ -183,6 +186,7 @@ typedef struct _VULKAN_DEVICE {
     VULKAN_FN(vkUpdateDescriptorSets);
     VULKAN_FN(vkUpdateDescriptorSetWithTemplate);
     VULKAN_FN(vkWaitForFences);
+    VULKAN_FN(vkWaitSemaphores);
 
 #ifdef VK_KHR_swapchain
     VULKAN_FN(vkCreateSwapchainKHR);
@@ -195,6 +199,11 @@ typedef struct _VULKAN_DEVICE {
     VULKAN_FN(vkAcquireNextImage2KHR);
 #endif
 
+#ifdef VK_KHR_push_descriptor
+    VULKAN_FN(vkCmdPushDescriptorSetKHR);
+    VULKAN_FN(vkCmdPushDescriptorSetWithTemplateKHR);
+#endif
+
 #ifdef VK_EXT_extended_dynamic_state
     VULKAN_FN(vkCmdBindVertexBuffers2EXT);
     VULKAN_FN(vkCmdSetCullModeEXT);
@@ -0,0 +1,17 @@
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Exit code that tells meson the test was skipped
+#define SKIP_EXIT_CODE (77)
+
+#define CHECK(cond) { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+}
+
+#endif // CHECK_H_
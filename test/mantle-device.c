@@ -0,0 +1,261 @@
+#include <math.h>
+#include "mantle-device.h"
+
+static unsigned findHeap(
+    GR_DEVICE device,
+    const GR_MEMORY_REQUIREMENTS* memReqs,
+    GR_FLAGS heapFlags)
+{
+    for (unsigned i = 0; i < memReqs->heapCount; i++) {
+        GR_MEMORY_HEAP_PROPERTIES heapProps;
+        GR_SIZE heapPropsSize = sizeof(heapProps);
+
+        CHECK(grGetMemoryHeapInfo(device, memReqs->heaps[i], GR_INFO_TYPE_MEMORY_HEAP_PROPERTIES,
+                                  &heapPropsSize, &heapProps) == GR_SUCCESS);
+        if ((heapProps.flags & heapFlags) == heapFlags) {
+            return memReqs->heaps[i];
+        }
+    }
+
+    fprintf(stderr, "no heap with flags 0x%X\n", heapFlags);
+    exit(1);
+}
+
+static GR_GPU_MEMORY allocMemory(
+    GR_DEVICE device,
+    const GR_MEMORY_REQUIREMENTS* memReqs,
+    GR_FLAGS heapFlags)
+{
+    GR_GPU_MEMORY mem = GR_NULL_HANDLE;
+
+    const GR_MEMORY_ALLOC_INFO allocInfo = {
+        .size = memReqs->size,
+        .alignment = memReqs->alignment,
+        .flags = 0,
+        .heapCount = 1,
+        .heaps = { findHeap(device, memReqs, heapFlags) },
+        .memPriority = GR_MEMORY_PRIORITY_NORMAL,
+    };
+
+    CHECK(grAllocMemory(device, &allocInfo, &mem) == GR_SUCCESS);
+    return mem;
+}
+
+void deviceCreate(
+    TestDevice* testDevice)
+{
+    GR_PHYSICAL_GPU gpus[GR_MAX_PHYSICAL_GPUS];
+    GR_UINT gpuCount = 0;
+
+    const GR_APPLICATION_INFO appInfo = {
+        .pAppName = "grvk-test",
+        .appVersion = 1,
+        .pEngineName = "grvk-test",
+        .engineVersion = 1,
+        .apiVersion = 0x19000, // 19.4.3
+    };
+
+    if (grInitAndEnumerateGpus(&appInfo, NULL, &gpuCount, gpus) != GR_SUCCESS ||
+        gpuCount == 0) {
+        fprintf(stderr, "no Vulkan device, skipping\n");
+        exit(SKIP_EXIT_CODE);
+    }
+
+    const GR_DEVICE_QUEUE_CREATE_INFO queueCreateInfo = {
+        .queueType = GR_QUEUE_UNIVERSAL,
+        .queueCount = 1,
+    };
+    const GR_DEVICE_CREATE_INFO deviceCreateInfo = {
+        .queueRecordCount = 1,
+        .pRequestedQueues = &queueCreateInfo,
+        .extensionCount = 0,
+        .ppEnabledExtensionNames = NULL,
+        .maxValidationLevel = GR_VALIDATION_LEVEL_0,
+        .flags = 0,
+    };
+    const GR_FENCE_CREATE_INFO fenceCreateInfo = { .flags = 0 };
+
+    CHECK(grCreateDevice(gpus[0], &deviceCreateInfo, &testDevice->device) == GR_SUCCESS);
+    CHECK(grGetDeviceQueue(testDevice->device, GR_QUEUE_UNIVERSAL, 0, &testDevice->queue) ==
+          GR_SUCCESS);
+    CHECK(grCreateFence(testDevice->device, &fenceCreateInfo, &testDevice->fence) ==
+          GR_SUCCESS);
+}
+
+void deviceDestroy(
+    TestDevice* testDevice)
+{
+    CHECK(grDestroyObject(testDevice->fence) == GR_SUCCESS);
+    CHECK(grDestroyDevice(testDevice->device) == GR_SUCCESS);
+}
+
+GR_IMAGE deviceCreateImage(
+    TestDevice* testDevice,
+    unsigned width,
+    unsigned height,
+    unsigned mipLevels,
+    unsigned samples,
+    GR_GPU_MEMORY* pMem)
+{
+    GR_IMAGE image = GR_NULL_HANDLE;
+    GR_MEMORY_REQUIREMENTS memReqs;
+    GR_SIZE memReqsSize = sizeof(memReqs);
+
+    const GR_IMAGE_CREATE_INFO createInfo = {
+        .imageType = GR_IMAGE_2D,
+        .format = {
+            .channelFormat = GR_CH_FMT_R8G8B8A8,
+            .numericFormat = GR_NUM_FMT_UNORM,
+        },
+        .extent = { width, height, 1 },
+        .mipLevels = mipLevels,
+        .arraySize = 1,
+        .samples = samples,
+        .tiling = GR_OPTIMAL_TILING,
+        .usage = GR_IMAGE_USAGE_COLOR_TARGET | GR_IMAGE_USAGE_SHADER_ACCESS_READ,
+        .flags = 0,
+    };
+
+    CHECK(grCreateImage(testDevice->device, &createInfo, &image) == GR_SUCCESS);
+    CHECK(grGetObjectInfo(image, GR_INFO_TYPE_MEMORY_REQUIREMENTS, &memReqsSize, &memReqs) ==
+          GR_SUCCESS);
+
+    *pMem = allocMemory(testDevice->device, &memReqs, 0);
+    CHECK(grBindObjectMemory(image, *pMem, 0) == GR_SUCCESS);
+    return image;
+}
+
+GR_GPU_MEMORY deviceAllocCpuMemory(
+    TestDevice* testDevice,
+    GR_GPU_SIZE size)
+{
+    GR_UINT heapCount = 0;
+
+    CHECK(grGetMemoryHeapCount(testDevice->device, &heapCount) == GR_SUCCESS);
+
+    GR_MEMORY_REQUIREMENTS memReqs = {
+        .size = size,
+        .alignment = 0,
+        .heapCount = heapCount,
+        .heaps = { 0 },
+    };
+
+    for (unsigned i = 0; i < heapCount; i++) {
+        memReqs.heaps[i] = i;
+    }
+
+    return allocMemory(testDevice->device, &memReqs, GR_MEMORY_HEAP_CPU_VISIBLE);
+}
+
+GR_CMD_BUFFER deviceBeginCmdBuffer(
+    TestDevice* testDevice)
+{
+    GR_CMD_BUFFER cmdBuffer = GR_NULL_HANDLE;
+
+    const GR_CMD_BUFFER_CREATE_INFO createInfo = {
+        .queueType = GR_QUEUE_UNIVERSAL,
+        .flags = 0,
+    };
+
+    CHECK(grCreateCommandBuffer(testDevice->device, &createInfo, &cmdBuffer) == GR_SUCCESS);
+    CHECK(grBeginCommandBuffer(cmdBuffer, GR_CMD_BUFFER_OPTIMIZE_ONE_TIME_SUBMIT) ==
+          GR_SUCCESS);
+    return cmdBuffer;
+}
+
+void devicePrepareImage(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE image,
+    unsigned mipLevels,
+    GR_ENUM oldState,
+    GR_ENUM newState)
+{
+    const GR_IMAGE_STATE_TRANSITION transition = {
+        .image = image,
+        .oldState = oldState,
+        .newState = newState,
+        .subresourceRange = {
+            .aspect = GR_IMAGE_ASPECT_COLOR,
+            .baseMipLevel = 0,
+            .mipLevels = mipLevels,
+            .baseArraySlice = 0,
+            .arraySize = 1,
+        },
+    };
+
+    grCmdPrepareImages(cmdBuffer, 1, &transition);
+}
+
+void deviceCopyImageToMemory(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE image,
+    unsigned mipLevel,
+    unsigned width,
+    unsigned height,
+    GR_GPU_MEMORY mem,
+    GR_GPU_SIZE offset)
+{
+    const GR_GPU_SIZE size = width * height * DEVICE_PIXEL_SIZE;
+
+    const GR_MEMORY_STATE_TRANSITION preCopyTransition = {
+        .mem = mem,
+        .oldState = GR_MEMORY_STATE_DATA_TRANSFER,
+        .newState = GR_MEMORY_STATE_DATA_TRANSFER_DESTINATION,
+        .offset = offset,
+        .regionSize = size,
+    };
+    const GR_MEMORY_IMAGE_COPY region = {
+        .memOffset = offset,
+        .imageSubresource = {
+            .aspect = GR_IMAGE_ASPECT_COLOR,
+            .mipLevel = mipLevel,
+            .arraySlice = 0,
+        },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = { width, height, 1 },
+    };
+    const GR_MEMORY_STATE_TRANSITION postCopyTransition = {
+        .mem = mem,
+        .oldState = GR_MEMORY_STATE_DATA_TRANSFER_DESTINATION,
+        .newState = GR_MEMORY_STATE_DATA_TRANSFER, // Makes it visible to the CPU
+        .offset = offset,
+        .regionSize = size,
+    };
+
+    grCmdPrepareMemoryRegions(cmdBuffer, 1, &preCopyTransition);
+    grCmdCopyImageToMemory(cmdBuffer, image, mem, 1, &region);
+    grCmdPrepareMemoryRegions(cmdBuffer, 1, &postCopyTransition);
+}
+
+void deviceSubmit(
+    TestDevice* testDevice,
+    GR_CMD_BUFFER cmdBuffer,
+    unsigned memCount,
+    const GR_GPU_MEMORY* mems)
+{
+    GR_MEMORY_REF memRefs[DEVICE_MAX_MEM_REFS];
+
+    CHECK(memCount <= DEVICE_MAX_MEM_REFS);
+    for (unsigned i = 0; i < memCount; i++) {
+        memRefs[i] = (GR_MEMORY_REF) { .mem = mems[i], .flags = 0 };
+    }
+
+    CHECK(grEndCommandBuffer(cmdBuffer) == GR_SUCCESS);
+    CHECK(grQueueSubmit(testDevice->queue, 1, &cmdBuffer, memCount, memRefs,
+                        testDevice->fence) == GR_SUCCESS);
+    CHECK(grWaitForFences(testDevice->device, 1, &testDevice->fence, true, 10.0f) ==
+          GR_SUCCESS);
+}
+
+uint32_t devicePackColor(
+    const float color[4])
+{
+    uint32_t packed = 0;
+
+    // Little endian R8G8B8A8
+    for (unsigned i = 0; i < 4; i++) {
+        packed |= (uint32_t)lroundf(color[i] * 255.0f) << (8 * i);
+    }
+
+    return packed;
+}
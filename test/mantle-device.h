@@ -0,0 +1,73 @@
+#ifndef MANTLE_DEVICE_H_
+#define MANTLE_DEVICE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "check.h"
+#include "mantle/mantle.h"
+
+#define DEVICE_PIXEL_SIZE   (4) // R8G8B8A8
+#define DEVICE_MAX_MEM_REFS (8)
+
+#define COUNT_OF(array) \
+    (sizeof(array) / sizeof((array)[0]))
+
+// Device created through the exported entry points, on whatever Vulkan driver the loader picks
+// (e.g. lavapipe through VK_ICD_FILENAMES). Tests are skipped when there is none.
+typedef struct {
+    GR_DEVICE device;
+    GR_QUEUE queue;
+    GR_FENCE fence;
+} TestDevice;
+
+void deviceCreate(
+    TestDevice* testDevice);
+
+void deviceDestroy(
+    TestDevice* testDevice);
+
+// Optimal R8G8B8A8 color target, bound to its own memory
+GR_IMAGE deviceCreateImage(
+    TestDevice* testDevice,
+    unsigned width,
+    unsigned height,
+    unsigned mipLevels,
+    unsigned samples,
+    GR_GPU_MEMORY* pMem);
+
+GR_GPU_MEMORY deviceAllocCpuMemory(
+    TestDevice* testDevice,
+    GR_GPU_SIZE size);
+
+GR_CMD_BUFFER deviceBeginCmdBuffer(
+    TestDevice* testDevice);
+
+void devicePrepareImage(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE image,
+    unsigned mipLevels,
+    GR_ENUM oldState,
+    GR_ENUM newState);
+
+// Copies a mip level to memory, tightly packed. The image must be in the data transfer source
+// state and the memory in the data transfer state.
+void deviceCopyImageToMemory(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE image,
+    unsigned mipLevel,
+    unsigned width,
+    unsigned height,
+    GR_GPU_MEMORY mem,
+    GR_GPU_SIZE offset);
+
+// Ends the command buffer, submits it and waits for it to complete
+void deviceSubmit(
+    TestDevice* testDevice,
+    GR_CMD_BUFFER cmdBuffer,
+    unsigned memCount,
+    const GR_GPU_MEMORY* mems);
+
+uint32_t devicePackColor(
+    const float color[4]);
+
+#endif // MANTLE_DEVICE_H_
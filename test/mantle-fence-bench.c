@@ -0,0 +1,72 @@
+#include "mantle-stub.h"
+
+#define ITERATION_COUNT (1000000)
+#define FENCE_COUNT     (8)
+
+// CPU cost of the fence paths, with a dispatch that returns right away
+static void printResult(
+    const char* name,
+    uint64_t startTime)
+{
+    uint64_t time = profilerGetTime() - startTime;
+
+    printf("%-32s %8.1f ns/call\n", name, (double)time * 1000.0 / ITERATION_COUNT);
+}
+
+int main(
+    int argc,
+    char* argv[])
+{
+    profilerInit(); // Sets up the timer
+
+    GrDevice* grDevice = stubCreateDevice();
+    GrQueue* grQueues[2] = { stubCreateQueue(grDevice), stubCreateQueue(grDevice) };
+    const GR_FENCE_CREATE_INFO createInfo = { .flags = 0 };
+    GR_FENCE fences[FENCE_COUNT];
+    uint64_t startTime;
+
+    for (unsigned i = 0; i < FENCE_COUNT; i++) {
+        CHECK(grCreateFence((GR_DEVICE)grDevice, &createInfo, &fences[i]) == GR_SUCCESS);
+        CHECK(grQueueSubmit((GR_QUEUE)grQueues[i % 2], 0, NULL, 0, NULL, fences[i]) ==
+              GR_SUCCESS);
+    }
+    for (unsigned i = 0; i < COUNT_OF(grQueues); i++) {
+        stubCompleteSemaphore(grQueues[i]->timelineSemaphore);
+    }
+
+    startTime = profilerGetTime();
+    for (unsigned i = 0; i < ITERATION_COUNT; i++) {
+        grGetFenceStatus(fences[0]);
+    }
+    printResult("grGetFenceStatus", startTime);
+
+    startTime = profilerGetTime();
+    for (unsigned i = 0; i < ITERATION_COUNT; i++) {
+        grWaitForFences((GR_DEVICE)grDevice, 1, fences, true, 1.0f);
+    }
+    printResult("grWaitForFences 1 fence", startTime);
+
+    startTime = profilerGetTime();
+    for (unsigned i = 0; i < ITERATION_COUNT; i++) {
+        grWaitForFences((GR_DEVICE)grDevice, FENCE_COUNT, fences, true, 1.0f);
+    }
+    printResult("grWaitForFences 8 fences, all", startTime);
+
+    startTime = profilerGetTime();
+    for (unsigned i = 0; i < ITERATION_COUNT; i++) {
+        grWaitForFences((GR_DEVICE)grDevice, FENCE_COUNT, fences, false, 1.0f);
+    }
+    printResult("grWaitForFences 8 fences, any", startTime);
+
+    // Submit, retire and wait, as a frame loop would
+    startTime = profilerGetTime();
+    for (unsigned i = 0; i < ITERATION_COUNT; i++) {
+        grQueueSubmit((GR_QUEUE)grQueues[0], 0, NULL, 0, NULL, fences[0]);
+        stubCompleteSemaphore(grQueues[0]->timelineSemaphore);
+        grWaitForFences((GR_DEVICE)grDevice, 1, fences, true, 1.0f);
+    }
+    printResult("grQueueSubmit + grWaitForFences", startTime);
+
+    CHECK(gStubStats.lastWait.callCount == 4 * ITERATION_COUNT);
+    return 0;
+}
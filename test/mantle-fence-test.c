@@ -0,0 +1,150 @@
+#include "mantle-stub.h"
+
+static GR_FENCE createFence(
+    GrDevice* grDevice)
+{
+    const GR_FENCE_CREATE_INFO createInfo = { .flags = 0 };
+    GR_FENCE fence = GR_NULL_HANDLE;
+
+    CHECK(grCreateFence((GR_DEVICE)grDevice, &createInfo, &fence) == GR_SUCCESS);
+    return fence;
+}
+
+static void submitFence(
+    GrQueue* grQueue,
+    GR_FENCE fence)
+{
+    CHECK(grQueueSubmit((GR_QUEUE)grQueue, 0, NULL, 0, NULL, fence) == GR_SUCCESS);
+}
+
+static void checkWait(
+    unsigned semaphoreCount,
+    bool isAny,
+    const VkSemaphore* semaphores,
+    const uint64_t* values)
+{
+    const StubWait* wait = &gStubStats.lastWait;
+
+    CHECK(wait->semaphoreCount == semaphoreCount);
+    CHECK(((wait->flags & VK_SEMAPHORE_WAIT_ANY_BIT) != 0) == isAny);
+
+    for (unsigned i = 0; i < semaphoreCount; i++) {
+        CHECK(wait->semaphores[i] == semaphores[i]);
+        CHECK(wait->values[i] == values[i]);
+    }
+}
+
+static void testInvalidArguments(
+    GrDevice* grDevice)
+{
+    GR_FENCE fence = createFence(grDevice);
+    unsigned callCount = gStubStats.lastWait.callCount;
+
+    CHECK(grWaitForFences(GR_NULL_HANDLE, 1, &fence, true, 1.0f) == GR_ERROR_INVALID_HANDLE);
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, 0, &fence, true, 1.0f) ==
+          GR_ERROR_INVALID_VALUE);
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, 1, NULL, true, 1.0f) ==
+          GR_ERROR_INVALID_POINTER);
+
+    // Never submitted
+    CHECK(grGetFenceStatus(fence) == GR_ERROR_UNAVAILABLE);
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, 1, &fence, true, 1.0f) == GR_ERROR_UNAVAILABLE);
+    CHECK(gStubStats.lastWait.callCount == callCount);
+}
+
+static void testMixedQueues(
+    GrDevice* grDevice,
+    GrQueue* grUniversalQueue,
+    GrQueue* grComputeQueue)
+{
+    VkSemaphore universalSemaphore = grUniversalQueue->timelineSemaphore;
+    VkSemaphore computeSemaphore = grComputeQueue->timelineSemaphore;
+    GR_FENCE fences[4];
+
+    for (unsigned i = 0; i < COUNT_OF(fences); i++) {
+        fences[i] = createFence(grDevice);
+    }
+
+    // Two fences on the universal queue, two on the compute queue, interleaved
+    submitFence(grUniversalQueue, fences[0]);
+    submitFence(grComputeQueue, fences[1]);
+    submitFence(grUniversalQueue, fences[2]);
+    submitFence(grComputeQueue, fences[3]);
+
+    uint64_t universalValue = ((GrFence*)fences[2])->timelineValue;
+    uint64_t computeValue = ((GrFence*)fences[3])->timelineValue;
+    CHECK(universalValue == ((GrFence*)fences[0])->timelineValue + 1);
+    CHECK(computeValue == ((GrFence*)fences[1])->timelineValue + 1);
+    CHECK(stubGetPendingSemaphoreValue(universalSemaphore) == universalValue);
+    CHECK(stubGetPendingSemaphoreValue(computeSemaphore) == computeValue);
+
+    const VkSemaphore semaphores[] = { universalSemaphore, computeSemaphore };
+
+    // Fences of a queue collapse into a single wait on its timeline: the last one for waitAll,
+    // the first one for waitAny
+    const uint64_t allValues[] = { universalValue, computeValue };
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, COUNT_OF(fences), fences, true, 0.25f) ==
+          GR_TIMEOUT);
+    checkWait(2, false, semaphores, allValues);
+    CHECK(gStubStats.lastWait.timeout == 250000000ull);
+
+    const uint64_t anyValues[] = { universalValue - 1, computeValue - 1 };
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, COUNT_OF(fences), fences, false, 0.25f) ==
+          GR_TIMEOUT);
+    checkWait(2, true, semaphores, anyValues);
+
+    // Only the universal queue is done
+    stubCompleteSemaphore(universalSemaphore);
+    CHECK(grGetFenceStatus(fences[0]) == GR_SUCCESS);
+    CHECK(grGetFenceStatus(fences[1]) == GR_NOT_READY);
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, COUNT_OF(fences), fences, false, 1.0f) ==
+          GR_SUCCESS);
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, COUNT_OF(fences), fences, true, 1.0f) ==
+          GR_TIMEOUT);
+
+    // Fences of the same queue wait on a single semaphore
+    const GR_FENCE universalFences[] = { fences[0], fences[2] };
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, COUNT_OF(universalFences), universalFences,
+                          true, 1.0f) == GR_SUCCESS);
+    checkWait(1, false, semaphores, allValues);
+
+    stubCompleteSemaphore(computeSemaphore);
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, COUNT_OF(fences), fences, true, 1.0f) ==
+          GR_SUCCESS);
+    checkWait(2, false, semaphores, allValues);
+}
+
+static void testTimeout(
+    GrDevice* grDevice,
+    GrQueue* grQueue)
+{
+    GR_FENCE fence = createFence(grDevice);
+
+    submitFence(grQueue, fence);
+
+    // Polling
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, 1, &fence, true, 0.0f) == GR_TIMEOUT);
+    CHECK(gStubStats.lastWait.timeout == 0);
+
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, 1, &fence, true, 2.0f) == GR_TIMEOUT);
+    CHECK(gStubStats.lastWait.timeout == 2000000000ull);
+
+    stubCompleteSemaphore(grQueue->timelineSemaphore);
+    CHECK(grWaitForFences((GR_DEVICE)grDevice, 1, &fence, true, 0.0f) == GR_SUCCESS);
+}
+
+int main(
+    int argc,
+    char* argv[])
+{
+    GrDevice* grDevice = stubCreateDevice();
+    GrQueue* grUniversalQueue = stubCreateQueue(grDevice);
+    GrQueue* grComputeQueue = stubCreateQueue(grDevice);
+
+    testInvalidArguments(grDevice);
+    testMixedQueues(grDevice, grUniversalQueue, grComputeQueue);
+    testTimeout(grDevice, grComputeQueue);
+
+    printf("fence waits ok\n");
+    return 0;
+}
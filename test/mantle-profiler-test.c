@@ -0,0 +1,145 @@
+#include "mantle-stub.h"
+
+#define CSV_REPORT_PATH     "mantle-profiler-test.csv"
+#define JSON_REPORT_PATH    "mantle-profiler-test.json"
+
+static void createPipelines(
+    GrDevice* grDevice,
+    const char* ilPath)
+{
+    GR_SHADER shader = GR_NULL_HANDLE;
+    GR_PIPELINE pipeline = GR_NULL_HANDLE;
+    size_t codeSize = 0;
+    void* code = stubReadFile(ilPath, &codeSize);
+
+    const GR_SHADER_CREATE_INFO shaderCreateInfo = {
+        .codeSize = codeSize,
+        .pCode = code,
+        .flags = 0,
+    };
+
+    CHECK(grCreateShader((GR_DEVICE)grDevice, &shaderCreateInfo, &shader) == GR_SUCCESS);
+    CHECK(gStubStats.shaderModuleCount == 1);
+    free(code);
+
+    GR_GRAPHICS_PIPELINE_CREATE_INFO pipelineCreateInfo = { 0 };
+    pipelineCreateInfo.vs.dynamicMemoryViewMapping.slotObjectType = GR_SLOT_UNUSED;
+    pipelineCreateInfo.hs.dynamicMemoryViewMapping.slotObjectType = GR_SLOT_UNUSED;
+    pipelineCreateInfo.ds.dynamicMemoryViewMapping.slotObjectType = GR_SLOT_UNUSED;
+    pipelineCreateInfo.gs.dynamicMemoryViewMapping.slotObjectType = GR_SLOT_UNUSED;
+    pipelineCreateInfo.ps.shader = shader;
+    pipelineCreateInfo.ps.dynamicMemoryViewMapping.slotObjectType = GR_SLOT_UNUSED;
+    pipelineCreateInfo.iaState.topology = GR_TOPOLOGY_TRIANGLE_LIST;
+    pipelineCreateInfo.cbState.logicOp = GR_LOGIC_OP_COPY;
+
+    CHECK(grCreateGraphicsPipeline((GR_DEVICE)grDevice, &pipelineCreateInfo, &pipeline) ==
+          GR_SUCCESS);
+    // Graphics pipelines are compiled on first bind
+    CHECK(gStubStats.graphicsPipelineCount == 0);
+
+    VkPipeline vkPipeline = grPipelineGetVkPipeline((GrPipeline*)pipeline, VK_FORMAT_UNDEFINED,
+                                                    VK_FORMAT_UNDEFINED);
+    CHECK(vkPipeline != VK_NULL_HANDLE);
+    CHECK(gStubStats.graphicsPipelineCount == 1);
+
+    // Cached from now on, no new event
+    CHECK(grPipelineGetVkPipeline((GrPipeline*)pipeline, VK_FORMAT_UNDEFINED,
+                                  VK_FORMAT_UNDEFINED) == vkPipeline);
+    CHECK(gStubStats.graphicsPipelineCount == 1);
+}
+
+static void addEscapedEvent()
+{
+    // Names are arbitrary strings, make sure they can't break the JSON report
+    const ProfilerPipelineEvent event = {
+        .type = PROFILER_COMPUTE_PIPELINE,
+        .object = NULL,
+        .shaderNames = { "quote\"name", "back\\slash" },
+        .translateTime = 1,
+        .moduleTime = 2,
+        .setupTime = 3,
+        .compileTime = 4,
+        .isRenderThread = false,
+        .isCacheHit = true,
+    };
+
+    profilerAddPipelineEvent(&event);
+}
+
+static unsigned countLines(
+    const char* str)
+{
+    unsigned count = 0;
+
+    for (const char* c = str; *c != '\0'; c++) {
+        count += *c == '\n';
+    }
+
+    return count;
+}
+
+static void checkCsvReport()
+{
+    size_t size = 0;
+    char* report = stubReadFile(CSV_REPORT_PATH, &size);
+
+    // Header and one line per event
+    CHECK(countLines(report) == 5);
+    CHECK(strncmp(report, "type,object,shaders,", strlen("type,object,shaders,")) == 0);
+    CHECK(strstr(report, "\nshader,") != NULL);
+    CHECK(strstr(report, "\ngraphics,") != NULL);
+    CHECK(strstr(report, "\ngraphics_compile,") != NULL);
+    CHECK(strstr(report, "\ncompute,") != NULL);
+    CHECK(strstr(report, ",quote\"name back\\slash,1,2,3,4,0,1\n") != NULL);
+
+    free(report);
+}
+
+static void checkJsonReport()
+{
+    size_t size = 0;
+    char* report = stubReadFile(JSON_REPORT_PATH, &size);
+
+    // Brackets and one line per event
+    CHECK(countLines(report) == 6);
+    CHECK(report[0] == '[' && strstr(report, "}\n]\n") != NULL);
+    CHECK(strstr(report, "\"type\": \"shader\"") != NULL);
+    CHECK(strstr(report, "\"type\": \"graphics\"") != NULL);
+    CHECK(strstr(report, "\"type\": \"graphics_compile\"") != NULL);
+    CHECK(strstr(report, "\"type\": \"compute\"") != NULL);
+    CHECK(strstr(report, "\"shaders\": \"quote\\\"name back\\\\slash\"") != NULL);
+    CHECK(strstr(report, "\"render_thread\": true") != NULL);
+    CHECK(strstr(report, "\"render_thread\": false, \"cache_hit\": true }\n") != NULL);
+
+    free(report);
+}
+
+int main(
+    int argc,
+    char* argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s [IL pixel shader]\n", argv[0]);
+        return 1;
+    }
+
+    // The report path is picked up at initialization
+    _putenv("GRVK_PIPELINE_STATS_PATH=" CSV_REPORT_PATH);
+    profilerInit();
+    CHECK(profilerIsEnabled());
+
+    GrDevice* grDevice = stubCreateDevice();
+    createPipelines(grDevice, argv[1]);
+    addEscapedEvent();
+
+    profilerWriteReport();
+    checkCsvReport();
+
+    _putenv("GRVK_PIPELINE_STATS_PATH=" JSON_REPORT_PATH);
+    profilerInit();
+    profilerWriteReport();
+    checkJsonReport();
+
+    printf("profiler reports ok\n");
+    return 0;
+}
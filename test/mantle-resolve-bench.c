@@ -0,0 +1,160 @@
+#include <windows.h>
+#include "mantle-device.h"
+
+#define ITERATION_COUNT (20)
+#define COMMAND_COUNT   (16) // Per submission
+#define SAMPLES         (4)
+
+typedef void (*RecordFunc)(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE srcImage,
+    GR_IMAGE dstImage,
+    int width,
+    int height);
+
+static double getTime()
+{
+    static LARGE_INTEGER frequency = { .QuadPart = 0 };
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+
+    return (double)counter.QuadPart / frequency.QuadPart;
+}
+
+static void recordResolve(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE srcImage,
+    GR_IMAGE dstImage,
+    int width,
+    int height)
+{
+    const GR_IMAGE_SUBRESOURCE subresource = {
+        .aspect = GR_IMAGE_ASPECT_COLOR,
+        .mipLevel = 0,
+        .arraySlice = 0,
+    };
+    const GR_IMAGE_RESOLVE region = {
+        .srcSubresource = subresource,
+        .srcOffset = { 0, 0 },
+        .destSubresource = subresource,
+        .destOffset = { 0, 0 },
+        .extent = { width, height },
+    };
+
+    grCmdResolveImage(cmdBuffer, srcImage, dstImage, 1, &region);
+}
+
+static void recordClone(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE srcImage,
+    GR_IMAGE dstImage,
+    int width,
+    int height)
+{
+    grCmdCloneImageData(cmdBuffer, srcImage, GR_IMAGE_STATE_RESOLVE_DESTINATION,
+                        dstImage, GR_IMAGE_STATE_CLEAR);
+}
+
+// Back-to-back commands between the same images, only the time they take matters
+static void runBench(
+    TestDevice* testDevice,
+    const char* name,
+    RecordFunc recordFunc,
+    GR_IMAGE srcImage,
+    GR_IMAGE dstImage,
+    int width,
+    int height,
+    unsigned memCount,
+    const GR_GPU_MEMORY* mems)
+{
+    double recordTime = 0.0;
+    double executeTime = 0.0;
+
+    for (unsigned i = 0; i < ITERATION_COUNT; i++) {
+        GR_CMD_BUFFER cmdBuffer = deviceBeginCmdBuffer(testDevice);
+        double startTime = getTime();
+
+        for (unsigned j = 0; j < COMMAND_COUNT; j++) {
+            recordFunc(cmdBuffer, srcImage, dstImage, width, height);
+        }
+
+        double submitTime = getTime();
+        deviceSubmit(testDevice, cmdBuffer, memCount, mems);
+        double endTime = getTime();
+
+        recordTime += submitTime - startTime;
+        executeTime += endTime - submitTime;
+        CHECK(grDestroyObject(cmdBuffer) == GR_SUCCESS);
+    }
+
+    const unsigned callCount = ITERATION_COUNT * COMMAND_COUNT;
+
+    printf("%-10s %4dx%-4d %8.2f us/call recorded %8.3f ms/call executed\n",
+           name, width, height, recordTime * 1000000.0 / callCount,
+           executeTime * 1000.0 / callCount);
+}
+
+static void benchSize(
+    TestDevice* testDevice,
+    int width,
+    int height)
+{
+    static const float color[4] = { 1.0f, 0.2f, 0.0f, 1.0f };
+    GR_GPU_MEMORY mems[3];
+    GR_IMAGE msaaImage = deviceCreateImage(testDevice, width, height, 1, SAMPLES, &mems[0]);
+    GR_IMAGE resolvedImage = deviceCreateImage(testDevice, width, height, 1, 1, &mems[1]);
+    GR_IMAGE cloneImage = deviceCreateImage(testDevice, width, height, 1, 1, &mems[2]);
+    GR_CMD_BUFFER cmdBuffer = deviceBeginCmdBuffer(testDevice);
+
+    const GR_IMAGE_SUBRESOURCE_RANGE range = {
+        .aspect = GR_IMAGE_ASPECT_COLOR,
+        .baseMipLevel = 0,
+        .mipLevels = 1,
+        .baseArraySlice = 0,
+        .arraySize = 1,
+    };
+
+    devicePrepareImage(cmdBuffer, msaaImage, 1, GR_IMAGE_STATE_UNINITIALIZED,
+                       GR_IMAGE_STATE_CLEAR);
+    grCmdClearColorImage(cmdBuffer, msaaImage, color, 1, &range);
+    devicePrepareImage(cmdBuffer, msaaImage, 1, GR_IMAGE_STATE_CLEAR,
+                       GR_IMAGE_STATE_RESOLVE_SOURCE);
+    devicePrepareImage(cmdBuffer, resolvedImage, 1, GR_IMAGE_STATE_UNINITIALIZED,
+                       GR_IMAGE_STATE_RESOLVE_DESTINATION);
+    devicePrepareImage(cmdBuffer, cloneImage, 1, GR_IMAGE_STATE_UNINITIALIZED,
+                       GR_IMAGE_STATE_CLEAR);
+    deviceSubmit(testDevice, cmdBuffer, COUNT_OF(mems), mems);
+    CHECK(grDestroyObject(cmdBuffer) == GR_SUCCESS);
+
+    runBench(testDevice, "resolve", recordResolve, msaaImage, resolvedImage, width, height,
+             COUNT_OF(mems), mems);
+    // Same amount of single-sample data written, without reading and averaging samples
+    runBench(testDevice, "clone", recordClone, resolvedImage, cloneImage, width, height,
+             COUNT_OF(mems), mems);
+
+    CHECK(grDestroyObject(msaaImage) == GR_SUCCESS);
+    CHECK(grDestroyObject(resolvedImage) == GR_SUCCESS);
+    CHECK(grDestroyObject(cloneImage) == GR_SUCCESS);
+    for (unsigned i = 0; i < COUNT_OF(mems); i++) {
+        CHECK(grFreeMemory(mems[i]) == GR_SUCCESS);
+    }
+}
+
+int main(
+    int argc,
+    char* argv[])
+{
+    TestDevice testDevice;
+
+    deviceCreate(&testDevice);
+    benchSize(&testDevice, 1280, 720);
+    benchSize(&testDevice, 1920, 1080);
+    benchSize(&testDevice, 2560, 1440);
+    deviceDestroy(&testDevice);
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "mantle-device.h"
+
+#define IMAGE_SIZE  (16)
+#define MIP_COUNT   (2)
+#define SAMPLES     (4)
+
+static const float mSrcColor[4] = { 1.0f, 0.2f, 0.0f, 1.0f };
+static const float mDstColor[4] = { 0.0f, 0.6f, 1.0f, 1.0f };
+static const float mSrcMipColor[4] = { 0.2f, 0.2f, 0.6f, 0.0f };
+
+static void clearImage(
+    GR_CMD_BUFFER cmdBuffer,
+    GR_IMAGE image,
+    unsigned mipLevel,
+    const float color[4])
+{
+    const GR_IMAGE_SUBRESOURCE_RANGE range = {
+        .aspect = GR_IMAGE_ASPECT_COLOR,
+        .baseMipLevel = mipLevel,
+        .mipLevels = 1,
+        .baseArraySlice = 0,
+        .arraySize = 1,
+    };
+
+    grCmdClearColorImage(cmdBuffer, image, color, 1, &range);
+}
+
+static void checkPixels(
+    const uint32_t* pixels,
+    int width,
+    int height,
+    const GR_OFFSET2D* offsets,
+    const GR_EXTENT2D* extents,
+    unsigned rectCount,
+    uint32_t insideColor,
+    uint32_t outsideColor)
+{
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            bool isInside = false;
+
+            for (unsigned i = 0; i < rectCount; i++) {
+                isInside |= x >= offsets[i].x && x < offsets[i].x + extents[i].width &&
+                            y >= offsets[i].y && y < offsets[i].y + extents[i].height;
+            }
+
+            uint32_t pixel = pixels[y * width + x];
+            uint32_t expected = isInside ? insideColor : outsideColor;
+            if (pixel != expected) {
+                fprintf(stderr, "pixel (%d, %d) is %08X, expected %08X\n",
+                        x, y, pixel, expected);
+                exit(1);
+            }
+        }
+    }
+}
+
+// Resolves two regions of a uniformly cleared 4x image at different offsets and checks that
+// exactly those pixels of the destination were written
+static void testResolve(
+    TestDevice* testDevice)
+{
+    GR_GPU_MEMORY mems[3];
+    GR_IMAGE srcImage = deviceCreateImage(testDevice, IMAGE_SIZE, IMAGE_SIZE, 1, SAMPLES,
+                                          &mems[0]);
+    GR_IMAGE dstImage = deviceCreateImage(testDevice, IMAGE_SIZE, IMAGE_SIZE, 1, 1, &mems[1]);
+    GR_GPU_MEMORY readbackMem = mems[2] =
+        deviceAllocCpuMemory(testDevice, IMAGE_SIZE * IMAGE_SIZE * DEVICE_PIXEL_SIZE);
+    GR_CMD_BUFFER cmdBuffer = deviceBeginCmdBuffer(testDevice);
+
+    const GR_IMAGE_SUBRESOURCE subresource = {
+        .aspect = GR_IMAGE_ASPECT_COLOR,
+        .mipLevel = 0,
+        .arraySlice = 0,
+    };
+    const GR_IMAGE_RESOLVE regions[] = {
+        {
+            .srcSubresource = subresource,
+            .srcOffset = { 4, 4 },
+            .destSubresource = subresource,
+            .destOffset = { 0, 8 },
+            .extent = { 8, 8 },
+        },
+        {
+            .srcSubresource = subresource,
+            .srcOffset = { 0, 0 },
+            .destSubresource = subresource,
+            .destOffset = { 12, 1 },
+            .extent = { 3, 5 },
+        },
+    };
+
+    devicePrepareImage(cmdBuffer, srcImage, 1, GR_IMAGE_STATE_UNINITIALIZED,
+                       GR_IMAGE_STATE_CLEAR);
+    devicePrepareImage(cmdBuffer, dstImage, 1, GR_IMAGE_STATE_UNINITIALIZED,
+                       GR_IMAGE_STATE_CLEAR);
+    clearImage(cmdBuffer, srcImage, 0, mSrcColor);
+    clearImage(cmdBuffer, dstImage, 0, mDstColor);
+
+    devicePrepareImage(cmdBuffer, srcImage, 1, GR_IMAGE_STATE_CLEAR,
+                       GR_IMAGE_STATE_RESOLVE_SOURCE);
+    devicePrepareImage(cmdBuffer, dstImage, 1, GR_IMAGE_STATE_CLEAR,
+                       GR_IMAGE_STATE_RESOLVE_DESTINATION);
+    grCmdResolveImage(cmdBuffer, srcImage, dstImage, COUNT_OF(regions), regions);
+
+    devicePrepareImage(cmdBuffer, dstImage, 1, GR_IMAGE_STATE_RESOLVE_DESTINATION,
+                       GR_IMAGE_STATE_DATA_TRANSFER_SOURCE);
+    deviceCopyImageToMemory(cmdBuffer, dstImage, 0, IMAGE_SIZE, IMAGE_SIZE, readbackMem, 0);
+    deviceSubmit(testDevice, cmdBuffer, COUNT_OF(mems), mems);
+
+    const GR_OFFSET2D offsets[] = { regions[0].destOffset, regions[1].destOffset };
+    const GR_EXTENT2D extents[] = { regions[0].extent, regions[1].extent };
+    uint32_t* pixels = NULL;
+
+    CHECK(grMapMemory(readbackMem, 0, (GR_VOID**)&pixels) == GR_SUCCESS);
+    checkPixels(pixels, IMAGE_SIZE, IMAGE_SIZE, offsets, extents, COUNT_OF(offsets),
+                devicePackColor(mSrcColor), devicePackColor(mDstColor));
+    CHECK(grUnmapMemory(readbackMem) == GR_SUCCESS);
+
+    CHECK(grDestroyObject(cmdBuffer) == GR_SUCCESS);
+    CHECK(grDestroyObject(srcImage) == GR_SUCCESS);
+    CHECK(grDestroyObject(dstImage) == GR_SUCCESS);
+    for (unsigned i = 0; i < COUNT_OF(mems); i++) {
+        CHECK(grFreeMemory(mems[i]) == GR_SUCCESS);
+    }
+}
+
+// Clones a mipmapped image left in a shader read state over a cleared one, then checks that
+// both levels were replaced
+static void testClone(
+    TestDevice* testDevice)
+{
+    GR_GPU_MEMORY mems[3];
+    GR_IMAGE srcImage = deviceCreateImage(testDevice, IMAGE_SIZE, IMAGE_SIZE, MIP_COUNT, 1,
+                                          &mems[0]);
+    GR_IMAGE dstImage = deviceCreateImage(testDevice, IMAGE_SIZE, IMAGE_SIZE, MIP_COUNT, 1,
+                                          &mems[1]);
+    const unsigned mipSize = IMAGE_SIZE / 2;
+    const GR_GPU_SIZE mipOffset = IMAGE_SIZE * IMAGE_SIZE * DEVICE_PIXEL_SIZE;
+    GR_GPU_MEMORY readbackMem = mems[2] =
+        deviceAllocCpuMemory(testDevice, mipOffset + mipSize * mipSize * DEVICE_PIXEL_SIZE);
+    GR_CMD_BUFFER cmdBuffer = deviceBeginCmdBuffer(testDevice);
+
+    devicePrepareImage(cmdBuffer, srcImage, MIP_COUNT, GR_IMAGE_STATE_UNINITIALIZED,
+                       GR_IMAGE_STATE_CLEAR);
+    devicePrepareImage(cmdBuffer, dstImage, MIP_COUNT, GR_IMAGE_STATE_UNINITIALIZED,
+                       GR_IMAGE_STATE_CLEAR);
+    clearImage(cmdBuffer, srcImage, 0, mSrcColor);
+    clearImage(cmdBuffer, srcImage, 1, mSrcMipColor);
+    clearImage(cmdBuffer, dstImage, 0, mDstColor);
+    clearImage(cmdBuffer, dstImage, 1, mDstColor);
+    devicePrepareImage(cmdBuffer, srcImage, MIP_COUNT, GR_IMAGE_STATE_CLEAR,
+                       GR_IMAGE_STATE_GRAPHICS_SHADER_READ_ONLY);
+
+    // Both images stay in their states
+    grCmdCloneImageData(cmdBuffer, srcImage, GR_IMAGE_STATE_GRAPHICS_SHADER_READ_ONLY,
+                        dstImage, GR_IMAGE_STATE_CLEAR);
+
+    devicePrepareImage(cmdBuffer, dstImage, MIP_COUNT, GR_IMAGE_STATE_CLEAR,
+                       GR_IMAGE_STATE_DATA_TRANSFER_SOURCE);
+    deviceCopyImageToMemory(cmdBuffer, dstImage, 0, IMAGE_SIZE, IMAGE_SIZE, readbackMem, 0);
+    deviceCopyImageToMemory(cmdBuffer, dstImage, 1, mipSize, mipSize, readbackMem, mipOffset);
+    deviceSubmit(testDevice, cmdBuffer, COUNT_OF(mems), mems);
+
+    uint32_t* pixels = NULL;
+
+    CHECK(grMapMemory(readbackMem, 0, (GR_VOID**)&pixels) == GR_SUCCESS);
+    checkPixels(pixels, IMAGE_SIZE, IMAGE_SIZE, NULL, NULL, 0,
+                0, devicePackColor(mSrcColor));
+    checkPixels(pixels + IMAGE_SIZE * IMAGE_SIZE, mipSize, mipSize, NULL, NULL, 0,
+                0, devicePackColor(mSrcMipColor));
+    CHECK(grUnmapMemory(readbackMem) == GR_SUCCESS);
+
+    CHECK(grDestroyObject(cmdBuffer) == GR_SUCCESS);
+    CHECK(grDestroyObject(srcImage) == GR_SUCCESS);
+    CHECK(grDestroyObject(dstImage) == GR_SUCCESS);
+    for (unsigned i = 0; i < COUNT_OF(mems); i++) {
+        CHECK(grFreeMemory(mems[i]) == GR_SUCCESS);
+    }
+}
+
+int main(
+    int argc,
+    char* argv[])
+{
+    TestDevice testDevice;
+
+    deviceCreate(&testDevice);
+    testResolve(&testDevice);
+    testClone(&testDevice);
+    deviceDestroy(&testDevice);
+
+    printf("resolve and clone ok\n");
+    return 0;
+}
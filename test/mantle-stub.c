@@ -0,0 +1,283 @@
+#include "mantle-stub.h"
+
+#define STUB_SEMAPHORE_BASE (0x10000)
+
+StubStats gStubStats = { 0 };
+
+static volatile LONG mHandleCount = 0;
+static volatile LONG mSemaphoreCount = 0;
+static uint64_t mSemaphoreValues[STUB_MAX_SEMAPHORES];
+static uint64_t mPendingSemaphoreValues[STUB_MAX_SEMAPHORES]; // Submitted but not completed
+
+#define STUB_HANDLE(type) \
+    ((type)(uintptr_t)InterlockedIncrement(&mHandleCount))
+
+static unsigned getSemaphoreIndex(
+    VkSemaphore semaphore)
+{
+    unsigned index = (unsigned)((uintptr_t)semaphore - STUB_SEMAPHORE_BASE);
+
+    CHECK(index < (unsigned)mSemaphoreCount);
+    return index;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubCreateShaderModule(
+    VkDevice device,
+    const VkShaderModuleCreateInfo* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator,
+    VkShaderModule* pShaderModule)
+{
+    CHECK(pCreateInfo->codeSize > 0 && pCreateInfo->pCode != NULL);
+
+    gStubStats.shaderModuleCount++;
+    *pShaderModule = STUB_HANDLE(VkShaderModule);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubCreateDescriptorSetLayout(
+    VkDevice device,
+    const VkDescriptorSetLayoutCreateInfo* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator,
+    VkDescriptorSetLayout* pSetLayout)
+{
+    *pSetLayout = STUB_HANDLE(VkDescriptorSetLayout);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubCreatePipelineLayout(
+    VkDevice device,
+    const VkPipelineLayoutCreateInfo* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator,
+    VkPipelineLayout* pPipelineLayout)
+{
+    *pPipelineLayout = STUB_HANDLE(VkPipelineLayout);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubCreateDescriptorUpdateTemplate(
+    VkDevice device,
+    const VkDescriptorUpdateTemplateCreateInfo* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator,
+    VkDescriptorUpdateTemplate* pDescriptorUpdateTemplate)
+{
+    *pDescriptorUpdateTemplate = STUB_HANDLE(VkDescriptorUpdateTemplate);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubCreateGraphicsPipelines(
+    VkDevice device,
+    VkPipelineCache pipelineCache,
+    uint32_t createInfoCount,
+    const VkGraphicsPipelineCreateInfo* pCreateInfos,
+    const VkAllocationCallbacks* pAllocator,
+    VkPipeline* pPipelines)
+{
+    for (unsigned i = 0; i < createInfoCount; i++) {
+        gStubStats.graphicsPipelineCount++;
+        pPipelines[i] = STUB_HANDLE(VkPipeline);
+    }
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubCreateComputePipelines(
+    VkDevice device,
+    VkPipelineCache pipelineCache,
+    uint32_t createInfoCount,
+    const VkComputePipelineCreateInfo* pCreateInfos,
+    const VkAllocationCallbacks* pAllocator,
+    VkPipeline* pPipelines)
+{
+    for (unsigned i = 0; i < createInfoCount; i++) {
+        gStubStats.computePipelineCount++;
+        pPipelines[i] = STUB_HANDLE(VkPipeline);
+    }
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL stubDestroyPipeline(
+    VkDevice device,
+    VkPipeline pipeline,
+    const VkAllocationCallbacks* pAllocator)
+{
+}
+
+static VKAPI_ATTR void VKAPI_CALL stubGetDeviceQueue(
+    VkDevice device,
+    uint32_t queueFamilyIndex,
+    uint32_t queueIndex,
+    VkQueue* pQueue)
+{
+    *pQueue = (VkQueue)(uintptr_t)InterlockedIncrement(&mHandleCount);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubCreateCommandPool(
+    VkDevice device,
+    const VkCommandPoolCreateInfo* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator,
+    VkCommandPool* pCommandPool)
+{
+    *pCommandPool = STUB_HANDLE(VkCommandPool);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubCreateSemaphore(
+    VkDevice device,
+    const VkSemaphoreCreateInfo* pCreateInfo,
+    const VkAllocationCallbacks* pAllocator,
+    VkSemaphore* pSemaphore)
+{
+    const VkSemaphoreTypeCreateInfo* typeCreateInfo = pCreateInfo->pNext;
+    unsigned index = InterlockedIncrement(&mSemaphoreCount) - 1;
+
+    CHECK(index < STUB_MAX_SEMAPHORES);
+
+    // Only timeline semaphores are tracked
+    mSemaphoreValues[index] = typeCreateInfo != NULL ? typeCreateInfo->initialValue : 0;
+    mPendingSemaphoreValues[index] = mSemaphoreValues[index];
+    *pSemaphore = (VkSemaphore)(uintptr_t)(STUB_SEMAPHORE_BASE + index);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubQueueSubmit2(
+    VkQueue queue,
+    uint32_t submitCount,
+    const VkSubmitInfo2* pSubmits,
+    VkFence fence)
+{
+    gStubStats.submitCount++;
+    gStubStats.submitInfoCount += submitCount;
+
+    for (unsigned i = 0; i < submitCount; i++) {
+        for (unsigned j = 0; j < pSubmits[i].signalSemaphoreInfoCount; j++) {
+            const VkSemaphoreSubmitInfo* info = &pSubmits[i].pSignalSemaphoreInfos[j];
+            unsigned index = getSemaphoreIndex(info->semaphore);
+
+            CHECK(info->value > mPendingSemaphoreValues[index]);
+            mPendingSemaphoreValues[index] = info->value;
+        }
+    }
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubQueueWaitIdle(
+    VkQueue queue)
+{
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubGetSemaphoreCounterValue(
+    VkDevice device,
+    VkSemaphore semaphore,
+    uint64_t* pValue)
+{
+    *pValue = mSemaphoreValues[getSemaphoreIndex(semaphore)];
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL stubWaitSemaphores(
+    VkDevice device,
+    const VkSemaphoreWaitInfo* pWaitInfo,
+    uint64_t timeout)
+{
+    StubWait* wait = &gStubStats.lastWait;
+    bool isAny = (pWaitInfo->flags & VK_SEMAPHORE_WAIT_ANY_BIT) != 0;
+    unsigned signaledCount = 0;
+
+    CHECK(pWaitInfo->semaphoreCount > 0 && pWaitInfo->semaphoreCount <= STUB_MAX_WAITS);
+
+    wait->callCount++;
+    wait->flags = pWaitInfo->flags;
+    wait->semaphoreCount = pWaitInfo->semaphoreCount;
+    wait->timeout = timeout;
+
+    for (unsigned i = 0; i < pWaitInfo->semaphoreCount; i++) {
+        unsigned index = getSemaphoreIndex(pWaitInfo->pSemaphores[i]);
+
+        wait->semaphores[i] = pWaitInfo->pSemaphores[i];
+        wait->values[i] = pWaitInfo->pValues[i];
+        signaledCount += mSemaphoreValues[index] >= pWaitInfo->pValues[i];
+    }
+
+    // Nothing ever completes behind the test's back, don't actually block
+    if (isAny ? signaledCount > 0 : signaledCount == pWaitInfo->semaphoreCount) {
+        return VK_SUCCESS;
+    }
+    return VK_TIMEOUT;
+}
+
+GrDevice* stubCreateDevice()
+{
+    GrDevice* grDevice = calloc(1, sizeof(GrDevice));
+
+    // Locks and condition variables are zero-initialized
+    grDevice->grBaseObj.grObjType = GR_OBJ_TYPE_DEVICE;
+    grDevice->device = (VkDevice)(uintptr_t)InterlockedIncrement(&mHandleCount);
+    grDevice->renderThreadId = GetCurrentThreadId();
+
+    VULKAN_DEVICE* vkd = &grDevice->vkd;
+    vkd->vkCreateShaderModule = stubCreateShaderModule;
+    vkd->vkCreateDescriptorSetLayout = stubCreateDescriptorSetLayout;
+    vkd->vkCreatePipelineLayout = stubCreatePipelineLayout;
+    vkd->vkCreateDescriptorUpdateTemplate = stubCreateDescriptorUpdateTemplate;
+    vkd->vkCreateGraphicsPipelines = stubCreateGraphicsPipelines;
+    vkd->vkCreateComputePipelines = stubCreateComputePipelines;
+    vkd->vkDestroyPipeline = stubDestroyPipeline;
+    vkd->vkGetDeviceQueue = stubGetDeviceQueue;
+    vkd->vkCreateCommandPool = stubCreateCommandPool;
+    vkd->vkCreateSemaphore = stubCreateSemaphore;
+    vkd->vkQueueSubmit2 = stubQueueSubmit2;
+    vkd->vkQueueWaitIdle = stubQueueWaitIdle;
+    vkd->vkGetSemaphoreCounterValue = stubGetSemaphoreCounterValue;
+    vkd->vkWaitSemaphores = stubWaitSemaphores;
+
+    return grDevice;
+}
+
+GrQueue* stubCreateQueue(
+    GrDevice* grDevice)
+{
+    return grQueueCreate(grDevice, 0, 0);
+}
+
+void stubCompleteSemaphore(
+    VkSemaphore semaphore)
+{
+    unsigned index = getSemaphoreIndex(semaphore);
+
+    mSemaphoreValues[index] = mPendingSemaphoreValues[index];
+}
+
+uint64_t stubGetSemaphoreValue(
+    VkSemaphore semaphore)
+{
+    return mSemaphoreValues[getSemaphoreIndex(semaphore)];
+}
+
+uint64_t stubGetPendingSemaphoreValue(
+    VkSemaphore semaphore)
+{
+    return mPendingSemaphoreValues[getSemaphoreIndex(semaphore)];
+}
+
+void* stubReadFile(
+    const char* path,
+    size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+
+    if (file == NULL) {
+        fprintf(stderr, "failed to open %s\n", path);
+        exit(1);
+    }
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* data = malloc(*size + 1);
+    CHECK(fread(data, 1, *size, file) == *size);
+    data[*size] = '\0'; // Text reports are read as strings
+    fclose(file);
+
+    return data;
+}
@@ -0,0 +1,51 @@
+#ifndef MANTLE_STUB_H_
+#define MANTLE_STUB_H_
+
+#include "check.h"
+#include "mantle_internal.h"
+
+#define STUB_MAX_SEMAPHORES (64)
+#define STUB_MAX_WAITS      (8)
+
+// Arguments of the last vkWaitSemaphores call
+typedef struct {
+    unsigned callCount;
+    VkSemaphoreWaitFlags flags;
+    unsigned semaphoreCount;
+    VkSemaphore semaphores[STUB_MAX_WAITS];
+    uint64_t values[STUB_MAX_WAITS];
+    uint64_t timeout;
+} StubWait;
+
+typedef struct {
+    unsigned shaderModuleCount;
+    unsigned graphicsPipelineCount;
+    unsigned computePipelineCount;
+    unsigned submitCount; // vkQueueSubmit2 calls
+    unsigned submitInfoCount;
+    StubWait lastWait;
+} StubStats;
+
+extern StubStats gStubStats;
+
+// Device whose Vulkan dispatch only implements what the tests exercise. Semaphore signals
+// submitted to a queue only land once the test completes that semaphore.
+GrDevice* stubCreateDevice();
+
+GrQueue* stubCreateQueue(
+    GrDevice* grDevice);
+
+void stubCompleteSemaphore(
+    VkSemaphore semaphore);
+
+uint64_t stubGetSemaphoreValue(
+    VkSemaphore semaphore);
+
+uint64_t stubGetPendingSemaphoreValue(
+    VkSemaphore semaphore);
+
+void* stubReadFile(
+    const char* path,
+    size_t* size);
+
+#endif // MANTLE_STUB_H_